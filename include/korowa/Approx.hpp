@@ -0,0 +1,297 @@
+#pragma once
+#ifndef KOROWA_APPROX_HPP
+#define KOROWA_APPROX_HPP
+
+// Piecewise Chebyshev approximants of expensive functions over a bounded domain.
+// [from, to] is split into equal pieces, each one a Chebyshev series of the same degree, so a
+// point finds its piece by one multiplication and every lane runs the same Clenshaw loop.
+// Pieces double until the series converge and the error measured between the sampled nodes
+// is within the tolerance.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <korowa/Solver.hpp>
+#include <korowa/SyntaxError.hpp>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace korowa {
+
+/**
+ * @brief f on [from, to] as pieces Chebyshev series of degree each, absolute error within tolerance
+ */
+struct Approximant {
+    double from = 0, to = 0;
+    double tolerance = 0;
+    double maxError = 0;  // largest error seen on the check points
+    uint32_t pieces = 0, degree = 0;
+    std::vector<double> coefficients{};  // piece after piece, degree + 1 of them each
+    uint64_t samples = 0;                // evaluations of f spent on building
+
+    bool contains(double x) const { return x >= from and x <= to; }
+
+    /// @brief Value at x, x inside [from, to]
+    double operator()(double x) const {
+        double out;
+        evaluate(&x, 1, &out);
+        return out;
+    }
+
+    /**
+     * @brief Values at count points by Clenshaw's recurrence, lane by lane for every coefficient.
+     * Points outside [from, to] get the nearest piece extrapolated, callers replace them.
+     */
+    void evaluate(const double* xs, size_t count, double* out) const {
+        constexpr size_t chunk = 64;
+        const auto scale = pieces / (to - from);
+        const auto stride = size_t(degree) + 1;
+
+        for (size_t first = 0; first < count; first += chunk) {
+            const auto size = std::min(chunk, count - first);
+            double u[chunk], b1[chunk], b2[chunk];
+            const double* c[chunk];
+
+            for (size_t i = 0; i < size; ++i) {
+                const auto t = (xs[first + i] - from) * scale;
+                // written so a NaN t lands on piece 0, std::max would pass it through
+                const auto piece = std::min(t >= 0 ? std::floor(t) : 0.0, double(pieces - 1));
+                u[i] = 2 * (t - piece) - 1;
+                c[i] = coefficients.data() + size_t(piece) * stride;
+                b1[i] = b2[i] = 0;
+            }
+            for (auto k = degree; k > 0; --k)
+                for (size_t i = 0; i < size; ++i) {
+                    const auto b0 = 2 * u[i] * b1[i] - b2[i] + c[i][k];
+                    b2[i] = b1[i];
+                    b1[i] = b0;
+                }
+            for (size_t i = 0; i < size; ++i) out[first + i] = u[i] * b1[i] - b2[i] + c[i][0];
+        }
+    }
+};
+
+namespace detail {
+
+static constexpr uint32_t chebyshevNodes = 33;       // samples per piece, the highest degree + 1
+static constexpr uint32_t maxApproximantPieces = 1 << 14;
+
+/**
+ * @brief Chebyshev coefficients of the values at the nodes cos(pi (j + 1/2) / n) of [-1, 1]
+ */
+static void chebyshevCoefficients(const double* values, double* coefficients) {
+    constexpr auto n = chebyshevNodes;
+    for (uint32_t k = 0; k < n; ++k) {
+        double sum = 0;
+        for (uint32_t j = 0; j < n; ++j) sum += values[j] * std::cos(my::PI * k * (j + 0.5) / n);
+        coefficients[k] = (k ? 2.0 : 1.0) / n * sum;
+    }
+}
+
+/**
+ * @brief Smallest degree dropping at most budget of coefficients, n if the series doesn't converge
+ * @param noise rounding error of every coefficient
+ */
+static uint32_t convergedDegree(const double* coefficients, double budget, double noise) {
+    constexpr auto n = chebyshevNodes;
+    // the last coefficients estimate what the truncated series misses beyond them
+    if (std::fabs(coefficients[n - 1]) + std::fabs(coefficients[n - 2]) > budget / 4 + 2 * noise)
+        return n;
+
+    double tail = 0;
+    auto degree = n - 1;
+    while (degree > 0 and tail + std::fabs(coefficients[degree]) <= budget)
+        tail += std::fabs(coefficients[degree--]);
+    return degree;
+}
+
+}  // namespace detail
+
+/**
+ * @brief Builds an approximant of f over [from, to]
+ *
+ * @param f function to approximate, must be finite on [from, to]
+ * @param from lower bound of the domain
+ * @param to upper bound of the domain
+ * @param tolerance maximum absolute error
+ * @param err occurred error reference
+ * @return Approximant approximant, empty on error
+ */
+Approximant approximate(Objective f, double from, double to, double tolerance, SyntaxError& err) {
+    using namespace detail;
+
+    if (not(from < to) or not std::isfinite(to - from) or not(tolerance > 0)) {
+        err = SyntaxError("Expected finite from < to and tolerance > 0", SyntaxError::Type::Evaluation);
+        return {};
+    }
+    if (not f.deterministic()) {
+        err = SyntaxError("Unable to approximate random expression", SyntaxError::Type::Evaluation);
+        return {};
+    }
+
+    constexpr auto n = chebyshevNodes;
+    double nodes[n];
+    for (uint32_t j = 0; j < n; ++j) nodes[j] = std::cos(my::PI * (j + 0.5) / n);
+
+    Approximant result;
+    result.from = from, result.to = to, result.tolerance = tolerance;
+    std::vector<double> xs, values, series;
+
+    for (uint32_t pieces = 1; pieces <= maxApproximantPieces; pieces *= 2) {
+        const auto width = (to - from) / pieces;
+        xs.resize(size_t(pieces) * n);
+        for (uint32_t p = 0; p < pieces; ++p)
+            for (uint32_t j = 0; j < n; ++j) xs[p * n + j] = from + width * (p + (nodes[j] + 1) / 2);
+        values.resize(xs.size());
+        f(xs.data(), xs.size(), values.data());
+        result.samples += xs.size();
+
+        if (not std::all_of(values.begin(), values.end(), [](double v) { return std::isfinite(v); })) {
+            err = SyntaxError("Unable to approximate, the expression isn't finite on the domain",
+                              SyntaxError::Type::Evaluation);
+            return {};
+        }
+
+        // half of the tolerance for truncation, the rest for interpolation and rounding
+        series.resize(xs.size());
+        uint32_t degree = 0;
+        for (uint32_t p = 0; p < pieces and degree < n; ++p) {
+            const auto* piece = values.data() + p * n;
+            const auto magnitude = std::fabs(*std::max_element(
+                piece, piece + n, [](double a, double b) { return std::fabs(a) < std::fabs(b); }));
+            chebyshevCoefficients(piece, series.data() + p * n);
+            degree = std::max(degree, convergedDegree(series.data() + p * n, tolerance / 2,
+                                                      n * magnitude * 0x1p-52));
+        }
+        if (degree >= n) continue;
+
+        result.pieces = pieces, result.degree = degree;
+        result.coefficients.resize(size_t(pieces) * (degree + 1));
+        for (uint32_t p = 0; p < pieces; ++p)
+            std::copy_n(series.data() + p * n, degree + 1, result.coefficients.data() + p * (degree + 1));
+
+        // points halfway between nodes and the ends of pieces, where interpolation errs most
+        for (uint32_t p = 0; p < pieces; ++p) {
+            for (uint32_t j = 0; j < n; ++j) {
+                const auto u = j + 1 < n ? (nodes[j] + nodes[j + 1]) / 2 : -1.0;
+                xs[p * n + j] = std::min(to, from + width * (p + (u + 1) / 2));
+            }
+        }
+        f(xs.data(), xs.size(), values.data());
+        result.samples += xs.size();
+        series.resize(xs.size());
+        result.evaluate(xs.data(), xs.size(), series.data());
+
+        result.maxError = 0;
+        for (size_t i = 0; i < xs.size(); ++i)
+            result.maxError = std::max(result.maxError, std::fabs(series[i] - values[i]));
+        if (result.maxError <= tolerance) return result;
+    }
+
+    err = SyntaxError(my::format("Unable to approximate within {} using {} pieces", tolerance,
+                                 maxApproximantPieces),
+                      SyntaxError::Type::Evaluation);
+    return {};
+}
+
+/**
+ * @brief Approximants shared across calls, keyed by the function's identity, domain and tolerance.
+ * Thread safe, building happens outside the lock.
+ */
+class ApproximantCache {
+   public:
+    static ApproximantCache& shared() {
+        static ApproximantCache cache;
+        return cache;
+    }
+
+    /**
+     * @brief Cached approximant of f, built on a miss
+     *
+     * @param cached set to whether the approximant came from the cache
+     * @return approximant, nullptr on error
+     */
+    std::shared_ptr<const Approximant> get(const Objective& f, double from, double to,
+                                           double tolerance, SyntaxError& err, bool& cached) {
+        auto key = f.identity();
+        for (const auto part : {from, to, tolerance}) {
+            uint64_t bits;
+            std::memcpy(&bits, &part, sizeof(bits));
+            key.push_back(bits);
+        }
+
+        {
+            std::lock_guard lock(mutex);
+            if (auto it = entries.find(key); it != entries.end()) {
+                cached = true;
+                return it->second;
+            }
+        }
+
+        cached = false;
+        auto approximant = std::make_shared<const Approximant>(approximate(f, from, to, tolerance, err));
+        if (err) return nullptr;
+
+        std::lock_guard lock(mutex);
+        if (entries.size() >= capacity) entries.clear();
+        return entries.emplace(std::move(key), std::move(approximant)).first->second;
+    }
+
+    void clear() {
+        std::lock_guard lock(mutex);
+        entries.clear();
+    }
+
+   private:
+    static constexpr size_t capacity = 64;
+
+    struct Hash {
+        size_t operator()(const std::vector<uint64_t>& key) const {
+            uint64_t hash = 0xcbf29ce484222325;
+            for (const auto word : key) hash = (hash ^ word) * 0x100000001b3;
+            return size_t(hash);
+        }
+    };
+
+    std::mutex mutex{};
+    std::unordered_map<std::vector<uint64_t>, std::shared_ptr<const Approximant>, Hash> entries{};
+};
+
+/**
+ * @brief Objective evaluated by its approximant inside the domain and exactly outside of it.
+ * Not thread safe, every thread works on its own copy.
+ */
+class Approximated {
+   public:
+    Approximated(Objective exact, std::shared_ptr<const Approximant> approximant)
+        : exact(std::move(exact)), approximant(std::move(approximant)) {}
+
+    double operator()(double x) {
+        ++evaluations;
+        return approximant->contains(x) ? (*approximant)(x) : exact(x);
+    }
+
+    /// @brief Values at count points, failed as Objective's
+    void operator()(const double* xs, size_t count, double* out, uint64_t* failed = nullptr) {
+        evaluations += count;
+        approximant->evaluate(xs, count, out);
+        for (size_t i = 0; i < count; ++i)
+            if (not approximant->contains(xs[i])) out[i] = exact(xs[i]);
+        if (failed)
+            for (size_t first = 0; first < count; first += blockSize)
+                failed[first / blockSize] = failedLanes(out + first, std::min(blockSize, count - first));
+    }
+
+    uint64_t evaluations = 0;
+
+   private:
+    Objective exact;
+    std::shared_ptr<const Approximant> approximant;
+};
+
+}  // namespace korowa
+
+#endif  // KOROWA_APPROX_HPP
@@ -0,0 +1,110 @@
+#pragma once
+#ifndef KOROWA_ARRAY_HPP
+#define KOROWA_ARRAY_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace korowa {
+
+/**
+ * @brief Result of array evaluation, scalar results hold exactly one value
+ */
+struct Array {
+    std::vector<double> values{};
+    bool scalar = true;
+};
+
+namespace detail {
+
+/**
+ * @brief Bump allocator for intermediate arrays of one evaluation.
+ * Blocks are kept between evaluations, reset only rewinds, so steady state
+ * evaluation doesn't touch the heap. Every allocation is cache line aligned.
+ */
+class Arena {
+   public:
+    static constexpr size_t alignment = 64;
+    static constexpr size_t blockDoubles = 16 * 1024;
+
+    double* allocate(size_t count) {
+        count = (count + lineDoubles - 1) / lineDoubles * lineDoubles;
+        if (count == 0) count = lineDoubles;
+
+        while (current < blocks.size()) {
+            auto& block = blocks[current];
+            if (offset + count <= block.size) {
+                auto* result = block.data.get() + offset;
+                offset += count;
+                return result;
+            }
+            ++current;
+            offset = 0;
+        }
+
+        blocks.push_back({std::unique_ptr<double[], Free>(static_cast<double*>(operator new(
+                              std::max(count, blockDoubles) * sizeof(double),
+                              std::align_val_t(alignment)))),
+                          std::max(count, blockDoubles)});
+        current = blocks.size() - 1;
+        offset = count;
+        return blocks.back().data.get();
+    }
+
+    void reset() {
+        current = 0;
+        offset = 0;
+    }
+
+    /// @brief Arena of the calling thread
+    static Arena& local() {
+        thread_local Arena arena;
+        return arena;
+    }
+
+   private:
+    static constexpr size_t lineDoubles = alignment / sizeof(double);
+
+    struct Free {
+        void operator()(double* ptr) const { operator delete(ptr, std::align_val_t(alignment)); }
+    };
+    struct Block {
+        std::unique_ptr<double[], Free> data;
+        size_t size;
+    };
+
+    std::vector<Block> blocks{};
+    size_t current = 0;
+    size_t offset = 0;
+};
+
+/**
+ * @brief Array or scalar operand of array evaluation, data lives in the Arena
+ */
+struct Operand {
+    double* data = nullptr;
+    uint32_t size = 0;
+    bool array = false;
+};
+
+/// @brief out[i] = fn(a[i * strideA], b[i * strideB]), stride 0 broadcasts a scalar
+template <class Fn>
+static void zipWith(const double* a, size_t strideA, const double* b, size_t strideB, double* out,
+                    size_t count, Fn&& fn) {
+    if (strideA and strideB)
+        for (size_t i = 0; i < count; ++i) out[i] = fn(a[i], b[i]);
+    else if (strideA)
+        for (size_t i = 0; i < count; ++i) out[i] = fn(a[i], b[0]);
+    else
+        for (size_t i = 0; i < count; ++i) out[i] = fn(a[0], b[i * strideB]);
+}
+
+}  // namespace detail
+
+}  // namespace korowa
+
+#endif  // KOROWA_ARRAY_HPP
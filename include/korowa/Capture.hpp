@@ -0,0 +1,135 @@
+#pragma once
+#ifndef KOROWA_CAPTURE_HPP
+#define KOROWA_CAPTURE_HPP
+
+// Evaluations recorded to be replayed later, e.g. real traffic against a newer build.
+// A record keeps the values of the variables the expression read, so replaying it needs
+// nothing but the record, and the time spent in each stage, so a slowdown shows in the
+// stage it happened in.
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <korowa/Exact.hpp>
+#include <korowa/Lexer.hpp>
+#include <korowa/SyntaxError.hpp>
+#include <korowa/Variables.hpp>
+#include <limits>
+#include <string>
+
+namespace korowa {
+
+/// @brief Nanoseconds spent in each stage of one evaluation
+struct Timings {
+    uint64_t tokenize = 0, parse = 0, evaluate = 0;
+
+    uint64_t total() const { return tokenize + parse + evaluate; }
+};
+
+/// @brief One evaluation, as captured or as replayed
+struct Capture {
+    std::string expression{};
+    bool session = false;    // whether variables were available
+    Variables variables{};   // the ones it read, as they were before
+    double result = std::numeric_limits<double>::quiet_NaN();
+    Exact exact{};        // of integer-only expressions, past 2^53 more precise than result
+    std::string error{};  // message, empty if it evaluated
+    Timings timings{};
+};
+
+/**
+ * @brief Evaluates math expression as the calculator does, integer-only expressions exactly
+ * and everything else with eval, timing every stage
+ *
+ * @param input string representing math expression
+ * @param err occurred error reference
+ * @param variables saved variables, nullptr if variables are not available
+ * @param timings stages of this evaluation
+ * @return Exact evaluated result, exact only for integer-only expressions
+ */
+Exact evalTimed(const std::string& input, SyntaxError& err,
+                Variables* variables, Timings& timings) {
+    using namespace detail;
+    using Clock = std::chrono::steady_clock;
+
+    auto since = Clock::now();
+    const auto lap = [&since] {
+        const auto now = Clock::now();
+        const auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(now - since).count();
+        since = now;
+        return uint64_t(nanoseconds);
+    };
+
+    const auto tokens = tokenize(input);
+    timings.tokenize = lap();
+    auto tokenQueue = parse(tokens, err);
+    timings.parse = lap();
+    if (err) return std::numeric_limits<double>::quiet_NaN();
+
+    Exact result;
+    if (not evalExact(tokenQueue, result, variables)) {
+        KOROWA_STATS_ADD(Evaluations, 1);
+        result.value = variables ? evalParsed(std::move(tokenQueue), err, *variables)
+                                 : evalParsed(std::move(tokenQueue), err);
+    }
+    timings.evaluate = lap();
+    return result;
+}
+
+/**
+ * @brief Evaluates math expression with evalTimed and records it
+ *
+ * @param expression string representing math expression
+ * @param err occurred error reference
+ * @param variables saved variables, nullptr if variables are not available
+ * @return Capture record of the evaluation
+ */
+Capture capture(const std::string& expression, SyntaxError& err,
+                Variables* variables) {
+    Capture record{expression, variables != nullptr};
+
+    // taken before the evaluation, which may assign one of them
+    if (variables)
+        for (const auto& token : detail::tokenize(expression))
+            if (token.spec == detail::Variable)
+                if (auto it = variables->find(token.value); it != variables->end()) record.variables[it->first] = it->second;
+
+    record.exact = evalTimed(expression, err, variables, record.timings);
+    record.result = record.exact.value;
+    if (err) record.error = err.what();
+    return record;
+}
+
+/**
+ * @brief Evaluates the captured expression again on its recorded variables
+ *
+ * @param captured record of capture
+ * @return Capture record of this evaluation
+ */
+Capture replay(const Capture& captured) {
+    Capture record{captured.expression, captured.session, captured.variables};
+
+    auto variables = captured.variables;
+    auto err = SyntaxError();
+    record.exact = evalTimed(record.expression, err, record.session ? &variables : nullptr, record.timings);
+    record.result = record.exact.value;
+    if (err) record.error = err.what();
+    return record;
+}
+
+/// @return whether both evaluations gave the same result or the same error
+bool sameOutcome(const Capture& a, const Capture& b) {
+    if (a.error != b.error) return false;
+    return a.result == b.result or (std::isnan(a.result) and std::isnan(b.result));
+}
+
+/// @return whether expression gives the same result every time, random ones can't be verified
+bool deterministic(const std::string& expression) {
+    for (const auto& token : detail::tokenize(expression))
+        if (not detail::isDeterministic(token.spec)) return false;
+    return true;
+}
+
+}  // namespace korowa
+
+#endif  // KOROWA_CAPTURE_HPP
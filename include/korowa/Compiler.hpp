@@ -0,0 +1,376 @@
+#pragma once
+#ifndef KOROWA_COMPILER_HPP
+#define KOROWA_COMPILER_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <korowa/FastMath.hpp>
+#include <korowa/Lexer.hpp>
+#include <korowa/SyntaxError.hpp>
+#include <limits>
+#include <map>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace korowa {
+
+/**
+ * @brief Single step of a compiled expression.
+ * Number pushes value, Variable pushes the value bound to slot,
+ * generators push a fresh value, every other op pops its operands and pushes the result.
+ */
+struct Instruction {
+    detail::Spec op = detail::Unknown;
+    uint32_t slot = 0;
+    double value = 0;
+};
+
+/**
+ * @brief Non-owning view of compiled code, of a Program or of a mapped library
+ */
+struct ProgramView {
+    const Instruction* code = nullptr;
+    uint32_t size = 0;
+    uint32_t maxDepth = 0;
+
+    const Instruction* begin() const { return code; }
+    const Instruction* end() const { return code + size; }
+};
+
+/**
+ * @brief Expression tokenized, parsed and resolved once, ready to be evaluated many times.
+ * Variables are referenced by slot, slot i holds the variable named symbols[i].
+ */
+struct Program {
+    std::vector<Instruction> code{};
+    std::vector<std::string> symbols{};
+    std::string assignTo{};  // target of "name = (...)", empty if none
+    uint32_t maxDepth = 0;   // operand stack size the program needs
+
+    /// @return slot of variable name or -1 if program doesn't reference it
+    long slotOf(const std::string& name) const {
+        auto it = std::find(symbols.begin(), symbols.end(), name);
+        return it == symbols.end() ? -1 : it - symbols.begin();
+    }
+
+    ProgramView view() const { return {code.data(), (uint32_t)code.size(), maxDepth}; }
+};
+
+namespace detail {
+
+static constexpr uint8_t arity(Spec op) {
+    if (isTernaryFn(op)) return 3;
+    if (isBinaryFn(op) or isBinaryOp(op)) return 2;
+    if (isUnaryFn(op) or isUnaryOp(op)) return 1;
+    return 0;
+}
+
+}  // namespace detail
+
+/**
+ * @brief Compiles parsed math expression into a Program, see compile of the text
+ *
+ * @param tokenQueue parsed expression, left unchanged
+ * @param err occurred error reference
+ * @return Program compiled expression, empty on error
+ */
+Program compile(const detail::TokenQueue& tokenQueue, SyntaxError& err) {
+    using namespace detail;
+
+    Program program;
+
+    if (tokenQueue.empty()) {
+        err = SyntaxError(SyntaxError::Code::EmptyExpression);
+        return {};
+    }
+
+    auto first = tokenQueue.begin();
+    if (tokenQueue.front().spec == Variable and tokenQueue.back().spec == Equals) {
+        program.assignTo = tokenQueue.front().value;
+        ++first;
+    }
+
+    program.code.reserve(tokenQueue.end() - first);
+    long depth = 0;
+
+    for (auto it = first; it != tokenQueue.end(); ++it) {
+        const auto& token = *it;
+        Instruction instruction{token.spec};
+
+        if (token.spec == Number) {
+            instruction.value = my::parse<double>(token.value);
+        } else if (isConstant(token.spec)) {
+            instruction = {Number, 0, getConstant(token.spec)};
+        } else if (token.spec == Variable) {
+            auto slot = program.slotOf(token.value);
+            if (slot < 0) {
+                slot = program.symbols.size();
+                program.symbols.push_back(token.value);
+            }
+            instruction.slot = slot;
+        } else if (token.spec == Equals) {
+            // like eval, assignment ends the expression at the first =
+            if (program.assignTo.empty()) {
+                err = SyntaxError(SyntaxError::Code::AssignmentToNothing);
+                return {};
+            }
+            break;
+        } else if (token.spec == RightArrPars or token.spec == Factor) {
+            err = SyntaxError("Arrays are not supported in compiled expressions",
+                              SyntaxError::Type::Evaluation);
+            return {};
+        } else if (not isOperator(token.spec) and not isFunction(token.spec) and
+                   not isGenerator(token.spec)) {
+            err = SyntaxError(SyntaxError::Code::UnknownSymbol, token.value);
+            return {};
+        }
+
+        depth += 1 - arity(instruction.op);
+        if (depth <= 0) {
+            err = SyntaxError(SyntaxError::Code::EvaluationError);
+            return {};
+        }
+        program.maxDepth = std::max<uint32_t>(program.maxDepth, depth);
+        program.code.push_back(instruction);
+    }
+
+    if (program.maxDepth > maxStackDepth) {
+        err = nestedTooDeeply(program.maxDepth);
+        return {};
+    }
+
+    if (depth != 1) {
+        err = SyntaxError(SyntaxError::Code::RedundantValues, {}, depth);
+        return {};
+    }
+
+    return program;
+}
+
+/**
+ * @brief Compiles math expression into a Program.
+ * Constants and number literals are resolved, operand stack depth is checked
+ * and limited to detail::maxStackDepth.
+ *
+ * @param input string representing math expression
+ * @param err occurred error reference
+ * @return Program compiled expression, empty on error
+ */
+Program compile(const std::string& input, SyntaxError& err) {
+    const auto tokenQueue = detail::parse(detail::tokenize(input), err);
+    if (err) return {};
+    return compile(tokenQueue, err);
+}
+
+/**
+ * @brief Checks code which didn't come from compile, e.g. read from a file:
+ * every op is one compile emits, slots are bound, the stack never underflows,
+ * maxDepth is its exact peak within maxStackDepth and exactly one value is left
+ *
+ * @param program code to check
+ * @param symbolCount number of variable slots
+ */
+bool verify(const ProgramView& program, size_t symbolCount) {
+    using namespace detail;
+
+    long depth = 0, peak = 0;
+    for (const auto& instruction : program) {
+        // read the raw value, an unchecked one may be no Spec at all. The underlying type is
+        // signed on some compilers and unsigned on others, as unsigned negative ones are too large
+        std::underlying_type_t<detail::Spec> raw;
+        std::memcpy(&raw, &instruction.op, sizeof(raw));
+        if (static_cast<uint32_t>(raw) >= uint32_t(SpecCount)) return false;
+
+        const auto op = detail::Spec(raw);
+        if (op == Equals or op == Factor) return false;
+        if (op == Variable and instruction.slot >= symbolCount) return false;
+        if (op != Number and op != Variable and not isOperator(op) and not isFunction(op) and
+            not isGenerator(op))
+            return false;
+
+        depth += 1 - arity(op);
+        if (depth <= 0) return false;
+        peak = std::max(peak, depth);
+    }
+    return depth == 1 and peak == program.maxDepth and peak <= (long)maxStackDepth;
+}
+
+/**
+ * @brief Values of program variables taken from the map, ordered by slot
+ *
+ * @param program compiled expression
+ * @param variables map of saved variables
+ * @param err occurred error reference, set if some variable is missing
+ * @return std::vector<double> slot values
+ */
+template <class Variables>
+std::vector<double> bindVariables(const Program& program, const Variables& variables, SyntaxError& err) {
+    std::vector<double> slots;
+    slots.reserve(program.symbols.size());
+    for (const auto& name : program.symbols) {
+        auto it = variables.find(name);
+        if (it == variables.end()) {
+            err = SyntaxError(SyntaxError::Code::UnknownVariable, name);
+            return {};
+        }
+        slots.push_back(it->second);
+    }
+    return slots;
+}
+
+static double applyUnary(detail::Spec op, double a) { return detail::performUnaryFn(op, a); }
+
+static double applyBinary(detail::Spec op, double a, double b) {
+    return detail::performBinaryFn(op, a, b);
+}
+
+static double applyTernary(detail::Spec op, double a, double b, double c) {
+    return detail::performTernaryFn(op, a, b, c);
+}
+
+/**
+ * @brief Evaluates compiled program for one point.
+ * Value may be any type with applyUnary/applyBinary/applyTernary overloads constructible from double.
+ * The stack is sized by maxDepth up front, compile and verify guarantee it suffices.
+ *
+ * @param program compiled expression
+ * @param slots values of program variables, ordered by slot
+ * @param stack scratch buffer, reused between calls
+ * @return Value evaluated result
+ */
+template <class Value>
+Value execute(const ProgramView& program, const Value* slots, std::vector<Value>& stack) {
+    using namespace detail;
+
+    if (stack.size() < program.maxDepth) stack.resize(program.maxDepth);
+    auto* values = stack.data();
+    size_t size = 0;
+
+    for (const auto& instruction : program) {
+        switch (arity(instruction.op)) {
+            case 3:
+                size -= 2;
+                values[size - 1] = applyTernary(instruction.op, values[size - 1], values[size],
+                                                values[size + 1]);
+                break;
+            case 2:
+                --size;
+                values[size - 1] = applyBinary(instruction.op, values[size - 1], values[size]);
+                break;
+            case 1:
+                values[size - 1] = applyUnary(instruction.op, values[size - 1]);
+                break;
+            default:
+                if (instruction.op == Variable)
+                    values[size++] = slots[instruction.slot];
+                else if (instruction.op == Number)
+                    values[size++] = Value(instruction.value);
+                else
+                    values[size++] = Value(getGenerated(instruction.op));
+        }
+    }
+
+    return values[0];
+}
+
+template <class Value>
+Value execute(const ProgramView& program, const Value* slots) {
+    std::vector<Value> stack(program.maxDepth);
+    return execute(program, slots, stack);
+}
+
+template <class Value>
+Value execute(const Program& program, const Value* slots, std::vector<Value>& stack) {
+    return execute(program.view(), slots, stack);
+}
+
+template <class Value>
+Value execute(const Program& program, const Value* slots) {
+    return execute(program.view(), slots);
+}
+
+static constexpr size_t blockSize = 64;
+
+/**
+ * @brief Evaluates compiled program for up to blockSize points at once.
+ * Runs instruction by instruction over all lanes, so every operation is a tight loop
+ * over contiguous values.
+ *
+ * @param program compiled expression
+ * @param lanes number of points, at most blockSize
+ * @param load load(slot, lane) returns value of a variable for a point
+ * @param out lanes results
+ * @param stack scratch buffer, reused between calls
+ * @param accuracy kernels of transcendental functions, see FastMath.hpp, double only
+ */
+template <class Value, class Load>
+void executeBlock(const ProgramView& program, size_t lanes, Load&& load, Value* out,
+                  std::vector<Value>& stack, Accuracy accuracy = Accuracy::Strict) {
+    using namespace detail;
+
+    stack.resize(std::max<size_t>(program.maxDepth, 1) * blockSize);
+    auto* top = stack.data() - blockSize;  // current top row
+
+    for (const auto& instruction : program) {
+        switch (arity(instruction.op)) {
+            case 3: {
+                const auto *b = top - blockSize, *c = top;
+                top -= 2 * blockSize;
+                for (size_t lane = 0; lane < lanes; ++lane)
+                    top[lane] = applyTernary(instruction.op, top[lane], b[lane], c[lane]);
+            } break;
+            case 2: {
+                const auto* b = top;
+                top -= blockSize;
+                for (size_t lane = 0; lane < lanes; ++lane)
+                    top[lane] = applyBinary(instruction.op, top[lane], b[lane]);
+            } break;
+            case 1:
+                if constexpr (std::is_same_v<Value, double>)
+                    if (fastmath::apply(instruction.op, top, lanes, accuracy)) break;
+                for (size_t lane = 0; lane < lanes; ++lane)
+                    top[lane] = applyUnary(instruction.op, top[lane]);
+                break;
+            default:
+                top += blockSize;
+                if (instruction.op == Variable)
+                    for (size_t lane = 0; lane < lanes; ++lane)
+                        top[lane] = load(instruction.slot, lane);
+                else if (instruction.op == Number)
+                    std::fill(top, top + lanes, Value(instruction.value));
+                else if (instruction.op == RndGen or instruction.op == NormGen) {
+                    double values[blockSize];
+                    if (instruction.op == RndGen)
+                        random::fill(values, lanes);
+                    else
+                        random::fillNormal(values, lanes);
+                    std::copy(values, values + lanes, top);
+                } else
+                    for (size_t lane = 0; lane < lanes; ++lane)
+                        top[lane] = Value(getGenerated(instruction.op));
+        }
+    }
+
+    std::copy(top, top + lanes, out);
+}
+
+template <class Value, class Load>
+void executeBlock(const Program& program, size_t lanes, Load&& load, Value* out,
+                  std::vector<Value>& stack, Accuracy accuracy = Accuracy::Strict) {
+    executeBlock(program.view(), lanes, load, out, stack, accuracy);
+}
+
+/// @return bit of every lane whose result is NaN, a block's failed rows as one word
+inline uint64_t failedLanes(const double* out, size_t lanes) {
+    static_assert(blockSize == 64, "failed lanes of a block fit a word");
+    uint64_t failed = 0;
+    for (size_t lane = 0; lane < lanes; ++lane) failed |= uint64_t(std::isnan(out[lane])) << lane;
+    return failed;
+}
+
+}  // namespace korowa
+
+#endif  // KOROWA_COMPILER_HPP
@@ -0,0 +1,311 @@
+#pragma once
+#ifndef KOROWA_DUAL_HPP
+#define KOROWA_DUAL_HPP
+
+#include <array>
+#include <cmath>
+#include <korowa/Compiler.hpp>
+#include <korowa/Lexer.hpp>
+#include <korowa/SyntaxError.hpp>
+#include <korowa/Variables.hpp>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace korowa {
+
+/**
+ * @brief Dual number carrying value and partial derivatives with respect to N variables.
+ * Evaluating a Program over duals yields value and gradient in a single pass.
+ */
+template <size_t N>
+struct Dual {
+    double value = 0;
+    std::array<double, N> grad{};
+
+    Dual() = default;
+    Dual(double value) : value(value) {}
+
+    /// @return dual of variable with index-th partial derivative set to one
+    static Dual variable(double value, size_t index) {
+        Dual dual(value);
+        dual.grad[index] = 1;
+        return dual;
+    }
+};
+
+namespace detail {
+
+/**
+ * @brief Digamma function, derivative of ln(tgamma(x))
+ * Reflection for negative arguments, recurrence up to 6 and asymptotic series past it.
+ */
+static double digamma(double x) {
+    if (x <= 0 and x == std::floor(x)) return std::numeric_limits<double>::quiet_NaN();
+    if (x < 0.5) return digamma(1 - x) - my::PI / std::tan(my::PI * x);
+
+    double result = 0;
+    for (; x < 6; ++x) result -= 1 / x;
+
+    const auto inv = 1 / (x * x);
+    return result + std::log(x) - 0.5 / x -
+           inv * (1.0 / 12 - inv * (1.0 / 120 - inv * (1.0 / 252 - inv * (1.0 / 240 - inv / 132))));
+}
+
+/// @brief Derivative of performUnaryFn(op, a), f is the already computed value
+static double unaryPartial(Spec op, double a, double f) {
+    switch (op) {
+        case Sqrt:
+            return 0.5 / f;
+        case Cbrt:
+            return 1 / (3 * f * f);
+            //
+        case Abs:
+            return (a > 0) - (a < 0);
+        case Factorial:
+        case Fact:
+            return f * digamma(a + 1);
+            //
+        case Ln:
+            return 1 / a;
+        case Lg:
+            return 1 / (a * std::log(10.0));
+        case Exp:
+            return f;
+            //
+        case Ceil:
+        case Floor:
+        case Round:
+        case Trunc:
+        case Step:
+            return 0;
+            //
+        case Sinc:
+            return a == 0 ? 0 : (std::cos(a) - f) / a;
+            //
+        case Sin:
+            return std::cos(a);
+        case Cos:
+            return -std::sin(a);
+        case Tan:
+            return 1 + f * f;
+        case Ctan:
+            return -(1 + f * f);
+            //
+        case Sinh:
+            return std::cosh(a);
+        case Cosh:
+            return std::sinh(a);
+        case Tanh:
+            return 1 - f * f;
+        case Ctanh:
+            return f * f - 1;
+            //
+        case Asin:
+            return 1 / std::sqrt(1 - a * a);
+        case Acos:
+            return -1 / std::sqrt(1 - a * a);
+        case Atan:
+            return 1 / (1 + a * a);
+        case Actan:
+            return -1 / (1 + (my::HALF_PI - a) * (my::HALF_PI - a));
+            //
+        case Asinh:
+            return 1 / std::sqrt(a * a + 1);
+        case Acosh:
+            return 1 / (std::sqrt(a - 1) * std::sqrt(a + 1));
+        case Atanh:
+            return 1 / (1 - a * a);
+        case Actanh:
+            return -1 / (1 - (my::HALF_PI - a) * (my::HALF_PI - a));
+            //
+        case Sum:
+        case Sort:
+            return 1;
+        case Len:
+            return 0;
+            // piecewise constant
+        case IsPrime:
+        case NextPrime:
+        case NthPrime:
+        case PrimePi:
+            return 0;
+    }
+    return std::numeric_limits<double>::quiet_NaN();
+}
+
+/// @brief Derivatives of performBinaryFn(op, a, b) by a and by b, f is the already computed value
+static std::array<double, 2> binaryPartials(Spec op, double a, double b, double f) {
+    switch (op) {
+        case Add:
+            return {1, 1};
+        case Sub:
+            return {1, -1};
+        case Mul:
+        case Dot:
+            return {b, a};
+        case Runif: {
+            const auto u = (f - a) / (b - a);  // f = a + (b - a) u
+            return {1 - u, u};
+        }
+        case Div:
+            return {1 / b, -f / b};
+        case Mod:
+            return {1, -std::trunc(a / b)};
+        case Pow:
+        case PowInt:
+            return {b * std::pow(a, b - 1), f * std::log(a)};
+        case Log:
+            return {-f / (a * std::log(a)), 1 / (b * std::log(a))};
+        case Min:
+            return b < a ? std::array<double, 2>{0, 1} : std::array<double, 2>{1, 0};
+        case Max:
+            return a < b ? std::array<double, 2>{0, 1} : std::array<double, 2>{1, 0};
+        case Gcd:
+        case Lcm:
+        case Less:
+        case LessEq:
+        case Greater:
+        case GreaterEq:
+        case EqualTo:
+        case NotEqualTo:
+        case And:
+        case Or:
+            return {0, 0};
+    }
+    return {std::numeric_limits<double>::quiet_NaN(), std::numeric_limits<double>::quiet_NaN()};
+}
+
+/// @brief Chain rule term; operands not depending on a variable contribute nothing,
+/// even where the partial is infinite (sqrt(0), pow(-2, x) etc.)
+static double chain(double partial, double tangent) { return tangent == 0 ? 0 : partial * tangent; }
+
+}  // namespace detail
+
+template <size_t N>
+Dual<N> applyUnary(detail::Spec op, const Dual<N>& a) {
+    Dual<N> result(detail::performUnaryFn(op, a.value));
+    const auto partial = detail::unaryPartial(op, a.value, result.value);
+    for (size_t i = 0; i < N; ++i) result.grad[i] = detail::chain(partial, a.grad[i]);
+    return result;
+}
+
+template <size_t N>
+Dual<N> applyBinary(detail::Spec op, const Dual<N>& a, const Dual<N>& b) {
+    Dual<N> result(detail::performBinaryFn(op, a.value, b.value));
+    const auto [da, db] = detail::binaryPartials(op, a.value, b.value, result.value);
+    for (size_t i = 0; i < N; ++i)
+        result.grad[i] = detail::chain(da, a.grad[i]) + detail::chain(db, b.grad[i]);
+    return result;
+}
+
+/// @brief if carries the derivative of the selected alternative, clamp the one of the bound it takes
+template <size_t N>
+Dual<N> applyTernary(detail::Spec op, const Dual<N>& a, const Dual<N>& b, const Dual<N>& c) {
+    if (op == detail::If) return a.value != 0 ? b : c;
+    return applyBinary(detail::Min, applyBinary(detail::Max, a, b), c);
+}
+
+struct Tangent {
+    double value = 0;
+    double derivative = 0;
+};
+
+struct Gradient {
+    double value = 0;
+    std::vector<double> partials{};  // ordered by slot
+};
+
+static constexpr size_t gradientWidth = 4;  // partials computed per pass
+
+/**
+ * @brief Value and partial derivatives by every variable of the program.
+ * Programs with more than gradientWidth variables are run once per gradientWidth of them.
+ *
+ * @param program compiled expression
+ * @param slots values of program variables, ordered by slot
+ * @return Gradient value and partials ordered by slot
+ */
+Gradient gradient(const Program& program, const std::vector<double>& slots) {
+    using Value = Dual<gradientWidth>;
+
+    Gradient result;
+    result.partials.resize(program.symbols.size());
+
+    std::vector<Value> duals(slots.begin(), slots.end());
+    size_t first = 0;
+    do {
+        const auto last = std::min(first + gradientWidth, slots.size());
+        for (auto i = first; i < last; ++i) duals[i] = Value::variable(slots[i], i - first);
+
+        const auto dual = execute(program, duals.data());
+        result.value = dual.value;
+        for (auto i = first; i < last; ++i) {
+            result.partials[i] = dual.grad[i - first];
+            duals[i] = Value(slots[i]);
+        }
+        first = last;
+    } while (first < slots.size());
+
+    return result;
+}
+
+/**
+ * @brief Value and derivative by one variable for many points at once.
+ * Other variables keep their slots values; points are processed blockSize at a time.
+ *
+ * @param program compiled expression
+ * @param slots values of program variables, ordered by slot
+ * @param slot slot of the variable to differentiate by
+ * @param points values of the variable
+ * @param out points.size() results
+ */
+void derivatives(const Program& program, const std::vector<double>& slots, uint32_t slot,
+                 const std::vector<double>& points, Tangent* out) {
+    using Value = Dual<1>;
+
+    std::vector<Value> stack;
+    Value results[blockSize];
+
+    for (size_t first = 0; first < points.size(); first += blockSize) {
+        const auto lanes = std::min(blockSize, points.size() - first);
+        const auto load = [&](uint32_t index, size_t lane) {
+            return index == slot ? Value::variable(points[first + lane], 0) : Value(slots[index]);
+        };
+
+        executeBlock(program, lanes, load, results, stack);
+        for (size_t lane = 0; lane < lanes; ++lane)
+            out[first + lane] = {results[lane].value, results[lane].grad[0]};
+    }
+}
+
+/**
+ * @brief Value and derivative of math expression by variable in a single pass.
+ *
+ * @param input string representing math expression
+ * @param variable name of the variable to differentiate by
+ * @param err occurred error reference
+ * @param variables values of every variable the expression references
+ * @return Tangent value and derivative
+ */
+Tangent derivative(const std::string& input, const std::string& variable, SyntaxError& err,
+                   const Variables& variables) {
+    const auto program = compile(input, err);
+    if (err) return {};
+
+    const auto slots = bindVariables(program, variables, err);
+    if (err) return {};
+
+    const auto slot = program.slotOf(variable);
+    if (slot < 0) return {execute(program, slots.data()), 0};
+
+    std::vector<Dual<1>> duals(slots.begin(), slots.end());
+    duals[slot] = Dual<1>::variable(slots[slot], 0);
+
+    const auto dual = execute(program, duals.data());
+    return {dual.value, dual.grad[0]};
+}
+
+}  // namespace korowa
+
+#endif  // KOROWA_DUAL_HPP
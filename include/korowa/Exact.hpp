@@ -0,0 +1,345 @@
+#pragma once
+#ifndef KOROWA_EXACT_HPP
+#define KOROWA_EXACT_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <korowa/Compiler.hpp>
+#include <korowa/Lexer.hpp>
+#include <korowa/Variables.hpp>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace korowa {
+
+/**
+ * @brief Value of exact integer evaluation.
+ * Integer values are computed in int64_t with overflow checks, an operation which overflows
+ * or doesn't give an integer falls back to double for its result.
+ */
+struct Exact {
+    double value = 0;
+    int64_t integer = 0;
+    bool exact = false;  // integer holds the value
+    bool wide = false;   // some exact integer on the way didn't fit double's 53 bits
+
+    Exact() = default;
+    Exact(double value) : value(value) {
+        if (std::fabs(value) < 0x1p63) {
+            integer = (int64_t)value;
+            exact = double(integer) == value;
+        }
+    }
+};
+
+namespace detail {
+
+static bool checkedAdd(int64_t a, int64_t b, int64_t& out) {
+#if defined(__GNUC__) or defined(__clang__)
+    return not __builtin_add_overflow(a, b, &out);
+#else
+    if ((b > 0 and a > INT64_MAX - b) or (b < 0 and a < INT64_MIN - b)) return false;
+    out = a + b;
+    return true;
+#endif
+}
+
+static bool checkedSub(int64_t a, int64_t b, int64_t& out) {
+#if defined(__GNUC__) or defined(__clang__)
+    return not __builtin_sub_overflow(a, b, &out);
+#else
+    if ((b < 0 and a > INT64_MAX + b) or (b > 0 and a < INT64_MIN + b)) return false;
+    out = a - b;
+    return true;
+#endif
+}
+
+static bool checkedMul(int64_t a, int64_t b, int64_t& out) {
+#if defined(__GNUC__) or defined(__clang__)
+    return not __builtin_mul_overflow(a, b, &out);
+#else
+    const auto product = magnitude(a) * magnitude(b);
+    const auto negative = (a < 0) != (b < 0);
+    if (a and product / magnitude(a) != magnitude(b)) return false;
+    if (product > uint64_t(INT64_MAX) + negative) return false;
+    out = negative ? int64_t(0 - product) : int64_t(product);
+    return true;
+#endif
+}
+
+/// @brief base^exponent by squaring, exponent >= 0
+static bool checkedPow(int64_t base, int64_t exponent, int64_t& out) {
+    if (magnitude(base) <= 1) {
+        out = base == -1 ? (exponent & 1 ? -1 : 1) : (base == 0 and exponent ? 0 : 1);
+        return true;
+    }
+
+    int64_t result = 1;
+    for (;;) {
+        if ((exponent & 1) and not checkedMul(result, base, result)) return false;
+        exponent >>= 1;
+        if (exponent == 0) break;
+        // the square is used by a later step, so its overflow is the result's overflow
+        if (not checkedMul(base, base, base)) return false;
+    }
+    out = result;
+    return true;
+}
+
+/**
+ * @brief Exact integer result
+ * @param sign zero result takes its sign, the same operation in double gives one
+ */
+static Exact integerResult(int64_t integer, bool wide, double sign) {
+    Exact result;
+    result.integer = integer;
+    result.exact = true;
+    result.value = integer ? double(integer) : std::copysign(0.0, sign);
+    result.wide = wide or magnitude(integer) > (uint64_t(1) << 53);
+    return result;
+}
+
+static Exact inexactResult(double value, bool wide) {
+    Exact result(value);
+    result.wide = wide;
+    return result;
+}
+
+}  // namespace detail
+
+static Exact applyUnary(detail::Spec op, const Exact& a) {
+    using namespace detail;
+
+    if (not a.exact) return inexactResult(performUnaryFn(op, a.value), a.wide);
+
+    switch (op) {
+        case Abs:
+            if (a.integer != INT64_MIN)
+                return integerResult(a.integer < 0 ? -a.integer : a.integer, a.wide, 1);
+            break;
+        case Ceil:
+        case Floor:
+        case Round:
+        case Trunc:
+        case Sum:
+        case Sort:
+            return a;
+        case Step:
+            return integerResult(a.integer >= 0, a.wide, 1);
+        case Fact:
+        case Factorial:
+            if (a.integer >= 0 and a.integer < (int64_t)std::size(factorials))
+                return integerResult(factorials[a.integer], a.wide, 1);
+            break;
+    }
+    return inexactResult(performUnaryFn(op, a.value), a.wide);
+}
+
+static Exact applyBinary(detail::Spec op, const Exact& a, const Exact& b) {
+    using namespace detail;
+
+    const auto wide = a.wide or b.wide;
+    if (not a.exact or not b.exact) return inexactResult(performBinaryFn(op, a.value, b.value), wide);
+
+    int64_t out = 0;
+    switch (op) {
+        case Add:
+            if (checkedAdd(a.integer, b.integer, out))
+                return integerResult(out, wide, a.value + b.value);
+            break;
+        case Sub:
+            if (checkedSub(a.integer, b.integer, out))
+                return integerResult(out, wide, a.value - b.value);
+            break;
+        case Mul:
+        case Dot:
+            if (checkedMul(a.integer, b.integer, out))
+                return integerResult(out, wide, a.value * b.value);
+            break;
+        case Mod:
+            // sign follows the dividend like fmod, INT64_MIN % -1 would trap
+            if (b.integer != 0)
+                return integerResult(b.integer == -1 ? 0 : a.integer % b.integer, wide, a.value);
+            break;
+        case Pow:
+        case PowInt:
+            if (b.integer >= 0 and checkedPow(a.integer, b.integer, out))
+                return integerResult(out, wide, b.integer & 1 ? a.value : 1);
+            break;
+        case Min:
+            return integerResult(std::min(a.integer, b.integer), wide, std::min(a.value, b.value));
+        case Max:
+            return integerResult(std::max(a.integer, b.integer), wide, std::max(a.value, b.value));
+        case Gcd: {
+            const auto gcd = binaryGcd(magnitude(a.integer), magnitude(b.integer));
+            if (gcd <= uint64_t(INT64_MAX)) return integerResult(gcd, wide, 1);
+        } break;
+        case Lcm: {
+            const auto gcd = binaryGcd(magnitude(a.integer), magnitude(b.integer));
+            if (gcd == 0) return integerResult(0, wide, 1);
+            const auto x = magnitude(a.integer) / gcd, y = magnitude(b.integer);
+            if (x <= INT64_MAX and y <= INT64_MAX and checkedMul(x, y, out))
+                return integerResult(out, wide, 1);
+        } break;
+        case Less:
+            return integerResult(a.integer < b.integer, wide, 1);
+        case LessEq:
+            return integerResult(a.integer <= b.integer, wide, 1);
+        case Greater:
+            return integerResult(a.integer > b.integer, wide, 1);
+        case GreaterEq:
+            return integerResult(a.integer >= b.integer, wide, 1);
+        case EqualTo:
+            return integerResult(a.integer == b.integer, wide, 1);
+        case NotEqualTo:
+            return integerResult(a.integer != b.integer, wide, 1);
+        case And:
+            return integerResult(a.integer and b.integer, wide, 1);
+        case Or:
+            return integerResult(a.integer or b.integer, wide, 1);
+    }
+    return inexactResult(performBinaryFn(op, a.value, b.value), wide);
+}
+
+static Exact applyTernary(detail::Spec op, const Exact& a, const Exact& b, const Exact& c) {
+    using namespace detail;
+
+    const auto wide = a.wide or b.wide or c.wide;
+    const auto value = performTernaryFn(op, a.value, b.value, c.value);
+
+    if (op == If) {
+        auto result = a.value != 0 ? b : c;
+        result.wide = wide;
+        return result;
+    }
+    if (op == Clamp and a.exact and b.exact and c.exact)
+        return integerResult(std::min(std::max(a.integer, b.integer), c.integer), wide, value);
+    return inexactResult(value, wide);
+}
+
+/**
+ * @brief Whether program is integer-only: every literal is an integer and every operation
+ * maps integers to integers, so with integer variables it runs entirely in int64_t
+ */
+bool isIntegral(const Program& program) {
+    using namespace detail;
+
+    for (const auto& instruction : program.code) {
+        switch (instruction.op) {
+            case Number:
+                if (Exact(instruction.value).exact) continue;
+                return false;
+            case Variable:
+            case Add:
+            case Sub:
+            case Mul:
+            case Mod:
+            case Pow:
+            case PowInt:
+            case Fact:
+            case Factorial:
+            case Abs:
+            case Ceil:
+            case Floor:
+            case Round:
+            case Trunc:
+            case Min:
+            case Max:
+            case Gcd:
+            case Lcm:
+            case Less:
+            case LessEq:
+            case Greater:
+            case GreaterEq:
+            case EqualTo:
+            case NotEqualTo:
+            case And:
+            case Or:
+            case Step:
+            case If:
+            case Clamp:
+            case IsPrime:
+            case NextPrime:
+            case NthPrime:
+            case PrimePi:
+            case Sum:
+            case Len:
+            case Sort:
+                continue;
+        }
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Evaluates parsed integer-only expression, see evalExact of the text
+ *
+ * @param tokenQueue parsed expression
+ * @param result evaluated result, its integer holds it exactly unless some operation fell back to double
+ * @param variables saved variables, nullptr if variables are not available
+ * @return false if expression isn't integer-only or can't be evaluated, eval reports the error
+ */
+bool evalExact(const detail::TokenQueue& tokenQueue, Exact& result,
+               Variables* variables) {
+    auto err = SyntaxError();
+    const auto program = compile(tokenQueue, err);
+    if (err or not isIntegral(program)) return false;
+    if (not variables and (not program.symbols.empty() or not program.assignTo.empty()))
+        return false;
+
+    std::vector<Exact> slots;
+    if (variables) {
+        const auto values = bindVariables(program, *variables, err);
+        if (err) return false;
+        slots.assign(values.begin(), values.end());
+    }
+
+    KOROWA_STATS_ADD(Evaluations, 1);
+    result = execute(program, slots.data());
+    if (not program.assignTo.empty()) (*variables)[program.assignTo] = result.value;
+    return true;
+}
+
+/**
+ * @brief Evaluates integer-only expression (see isIntegral) with exact integer arithmetic.
+ * Falls back to double per operation on overflow.
+ *
+ * @param input string representing math expression
+ * @param result evaluated result, its integer holds it exactly unless some operation fell back to double
+ * @param variables saved variables, nullptr if variables are not available
+ * @return false if expression isn't integer-only or can't be evaluated, eval reports the error
+ */
+bool evalExact(const std::string& input, Exact& result,
+               Variables* variables) {
+    auto err = SyntaxError();
+    const auto tokenQueue = detail::parse(detail::tokenize(input), err);
+    return not err and evalExact(tokenQueue, result, variables);
+}
+
+/**
+ * @brief Evaluates math expression as the calculator does, integer-only expressions exactly
+ * and everything else with eval. The expression is tokenized and parsed once for both.
+ *
+ * @param input string representing math expression
+ * @param err occurred error reference
+ * @param variables saved variables, nullptr if variables are not available
+ * @return Exact evaluated result, exact only for integer-only expressions
+ */
+Exact evalPreferExact(const std::string& input, SyntaxError& err, Variables* variables) {
+    auto tokenQueue = detail::parse(detail::tokenize(input), err);
+    if (err) return std::numeric_limits<double>::quiet_NaN();
+
+    Exact result;
+    if (evalExact(tokenQueue, result, variables)) return result;
+    KOROWA_STATS_ADD(Evaluations, 1);
+    // left inexact, even an integral double is printed as one
+    result.value = variables ? evalParsed(std::move(tokenQueue), err, *variables)
+                             : evalParsed(std::move(tokenQueue), err);
+    return result;
+}
+
+}  // namespace korowa
+
+#endif  // KOROWA_EXACT_HPP
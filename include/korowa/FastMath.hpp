@@ -0,0 +1,217 @@
+#pragma once
+#ifndef KOROWA_FASTMATH_HPP
+#define KOROWA_FASTMATH_HPP
+
+// Polynomial kernels of exp, ln, lg, sin and cos for block evaluation.
+// Every kernel is a straight loop without calls or branches the compiler can't turn into
+// selects, so a block of values is evaluated in SIMD registers instead of one libm call at a time.
+// Inputs outside a kernel's domain (huge, tiny, negative, infinite or NaN) are passed to libm,
+// so special values come out exactly as in strict mode.
+// The loops pay off once the compiler vectorizes them, -O3 with a SIMD target (e.g. -march=native)
+// gives 3-6 times the throughput of libm, scalar builds are about as fast as libm.
+//
+// Maximum error against libm, measured by Fuzz --accuracy over dense sweeps:
+//   function  domain of the kernel       fast        approx
+//   exp       |x| <= 708                 2^-51 rel   2^-26 rel
+//   ln, lg    normal x > 0               2^-50 rel   2^-27 rel
+//   sin, cos  |x| <= 1e5                 2^-51 abs   2^-26 abs
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <korowa/Lexer.hpp>
+
+namespace korowa {
+
+enum class Accuracy : uint8_t {
+    Strict,  // libm, correctly rounded or nearly so
+    Fast,    // a few ulp
+    Approx,  // about 8 significant digits, for plots and sampling
+};
+
+namespace fastmath {
+
+namespace detail {
+
+static constexpr size_t chunk = 64;  // values reduced at once, their inputs are kept on the stack
+
+static constexpr double shifter = 0x1.8p52;  // x + shifter rounds x to an integer in low bits
+static constexpr double log2e = 1.4426950408889634074;
+static constexpr double ln2hi = 6.93147180369123816490e-01, ln2lo = 1.90821492927058770002e-10;
+static constexpr double log10e = 0.43429448190325182765;
+static constexpr double sqrt2 = 1.41421356237309504880;
+static constexpr double twoOverPi = 0.63661977236758134308;
+// pi/2 = pio2a + pio2b + pio2c (fdlibm's pio2_1, pio2_2, pio2_2t), a and b hold 33 bits,
+// so k * pio2a and k * pio2b are exact for |k| < 2^20
+static constexpr double pio2a = 1.57079632673412561417e+00, pio2b = 6.07710050630396597660e-11,
+                        pio2c = 2.02226624879595063154e-21;
+
+// Taylor coefficients, fast keeps terms down to 2^-60 of the result over the reduced range
+static constexpr double expFast[]{1.0 / 6227020800, 1.0 / 479001600, 1.0 / 39916800,
+                                  1.0 / 3628800,    1.0 / 362880,    1.0 / 40320,
+                                  1.0 / 5040,       1.0 / 720,       1.0 / 120,
+                                  1.0 / 24,         1.0 / 6,         0.5,
+                                  1.0,              1.0};
+static constexpr double expApprox[]{1.0 / 5040, 1.0 / 720, 1.0 / 120, 1.0 / 24, 1.0 / 6, 0.5, 1.0, 1.0};
+// 2 atanh(s) = 2 (s + s^3/3 + s^5/5 + ...), coefficients of s^2 powers
+static constexpr double lnFast[]{2.0 / 25, 2.0 / 23, 2.0 / 21, 2.0 / 19, 2.0 / 17, 2.0 / 15, 2.0 / 13,
+                                 2.0 / 11, 2.0 / 9,  2.0 / 7,  2.0 / 5,  2.0 / 3,  2.0};
+static constexpr double lnApprox[]{2.0 / 9, 2.0 / 7, 2.0 / 5, 2.0 / 3, 2.0};
+static constexpr double sinFast[]{1.0 / 355687428096000, -1.0 / 1307674368000, 1.0 / 6227020800,
+                                  -1.0 / 39916800,       1.0 / 362880,         -1.0 / 5040,
+                                  1.0 / 120,             -1.0 / 6,             1.0};
+static constexpr double sinApprox[]{1.0 / 362880, -1.0 / 5040, 1.0 / 120, -1.0 / 6, 1.0};
+static constexpr double cosFast[]{1.0 / 20922789888000, -1.0 / 87178291200, 1.0 / 479001600,
+                                  -1.0 / 3628800,       1.0 / 40320,        -1.0 / 720,
+                                  1.0 / 24,             -0.5,               1.0};
+static constexpr double cosApprox[]{-1.0 / 3628800, 1.0 / 40320, -1.0 / 720, 1.0 / 24, -0.5, 1.0};
+
+/// @brief Polynomial with coefficients from the highest power down, by Horner's scheme
+template <size_t N>
+static inline double horner(double x, const double (&coefficients)[N]) {
+    double result = coefficients[0];
+    for (size_t i = 1; i < N; ++i) result = result * x + coefficients[i];
+    return result;
+}
+
+static inline uint64_t bits(double x) {
+    uint64_t result;
+    std::memcpy(&result, &x, sizeof(result));
+    return result;
+}
+
+static inline double fromBits(uint64_t x) {
+    double result;
+    std::memcpy(&result, &x, sizeof(result));
+    return result;
+}
+
+template <bool approx>
+static inline double exp(double x) {
+    // x = k ln2 + r, |r| <= ln2 / 2
+    x = x < -708 ? -708 : x > 708 ? 708 : x;
+    const auto shifted = x * log2e + shifter;
+    const auto k = shifted - shifter;
+    const auto r = (x - k * ln2hi) - k * ln2lo;
+    const auto scale = fromBits((bits(shifted) + 1023) << 52);
+    return scale * (approx ? horner(r, expApprox) : horner(r, expFast));
+}
+
+template <bool approx>
+static inline double ln(double x) {
+    // x = m 2^e, m in [sqrt2 / 2, sqrt2), ln m = 2 atanh(s) with s = (m - 1) / (m + 1)
+    const auto raw = bits(x);
+    auto e = double(int64_t(raw >> 52) - 1023);
+    auto m = fromBits((raw & 0x000fffffffffffff) | 0x3ff0000000000000);
+    const auto big = m > sqrt2;
+    m = big ? m * 0.5 : m;
+    e = big ? e + 1 : e;
+    const auto f = m - 1, s = f / (2 + f), s2 = s * s;
+    const auto lnm = s * (approx ? horner(s2, lnApprox) : horner(s2, lnFast));
+    return e * ln2hi + (lnm + e * ln2lo);
+}
+
+template <bool approx>
+static inline double sinCos(double x, bool cosine) {
+    // x = k pi/2 + r, |r| <= pi/4, the quadrant k picks the kernel and the sign
+    const auto shifted = x * twoOverPi + shifter;
+    const auto k = shifted - shifter;
+    const auto r = ((x - k * pio2a) - k * pio2b) - k * pio2c, r2 = r * r;
+    const auto quadrant = bits(shifted) + cosine;
+    const auto s = r * (approx ? horner(r2, sinApprox) : horner(r2, sinFast));
+    const auto c = approx ? horner(r2, cosApprox) : horner(r2, cosFast);
+    const auto value = quadrant & 1 ? c : s;
+    return quadrant & 2 ? -value : value;
+}
+
+/**
+ * @brief Applies kernel to values in place, lanes where inDomain fails get libm's strict(x)
+ */
+template <class Kernel, class InDomain, class Strict>
+static void map(double* values, size_t count, Kernel&& kernel, InDomain&& inDomain, Strict&& strict) {
+    for (size_t first = 0; first < count; first += chunk) {
+        const auto size = std::min(chunk, count - first);
+        auto* out = values + first;
+        double input[chunk];
+        std::copy(out, out + size, input);
+
+        // separate loops, each of them vectorizes
+        size_t outside = 0;
+        for (size_t i = 0; i < size; ++i) out[i] = kernel(input[i]);
+        for (size_t i = 0; i < size; ++i) outside += not inDomain(input[i]);
+        if (outside)
+            for (size_t i = 0; i < size; ++i)
+                if (not inDomain(input[i])) out[i] = strict(input[i]);
+    }
+}
+
+template <bool approx>
+static bool apply(korowa::detail::Spec op, double* values, size_t count) {
+    using namespace korowa::detail;
+
+    const auto positive = [](double x) { return (x >= 0x1p-1022) & (x <= 0x1.fffffffffffffp1023); };
+    const auto reducible = [](double x) { return std::fabs(x) <= 1e5; };
+    switch (op) {
+        case Exp:
+            map(values, count, [](double x) { return exp<approx>(x); }, [](double x) { return std::fabs(x) <= 708; },
+                [](double x) { return std::exp(x); });
+            return true;
+        case Ln:
+            map(values, count, [](double x) { return ln<approx>(x); }, positive, [](double x) { return std::log(x); });
+            return true;
+        case Lg:
+            map(values, count, [](double x) { return ln<approx>(x) * log10e; }, positive,
+                [](double x) { return std::log10(x); });
+            return true;
+        case Sin:
+            map(values, count, [](double x) { return sinCos<approx>(x, false); }, reducible,
+                [](double x) { return std::sin(x); });
+            return true;
+        case Cos:
+            map(values, count, [](double x) { return sinCos<approx>(x, true); }, reducible,
+                [](double x) { return std::cos(x); });
+            return true;
+    }
+    return false;
+}
+
+}  // namespace detail
+
+/// @return whether op has a kernel, strict accuracy never uses one
+static constexpr bool hasKernel(korowa::detail::Spec op, Accuracy accuracy) {
+    using namespace korowa::detail;
+    return accuracy != Accuracy::Strict and
+           (op == Exp or op == Ln or op == Lg or op == Sin or op == Cos);
+}
+
+/**
+ * @brief Maximum error of op's kernel, relative for exp, ln and lg, absolute for sin and cos
+ */
+static constexpr double maxError(korowa::detail::Spec op, Accuracy accuracy) {
+    using namespace korowa::detail;
+    if (not hasKernel(op, accuracy)) return 0;
+    if (accuracy == Accuracy::Fast) return op == Ln or op == Lg ? 0x1p-50 : 0x1p-51;
+    return op == Ln or op == Lg ? 0x1p-27 : 0x1p-26;
+}
+
+/**
+ * @brief Evaluates unary op for count values in place
+ *
+ * @param op unary function
+ * @param values arguments, replaced by results
+ * @param count number of values
+ * @param accuracy kernel to use
+ * @return false if op has no kernel for accuracy, values are untouched then
+ */
+static bool apply(korowa::detail::Spec op, double* values, size_t count, Accuracy accuracy) {
+    if (not hasKernel(op, accuracy)) return false;
+    return accuracy == Accuracy::Approx ? detail::apply<true>(op, values, count)
+                                        : detail::apply<false>(op, values, count);
+}
+
+}  // namespace fastmath
+
+}  // namespace korowa
+
+#endif  // KOROWA_FASTMATH_HPP
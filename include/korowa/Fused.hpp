@@ -0,0 +1,315 @@
+#pragma once
+#ifndef KOROWA_FUSED_HPP
+#define KOROWA_FUSED_HPP
+
+// Several programs over the same variables merged into one DAG.
+// Identical subexpressions are hash-consed into a single node, so sin(x)*y, sin(x)+z and
+// sqrt(sin(x)) compute sin(x) once, and all results come out of one pass over the inputs.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <korowa/Compiler.hpp>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace korowa {
+
+/**
+ * @brief Node of a fused program, operands are earlier nodes.
+ * Variable slot refers to FusedProgram::symbols, the result lives in scratch row.
+ */
+struct FusedNode {
+    Instruction instruction{};
+    uint32_t a = 0, b = 0, c = 0;
+    uint32_t row = 0;
+};
+
+/**
+ * @brief Programs merged by fuse, nodes are in evaluation order
+ */
+struct FusedProgram {
+    std::vector<FusedNode> nodes{};
+    std::vector<std::string> symbols{};
+    std::vector<uint32_t> outputs{};  // node of every program's result, in the order given
+    uint32_t rows = 0;                // scratch rows, nodes reuse rows of dead values
+    size_t instructions = 0;          // instructions of the programs before merging
+
+    /// @return slot of variable name or -1 if no program references it
+    long slotOf(const std::string& name) const {
+        auto it = std::find(symbols.begin(), symbols.end(), name);
+        return it == symbols.end() ? -1 : it - symbols.begin();
+    }
+};
+
+namespace detail {
+
+struct NodeKey {
+    Spec op;
+    uint32_t slot;
+    uint64_t value;  // bits of the number, so 0 and -0 stay apart
+    uint32_t a, b, c;
+
+    bool operator==(const NodeKey& other) const {
+        return op == other.op and slot == other.slot and value == other.value and
+               a == other.a and b == other.b and c == other.c;
+    }
+};
+
+struct NodeKeyHash {
+    size_t operator()(const NodeKey& key) const {
+        uint64_t hash = key.op;
+        for (const uint64_t part :
+             {uint64_t(key.slot), key.value, uint64_t(key.a), uint64_t(key.b), uint64_t(key.c)})
+            hash = (hash ^ part) * 0x100000001b3 + (hash >> 29);
+        return hash;
+    }
+};
+
+/// @brief Operations whose operands can be swapped without changing a single bit of the result
+static constexpr bool isCommutative(Spec op) {
+    return op == Add or op == Mul or op == EqualTo or op == NotEqualTo or op == And or op == Or;
+}
+
+}  // namespace detail
+
+/**
+ * @brief Merges programs into one DAG, sharing every repeated subexpression.
+ * Generators and runif are never shared, every occurrence draws its own number.
+ * Assignment targets are ignored, results come out in the order of programs.
+ *
+ * @param programs compiled expressions
+ * @return FusedProgram merged programs
+ */
+FusedProgram fuse(const std::vector<Program>& programs) {
+    using namespace detail;
+
+    FusedProgram fused;
+    std::unordered_map<NodeKey, uint32_t, NodeKeyHash> interned;
+    std::vector<uint32_t> stack;
+
+    for (const auto& program : programs) {
+        fused.instructions += program.code.size();
+        stack.clear();
+
+        for (auto instruction : program.code) {
+            NodeKey key{instruction.op, 0, 0, 0, 0, 0};
+            switch (arity(instruction.op)) {
+                case 3:
+                    key.c = stack.back();
+                    stack.pop_back();
+                    key.b = stack.back();
+                    stack.pop_back();
+                    key.a = stack.back();
+                    stack.pop_back();
+                    break;
+                case 2:
+                    key.b = stack.back();
+                    stack.pop_back();
+                    key.a = stack.back();
+                    stack.pop_back();
+                    if (isCommutative(key.op) and key.a > key.b) std::swap(key.a, key.b);
+                    break;
+                case 1:
+                    key.a = stack.back();
+                    stack.pop_back();
+                    break;
+                default:
+                    if (instruction.op == Variable) {
+                        auto slot = fused.slotOf(program.symbols[instruction.slot]);
+                        if (slot < 0) {
+                            slot = fused.symbols.size();
+                            fused.symbols.push_back(program.symbols[instruction.slot]);
+                        }
+                        key.slot = instruction.slot = slot;
+                    } else if (instruction.op == Number) {
+                        std::memcpy(&key.value, &instruction.value, sizeof(key.value));
+                    }
+            }
+
+            const auto node = (uint32_t)fused.nodes.size();
+            if (isDeterministic(key.op)) {
+                auto [it, inserted] = interned.emplace(key, node);
+                if (not inserted) {
+                    stack.push_back(it->second);
+                    continue;
+                }
+            }
+            fused.nodes.push_back({instruction, key.a, key.b, key.c});
+            stack.push_back(node);
+        }
+
+        fused.outputs.push_back(stack.back());
+    }
+
+    // a node's row is free again after its last reader, results stay alive to the end
+    const auto end = (uint32_t)fused.nodes.size();
+    std::vector<uint32_t> lastUse(end, 0), freeRows;
+    for (uint32_t i = 0; i < end; ++i) {
+        const auto operands = arity(fused.nodes[i].instruction.op);
+        if (operands >= 1) lastUse[fused.nodes[i].a] = i;
+        if (operands >= 2) lastUse[fused.nodes[i].b] = i;
+        if (operands == 3) lastUse[fused.nodes[i].c] = i;
+    }
+    for (const auto output : fused.outputs) lastUse[output] = end;
+
+    for (uint32_t i = 0; i < end; ++i) {
+        auto& node = fused.nodes[i];
+        const auto operands = arity(node.instruction.op);
+        // operations are element-wise, so the result may overwrite an operand it reads
+        if (operands >= 1 and lastUse[node.a] == i) freeRows.push_back(fused.nodes[node.a].row);
+        if (operands >= 2 and node.b != node.a and lastUse[node.b] == i)
+            freeRows.push_back(fused.nodes[node.b].row);
+        if (operands == 3 and node.c != node.a and node.c != node.b and lastUse[node.c] == i)
+            freeRows.push_back(fused.nodes[node.c].row);
+
+        if (freeRows.empty()) {
+            node.row = fused.rows++;
+        } else {
+            node.row = freeRows.back();
+            freeRows.pop_back();
+        }
+    }
+
+    return fused;
+}
+
+/**
+ * @brief Evaluates every fused program for one point
+ *
+ * @param program fused programs
+ * @param slots values of variables, ordered by FusedProgram::symbols
+ * @param out results, one per fused program
+ * @param scratch scratch buffer, reused between calls
+ */
+template <class Value>
+void execute(const FusedProgram& program, const Value* slots, Value* out,
+             std::vector<Value>& scratch) {
+    using namespace detail;
+
+    scratch.resize(program.rows);
+    auto* rows = scratch.data();
+
+    for (const auto& node : program.nodes) {
+        const auto& instruction = node.instruction;
+        switch (arity(instruction.op)) {
+            case 3:
+                rows[node.row] =
+                    applyTernary(instruction.op, rows[program.nodes[node.a].row],
+                                 rows[program.nodes[node.b].row], rows[program.nodes[node.c].row]);
+                break;
+            case 2:
+                rows[node.row] = applyBinary(instruction.op, rows[program.nodes[node.a].row],
+                                             rows[program.nodes[node.b].row]);
+                break;
+            case 1:
+                rows[node.row] = applyUnary(instruction.op, rows[program.nodes[node.a].row]);
+                break;
+            default:
+                if (instruction.op == Variable)
+                    rows[node.row] = slots[instruction.slot];
+                else if (instruction.op == Number)
+                    rows[node.row] = Value(instruction.value);
+                else
+                    rows[node.row] = Value(getGenerated(instruction.op));
+        }
+    }
+
+    for (size_t i = 0; i < program.outputs.size(); ++i)
+        out[i] = rows[program.nodes[program.outputs[i]].row];
+}
+
+/**
+ * @brief Evaluates every fused program for up to blockSize points at once
+ *
+ * @param program fused programs
+ * @param lanes number of points, at most blockSize
+ * @param load load(slot, lane) returns value of a variable for a point
+ * @param out results, out[i * blockSize + lane] is the result of program i for lane
+ * @param scratch scratch buffer, reused between calls
+ * @param accuracy kernels of transcendental functions, see FastMath.hpp, double only
+ */
+template <class Value, class Load>
+void executeBlock(const FusedProgram& program, size_t lanes, Load&& load, Value* out,
+                  std::vector<Value>& scratch, Accuracy accuracy = Accuracy::Strict) {
+    using namespace detail;
+
+    scratch.resize(size_t(program.rows) * blockSize);
+    const auto row = [&](uint32_t node) { return scratch.data() + program.nodes[node].row * blockSize; };
+
+    for (uint32_t i = 0; i < program.nodes.size(); ++i) {
+        const auto& node = program.nodes[i];
+        const auto op = node.instruction.op;
+        auto* result = row(i);
+
+        switch (arity(op)) {
+            case 3: {
+                const auto *a = row(node.a), *b = row(node.b), *c = row(node.c);
+                for (size_t lane = 0; lane < lanes; ++lane)
+                    result[lane] = applyTernary(op, a[lane], b[lane], c[lane]);
+            } break;
+            case 2: {
+                const auto *a = row(node.a), *b = row(node.b);
+                for (size_t lane = 0; lane < lanes; ++lane)
+                    result[lane] = applyBinary(op, a[lane], b[lane]);
+            } break;
+            case 1: {
+                const auto* a = row(node.a);
+                if constexpr (std::is_same_v<Value, double>)
+                    if (fastmath::hasKernel(op, accuracy)) {
+                        std::copy(a, a + lanes, result);
+                        fastmath::apply(op, result, lanes, accuracy);
+                        break;
+                    }
+                for (size_t lane = 0; lane < lanes; ++lane) result[lane] = applyUnary(op, a[lane]);
+            } break;
+            default:
+                if (op == Variable)
+                    for (size_t lane = 0; lane < lanes; ++lane)
+                        result[lane] = load(node.instruction.slot, lane);
+                else if (op == Number)
+                    std::fill(result, result + lanes, Value(node.instruction.value));
+                else if (op == RndGen or op == NormGen) {
+                    double values[blockSize];
+                    if (op == RndGen)
+                        random::fill(values, lanes);
+                    else
+                        random::fillNormal(values, lanes);
+                    std::copy(values, values + lanes, result);
+                } else
+                    for (size_t lane = 0; lane < lanes; ++lane)
+                        result[lane] = Value(getGenerated(op));
+        }
+    }
+
+    for (size_t i = 0; i < program.outputs.size(); ++i) {
+        const auto* result = row(program.outputs[i]);
+        std::copy(result, result + lanes, out + i * blockSize);
+    }
+}
+
+/**
+ * @brief Values of fused program variables taken from the map, ordered by slot
+ *
+ * @param err occurred error reference, set if some variable is missing
+ */
+template <class Variables>
+std::vector<double> bindVariables(const FusedProgram& program, const Variables& variables,
+                                  SyntaxError& err) {
+    std::vector<double> slots;
+    slots.reserve(program.symbols.size());
+    for (const auto& name : program.symbols) {
+        auto it = variables.find(name);
+        if (it == variables.end()) {
+            err = SyntaxError(SyntaxError::Code::UnknownVariable, name);
+            return {};
+        }
+        slots.push_back(it->second);
+    }
+    return slots;
+}
+
+}  // namespace korowa
+
+#endif  // KOROWA_FUSED_HPP
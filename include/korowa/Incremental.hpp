@@ -0,0 +1,161 @@
+#pragma once
+#ifndef KOROWA_INCREMENTAL_HPP
+#define KOROWA_INCREMENTAL_HPP
+
+// Expression kept tokenized and parsed while it is being edited.
+// Tokenizer and parser states are checkpointed every few characters and tokens, an edit
+// restores the checkpoints before the first changed character and feeds only what follows,
+// so a keystroke at the end of a long line costs as much as in a short one.
+// An edit near the beginning feeds the text at once without checkpoints, the next update
+// further along takes them again.
+
+#include <algorithm>
+#include <korowa/Exact.hpp>
+#include <korowa/Lexer.hpp>
+#include <korowa/SyntaxError.hpp>
+#include <korowa/Variables.hpp>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace korowa {
+
+class IncrementalExpression {
+   public:
+    IncrementalExpression() : lexed(1), parsed(1) {}
+    // the parser refers to the tokenizer's tokens
+    IncrementalExpression(const IncrementalExpression&) = delete;
+    IncrementalExpression& operator=(const IncrementalExpression&) = delete;
+
+    /**
+     * @brief Replaces the text, retokenizes it from the first changed character
+     * and reparses it from the first token that character may have changed
+     */
+    void update(const std::string& text) {
+        const auto mismatch = std::mismatch(source.begin(), source.end(), text.begin(), text.end());
+        const auto changed = size_t(mismatch.first - source.begin());
+        // taking checkpoints costs more than they save when most of the text is fed again
+        const auto full = changed < text.size() / 4;
+        // after a full update there are no checkpoints past the beginning
+        const auto common = full ? 0 : std::min(changed / stride, lexed.size() - 1) * stride;
+
+        lexed.resize(common / stride + 1);
+        tokenizer.restore(lexed.back());
+        if (full)
+            tokenizer.feed(text.data(), text.data() + text.size());
+        else
+            for (auto i = common; i < text.size(); i += stride) {
+                const auto end = std::min(i + stride, text.size());
+                tokenizer.feed(text.data() + i, text.data() + end);
+                if (end - i == stride) lexed.push_back(tokenizer.checkpoint());
+            }
+        source = text;
+
+        // tokens before the last one of the common prefix are final, the last one may have grown
+        const auto& tokens = tokenizer.tokens;
+        const auto settled = lexed[common / stride].size;
+        const auto kept = std::min((settled ? settled - 1 : 0) / stride, parsed.size() - 1) * stride;
+        parsed.resize(kept / stride + 1);
+        parser.restore(parsed.back());
+        if (full)
+            parser.feed(tokens.size());
+        else
+            for (auto i = kept; i < tokens.size(); i += stride) {
+                const auto end = std::min(i + stride, tokens.size());
+                parser.feed(end);
+                if (end - i == stride) parsed.push_back(parser.checkpoint());
+            }
+        parser.finish();
+
+        relexed = text.size() - common;
+        reparsed = tokens.size() - kept;
+
+        // the kept tokens are the same, so is the first unknown one among them
+        if (unknown >= kept)
+            unknown = size_t(std::find_if(tokens.begin() + kept, tokens.end(), detail::isUnknownSymbol) -
+                             tokens.begin());
+        err = unknown < tokens.size() ? detail::unknownSymbol(tokens, unknown) : parser.err;
+    }
+
+    const std::string& text() const { return source; }
+    const detail::TokenContainer& tokens() const { return tokenizer.tokens; }
+    /// @brief Parsed expression, valid until the next update
+    const detail::TokenQueue& queue() const { return parser.output; }
+    /// @brief Error of tokenizing or parsing the text, evaluation errors come from evaluate
+    const SyntaxError& error() const { return err; }
+
+    /// @return whether evaluating the expression gives the same result every time
+    bool deterministic() const {
+        return std::none_of(tokens().begin(), tokens().end(),
+                            [](const auto& token) { return not detail::isDeterministic(token.spec); });
+    }
+
+    /**
+     * @brief Value of the expression as eval computes it, without assigning anything
+     *
+     * @param err occurred error reference
+     * @param variables saved variables, left unchanged
+     * @return double evaluated result
+     */
+    double evaluate(SyntaxError& err, const Variables& variables) const {
+        using namespace detail;
+
+        if (this->err) {
+            err = this->err;
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+
+        // the parsed queue evaluates as is when it passes the static check, eval handles the rest
+        const auto& tokenQueue = parser.output;
+        const auto assignment = tokenQueue.size() > 1 and tokenQueue.front().spec == Variable and
+                                tokenQueue.back().spec == Equals;
+        if (not assignment and not tokenQueue.empty() and not hasArrays(tokenQueue)) {
+            if (const auto depth = stackDepth(tokenQueue, false); depth and depth <= maxStackDepth) {
+                std::string missing;
+                const auto result = evalVerified(tokenQueue, &variables, missing);
+                if (missing.empty()) return result;
+            }
+        }
+
+        auto scratch = variables;
+        return eval(source, err, scratch);
+    }
+
+    /**
+     * @brief Value of the expression as evalPreferExact computes it, without assigning anything
+     *
+     * @param err occurred error reference
+     * @param variables saved variables, left unchanged
+     * @return Exact evaluated result, exact only for integer-only expressions
+     */
+    Exact evaluatePreferExact(SyntaxError& err, const Variables& variables) const {
+        Exact result;
+        if (not this->err) {
+            auto scratch = variables;
+            if (evalExact(parser.output, result, &scratch)) return result;
+        }
+        // left inexact, as evalPreferExact leaves it
+        result.value = evaluate(err, variables);
+        return result;
+    }
+
+    size_t relexed = 0;   // characters the last update fed to the tokenizer
+    size_t reparsed = 0;  // tokens the last update fed to the parser
+
+   private:
+    // characters or tokens between checkpoints, a few of them are fed again instead of copying
+    // the state after every one
+    static constexpr size_t stride = 16;
+
+    std::string source{};
+    detail::Tokenizer tokenizer{};
+    detail::Parser parser{tokenizer.tokens};
+    std::vector<detail::Tokenizer::Checkpoint> lexed;  // after every stride characters, from none
+    std::vector<detail::Parser::Checkpoint> parsed;   // after every stride tokens, from none
+    size_t unknown = 0;                                // index of the first token parse rejects
+    SyntaxError err = SyntaxError();
+};
+
+}  // namespace korowa
+
+#endif  // KOROWA_INCREMENTAL_HPP
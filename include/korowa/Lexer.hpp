@@ -3,9 +3,15 @@
 #define KOROWA_LEXER_HPP
 
 #include <algorithm>
+#include <array>
 #include <cctype>
 #include <cmath>
+#include <korowa/Array.hpp>
+#include <korowa/Primes.hpp>
+#include <korowa/Random.hpp>
+#include <korowa/Stats.hpp>
 #include <korowa/SyntaxError.hpp>
+#include <korowa/Variables.hpp>
 #include <limits>
 #include <map>
 #include <my/extention/Math.hpp>
@@ -48,6 +54,14 @@ enum Spec {
     Mul,
     Mod,
     Pow,
+    Less,
+    LessEq,
+    Greater,
+    GreaterEq,
+    EqualTo,
+    NotEqualTo,
+    And,
+    Or,
     Equals,
     // Unary f-ns
     Sqrt,
@@ -63,6 +77,7 @@ enum Spec {
     Floor,
     Round,
     Trunc,
+    Step,  // Heaviside, 1 from 0 on
 
     Sinc,
 
@@ -84,12 +99,31 @@ enum Spec {
     Atanh,
     Actanh,
 
+    // Number theory
+    IsPrime,
+    NextPrime,
+    NthPrime,
+    PrimePi,
+    Factor,  // array of prime factors
+
+    // Reductions (identity on scalars)
+    Sum,
+    Len,
+    Sort,
+
     // Binary f-ns
     Min,
     Max,
     Gcd,
     Lcm,
     Log,
+    Dot,
+    PowInt,  // a^b for integer b, emitted by optimize only
+    Runif,   // uniform in [a, b)
+
+    // Ternary f-ns, both alternatives are always evaluated
+    If,
+    Clamp,
 
     // Constants
     EConst,
@@ -101,7 +135,9 @@ enum Spec {
     RndGen,
     PrimeGen,
     TimeGen,
-    PlaceholderGen3,
+    NormGen,
+
+    SpecCount,  // number of specs, not a token
 };
 
 struct Token {
@@ -123,30 +159,86 @@ static constexpr bool isBinaryOp(Spec s) { return s >= Add and s <= Equals; }
 static constexpr bool isUnaryOp(Spec s) { return s >= Fact and s <= Placeholder2; }
 
 static constexpr bool isConstant(Spec s) { return s >= EConst and s <= PhiConst; }
-static constexpr bool isGenerator(Spec s) { return s >= RndGen and s <= PlaceholderGen3; }
+static constexpr bool isGenerator(Spec s) { return s >= RndGen and s <= NormGen; }
 
-static constexpr bool isFunction(Spec s) { return s >= Sqrt and s <= Log; }
-static constexpr bool isUnaryFn(Spec s) { return s >= Sqrt and s <= Actanh; }
-static constexpr bool isBinaryFn(Spec s) { return s >= Min and s <= Log; }
+static constexpr bool isFunction(Spec s) { return s >= Sqrt and s <= Clamp; }
+static constexpr bool isUnaryFn(Spec s) { return s >= Sqrt and s <= Sort; }
+static constexpr bool isBinaryFn(Spec s) { return s >= Min and s <= Runif; }
+static constexpr bool isTernaryFn(Spec s) { return s >= If and s <= Clamp; }
+
+/// @brief Whether equal operands always give the same result
+static constexpr bool isDeterministic(Spec s) { return not isGenerator(s) and s != Runif; }
 
 static constexpr uint8_t getPrecedence(Spec s) {
     switch (s) {
         case LeftPars:
         case RightPars:
+        case LeftArrPars:
+        case RightArrPars:
             return 0;
+        case Or:
+            return 1;
+        case And:
+            return 2;
+        case EqualTo:
+        case NotEqualTo:
+            return 3;
+        case Less:
+        case LessEq:
+        case Greater:
+        case GreaterEq:
+            return 4;
         case Add:
         case Sub:
-            return 1;
+            return 5;
         case Div:
         case Mul:
         case Mod:
-            return 2;
+            return 6;
         case Pow:
-            return 3;
+            return 7;
     }
-    return 4;
+    return 8;
 }
 
+/// @brief n! for every n whose factorial fits int64_t
+static constexpr int64_t factorials[]{
+    1, 1, 2, 6, 24, 120, 720, 5040, 40320, 362880, 3628800, 39916800, 479001600, 6227020800,
+    87178291200, 1307674368000, 20922789888000, 355687428096000, 6402373705728000,
+    121645100408832000, 2432902008176640000};
+
+static constexpr uint64_t magnitude(int64_t x) { return x < 0 ? 0 - uint64_t(x) : uint64_t(x); }
+
+/// @return number of trailing zero bits of x != 0
+static int trailingZeros(uint64_t x) {
+#if defined(__GNUC__) or defined(__clang__)
+    return __builtin_ctzll(x);
+#else
+    int count = 0;
+    for (; (x & 1) == 0; x >>= 1) ++count;
+    return count;
+#endif
+}
+
+/// @brief Stein's binary gcd, shifts and subtractions instead of divisions
+static uint64_t binaryGcd(uint64_t a, uint64_t b) {
+    if (a == 0) return b;
+    if (b == 0) return a;
+
+    const auto shift = trailingZeros(a | b);
+    a >>= trailingZeros(a);
+    do {
+        b >>= trailingZeros(b);
+        if (a > b) std::swap(a, b);
+        b -= a;
+    } while (b);
+    return a << shift;
+}
+
+static constexpr double maxPrimeIndex = 1e10;  // nthprime past it sieves for minutes
+static constexpr double maxPrimeCount = 1e11;  // same for primepi
+static constexpr uint64_t maxNextPrime = uint64_t(1) << 53;  // larger ones round to even doubles
+
 static constexpr double performUnaryFn(Spec op, double a) {
     switch (op) {
         case Sqrt:
@@ -158,6 +250,8 @@ static constexpr double performUnaryFn(Spec op, double a) {
             return std::fabs(a);
         case Factorial:
         case Fact:
+            if (a >= 0 and a < std::size(factorials) and a == std::floor(a))
+                return double(factorials[(size_t)a]);
             return std::tgamma(a + 1);
             //
         case Ln:
@@ -175,6 +269,8 @@ static constexpr double performUnaryFn(Spec op, double a) {
             return std::round(a);
         case Trunc:
             return std::trunc(a);
+        case Step:
+            return std::isnan(a) ? a : a >= 0;
             //
         case Sinc:
             return my::sinc(a);
@@ -214,6 +310,29 @@ static constexpr double performUnaryFn(Spec op, double a) {
             return std::atanh(a);
         case Actanh:
             return std::atanh(my::HALF_PI - a);
+            //
+        case IsPrime:
+            return a >= 0 and a < 0x1p64 and a == std::floor(a) and isPrime((uint64_t)a);
+        case NextPrime:
+            if (a < 2) return 2;
+            if (a < 0x1p53)
+                if (const auto prime = PrimeTable::instance().next((uint64_t)a); prime and prime <= maxNextPrime)
+                    return double(prime);
+            return NaN;
+        case NthPrime:
+            if (a >= 1 and a <= maxPrimeIndex and a == std::floor(a))
+                return PrimeTable::instance().nth((uint64_t)a);
+            return NaN;
+        case PrimePi:
+            if (a < 2) return 0;
+            if (a <= maxPrimeCount) return PrimeTable::instance().count((uint64_t)a);
+            return NaN;
+            //
+        case Sum:
+        case Sort:
+            return a;
+        case Len:
+            return 1;
     }
     return NaN;
 }
@@ -239,9 +358,59 @@ static constexpr double performBinaryFn(Spec op, double a, double b) {
         case Max:
             return std::max(a, b);
         case Gcd:
-            return std::gcd((int)a, (int)b);
-        case Lcm:
-            return std::lcm((int)a, (int)b);
+        case Lcm: {
+            // operands are truncated to integers, both must fit int64_t
+            if (not(std::fabs(a) < 0x1p63 and std::fabs(b) < 0x1p63)) return NaN;
+            const auto x = magnitude((int64_t)a), y = magnitude((int64_t)b);
+            const auto gcd = binaryGcd(x, y);
+            if (op == Gcd) return double(gcd);
+            return gcd ? double(x / gcd) * double(y) : 0;
+        }
+        case Dot:
+            return (a * b);
+        case PowInt: {
+            // exponentiation by squaring, a handful of multiplications instead of std::pow
+            if (not(std::fabs(b) < 0x1p31) or b != std::trunc(b)) return std::pow(a, b);
+            // a negative power as (1/a)^n, 1/a^n would overflow to 0 before reaching a subnormal
+            const auto n = (int64_t)b;
+            if (n < 0) a = 1 / a;
+            double result = 1;
+            for (auto m = magnitude(n); m; m >>= 1) {
+                if (m & 1) result *= a;
+                a *= a;
+            }
+            return result;
+        }
+        case Runif:
+            return random::uniform(a, b);
+            // comparisons and logic give 1 or 0, any number but 0 is true
+        case Less:
+            return a < b;
+        case LessEq:
+            return a <= b;
+        case Greater:
+            return a > b;
+        case GreaterEq:
+            return a >= b;
+        case EqualTo:
+            return a == b;
+        case NotEqualTo:
+            return a != b;
+        case And:
+            return a != 0 and b != 0;
+        case Or:
+            return a != 0 or b != 0;
+    }
+    return NaN;
+}
+
+/// @brief Selects without branching, so block loops stay straight-line over piecewise functions
+static constexpr double performTernaryFn(Spec op, double a, double b, double c) {
+    switch (op) {
+        case If:
+            return a != 0 ? b : c;
+        case Clamp:
+            return std::min(std::max(a, b), c);
     }
     return NaN;
 }
@@ -263,33 +432,20 @@ static constexpr double getConstant(Spec op) {
 static constexpr double getGenerated(Spec op) {
     switch (op) {
         case RndGen:
-            return my::random();
+            return random::uniform();
+        case PrimeGen:
+            return PrimeTable::instance().next(uint64_t(random::uniform() * 2147483647.0));
+        case NormGen:
+            return random::normal();
         case TimeGen:
             return std::time(nullptr);
     }
     return NaN;
 }
 
-TokenContainer tokenize(const std::string& expression) {
-    static const std::map<char, Spec> ops{
-        {'+', Add},
-        {'-', Sub},
-        {'/', Div},
-        {'*', Mul},
-        {'%', Mod},
-        {'!', Fact},
-        {'^', Pow},
-        {'(', LeftPars},
-        {')', RightPars},
-        {'{', LeftPars},
-        {'}', RightPars},
-        {'[', LeftArrPars},
-        {']', RightArrPars},
-        {',', Comma},
-        {'=', Equals},
-    };
-
-    static const std::map<std::string, Spec> funcs{
+/// @brief Names of unary, binary and ternary functions
+static const std::map<std::string, Spec>& functions() {
+    static const std::map<std::string, Spec> table{
         {"fact", Factorial},
         //
         {"sqrt", Sqrt},
@@ -303,6 +459,7 @@ TokenContainer tokenize(const std::string& expression) {
         {"floor", Floor},
         {"round", Round},
         {"trunc", Trunc},
+        {"step", Step},
         //
         {"sinc", Sinc},
         //
@@ -332,20 +489,183 @@ TokenContainer tokenize(const std::string& expression) {
         {"lcm", Lcm},
         {"log", Log},
         {"abs", Abs},
+        //
+        {"sum", Sum},
+        {"len", Len},
+        {"sort", Sort},
+        {"dot", Dot},
+        {"runif", Runif},
+        //
+        {"if", If},
+        {"clamp", Clamp},
+        //
+        {"isprime", IsPrime},
+        {"nextprime", NextPrime},
+        {"nthprime", NthPrime},
+        {"primepi", PrimePi},
+        {"factor", Factor},
     };
+    return table;
+}
 
-    static const std::map<std::string, Spec> consts{
+/// @brief Names of constants
+static const std::map<std::string, Spec>& constants() {
+    static const std::map<std::string, Spec> table{
         {"pi", PiConst},
         {"tau", TauConst},
         {"e", EConst},
         {"phi", PhiConst},
     };
+    return table;
+}
 
-    static const std::map<std::string, Spec> gens{
+/// @brief Names of generators
+static const std::map<std::string, Spec>& generators() {
+    static const std::map<std::string, Spec> table{
         {"rnd", RndGen},
+        {"prime", PrimeGen},
+        {"rnorm", NormGen},
         {"time", TimeGen},
     };
+    return table;
+}
+
+// character classes of the "C" locale, which the calculator never leaves, without calls
+static constexpr bool isDigit(char ch) { return ch >= '0' and ch <= '9'; }
+static constexpr bool isLetter(char ch) { return (ch >= 'a' and ch <= 'z') or (ch >= 'A' and ch <= 'Z'); }
+static constexpr bool isBlank(char ch) { return ch == ' ' or ch == '\t'; }
+
+/// @brief Meanings of a name, Unknown for those it doesn't have
+struct Keyword {
+    Spec function = Unknown, constant = Unknown, generator = Unknown;
+};
+
+/**
+ * @brief Trie of the names of functions, constants and generators.
+ * The tokenizer looks the name being read up after every character of it, a walk is a step
+ * per character and leaves any other name at its first character no keyword continues with.
+ */
+class Keywords {
+   public:
+    Keywords() : nodes(1) {
+        const std::pair<const std::map<std::string, Spec>*, Spec Keyword::*> tables[]{
+            {&functions(), &Keyword::function},
+            {&constants(), &Keyword::constant},
+            {&generators(), &Keyword::generator},
+        };
+        for (const auto& [table, meaning] : tables) {
+            for (const auto& [name, spec] : *table) {
+                uint16_t node = 0;
+                for (const auto ch : name) {
+                    const auto index = edge(ch);
+                    // find never reaches a name with other characters, a trie can't hold it
+                    if (index == none) {
+                        node = 0;
+                        break;
+                    }
+                    if (not nodes[node].next[index]) {
+                        nodes[node].next[index] = uint16_t(nodes.size());
+                        nodes.emplace_back();
+                    }
+                    node = nodes[node].next[index];
+                }
+                if (node) nodes[node].keyword.*meaning = spec;
+            }
+        }
+    }
+
+    Keyword find(const std::string& name) const { return find(name.data(), name.size()); }
+
+    Keyword find(const char* name, size_t size) const {
+        uint16_t node = 0;
+        for (size_t i = 0; i < size; ++i) {
+            const auto index = edge(name[i]);
+            if (index == none or not(node = nodes[node].next[index])) return {};
+        }
+        return nodes[node].keyword;
+    }
+
+   private:
+    static constexpr uint8_t none = 36;  // edge of characters no name has
+
+    /// @return a..z as 0..25, 0..9 as 26..35
+    static uint8_t edge(char ch) {
+        if (ch >= 'a' and ch <= 'z') return uint8_t(ch - 'a');
+        if (ch >= '0' and ch <= '9') return uint8_t(26 + ch - '0');
+        return none;
+    }
+
+    struct Node {
+        uint16_t next[none]{};  // 0 where no name continues, the root is no one's child
+        Keyword keyword{};
+    };
+
+    std::vector<Node> nodes;
+};
 
+static const Keywords& keywords() {
+    static const Keywords trie;
+    return trie;
+}
+
+/// @return operator of the two characters written as prev then curr, Unknown if they are two
+static Spec mergedOperator(Spec prev, Spec curr, const std::string& prevValue) {
+    if (prevValue.size() != 1) return Unknown;
+    if (curr == Equals) {
+        switch (prev) {
+            case Less:
+                return LessEq;
+            case Greater:
+                return GreaterEq;
+            case Equals:
+                return EqualTo;
+            case Fact:
+                return NotEqualTo;
+        }
+    }
+    if ((curr == And or curr == Or) and prev == curr) return curr;
+    return Unknown;
+}
+
+/// @brief Operator of every character, Unknown for the other ones, looked up once per character
+static const std::array<Spec, 256>& operatorSymbols() {
+    static const auto table = [] {
+        std::array<Spec, 256> table;
+        table.fill(Unknown);
+        for (const auto& [ch, spec] : std::initializer_list<std::pair<char, Spec>>{
+                 {'+', Add},
+                 {'-', Sub},
+                 {'/', Div},
+                 {'*', Mul},
+                 {'%', Mod},
+                 {'!', Fact},
+                 {'^', Pow},
+                 {'(', LeftPars},
+                 {')', RightPars},
+                 {'{', LeftPars},
+                 {'}', RightPars},
+                 {'[', LeftArrPars},
+                 {']', RightArrPars},
+                 {',', Comma},
+                 {'=', Equals},
+                 {'<', Less},
+                 {'>', Greater},
+                 {'&', And},  // && and || only, a single one is rejected by parse
+                 {'|', Or},
+             })
+            table[uint8_t(ch)] = spec;
+        return table;
+    }();
+    return table;
+}
+
+/**
+ * @brief Tokenizer fed the input piece by piece, down to single characters.
+ * Feeding only appends tokens or changes the last one, every earlier token is final,
+ * so the state after a prefix of the input is the state, the token count and the last token.
+ */
+class Tokenizer {
+   public:
     enum State {
         OperatorState,
         UnaryOperatorState,
@@ -355,466 +675,937 @@ TokenContainer tokenize(const std::string& expression) {
         FunctionState,
         BeginState,
         ReadState,
-    } state = BeginState;
+        SpacedOperatorState,  // blanks after an operator, it doesn't merge with the next one
+    };
 
-    TokenContainer tokens;
-    tokens.reserve(expression.size());
+    /// @brief State after some prefix of the input, see restore
+    struct Checkpoint {
+        State state = BeginState;
+        size_t size = 0;
+        Token last{};
+    };
 
-    for (const auto& ch : expression) {
-        auto& last = tokens.back();
-        const auto conv = std::string(1, ch);
+    Checkpoint checkpoint() const { return {state, tokens.size(), tokens.empty() ? Token{} : tokens.back()}; }
 
-        switch (state) {
-            case BeginState: {
-                if (std::isdigit(ch)) {
-                    tokens.push_back({Number, conv});
-                    state = NumberState;
-                    break;
-                }
-                if (ch == '.') {
-                    tokens.push_back({Number, conv});
-                    state = FractionState;
-                    break;
-                }
-                if (std::isalpha(ch)) {
-                    state = VariableState;
+    /// @brief Returns to checkpoint taken after a prefix of the characters fed since
+    void restore(const Checkpoint& at) {
+        state = at.state;
+        tokens.resize(at.size);
+        if (at.size) tokens.back() = at.last;
+    }
 
-                    if (auto it = consts.find(conv); it != consts.end()) {
-                        tokens.push_back({it->second, conv});
+    /// @brief Feeds the characters in [begin, end)
+    void feed(const char* begin, const char* end) {
+        const auto& ops = operatorSymbols();
+        const auto& names = keywords();
+
+        // locals stay in registers, members would be reloaded after every store to a token
+        auto tokens = std::move(this->tokens);
+        auto state = this->state;
+        Token none{};  // stands in for the token before the first one
+
+        for (; begin != end; ++begin) {
+            const auto ch = *begin;
+            auto& last = tokens.empty() ? none : tokens.back();
+            const auto conv = std::string(1, ch);
+
+            switch (state) {
+                case BeginState: {
+                    if (isDigit(ch)) {
+                        tokens.push_back({Number, conv});
+                        state = NumberState;
                         break;
                     }
-
-                    if (auto it = gens.find(conv); it != gens.end()) {
-                        tokens.push_back({it->second, conv});
+                    if (ch == '.') {
+                        tokens.push_back({Number, conv});
+                        state = FractionState;
                         break;
                     }
+                    if (isLetter(ch)) {
+                        state = VariableState;
 
-                    tokens.push_back({Variable, conv});
-                    break;
-                }
-                if (auto it = ops.find(ch); it != ops.end()) {
-                    state = OperatorState;
+                        const auto name = names.find(&ch, 1);
+                        if (name.constant != Unknown) {
+                            tokens.push_back({name.constant, conv});
+                            break;
+                        }
 
-                    if (it->second == Sub) {
-                        tokens.push_back({Number, "-1"});
-                        tokens.push_back({Mul, "*"});
+                        if (name.generator != Unknown) {
+                            tokens.push_back({name.generator, conv});
+                            break;
+                        }
+
+                        tokens.push_back({Variable, conv});
                         break;
                     }
+                    if (const auto op = ops[uint8_t(ch)]; op != Unknown) {
+                        state = OperatorState;
 
-                    if (it->second == Add) break;
+                        if (op == Sub) {
+                            tokens.push_back({Number, "-1"});
+                            tokens.push_back({Mul, "*"});
+                            break;
+                        }
 
-                    tokens.push_back({it->second, conv});
-                    break;
-                }
-                if (!std::isblank(ch)) {
-                    tokens.push_back({Unknown, conv});
-                }
-                break;
-            }
-            case ReadState: {
-                if (std::isdigit(ch)) {
-                    tokens.push_back({Number, conv});
-                    state = NumberState;
-                    break;
-                }
-                if (ch == '.') {
-                    tokens.push_back({Number, conv});
-                    state = FractionState;
+                        if (op == Add) break;
+
+                        tokens.push_back({op, conv});
+                        break;
+                    }
+                    if (!isBlank(ch)) {
+                        tokens.push_back({Unknown, conv});
+                    }
                     break;
                 }
-                if (std::isalpha(ch)) {
-                    state = VariableState;
-
-                    if (auto it = consts.find(conv); it != consts.end()) {
-                        tokens.push_back({it->second, conv});
+                case ReadState: {
+                    if (isDigit(ch)) {
+                        tokens.push_back({Number, conv});
+                        state = NumberState;
                         break;
                     }
-
-                    if (auto it = gens.find(conv); it != gens.end()) {
-                        tokens.push_back({it->second, conv});
+                    if (ch == '.') {
+                        tokens.push_back({Number, conv});
+                        state = FractionState;
                         break;
                     }
+                    if (isLetter(ch)) {
+                        state = VariableState;
 
-                    tokens.push_back({Variable, conv});
-                    break;
-                }
-                if (auto it = ops.find(ch); it != ops.end()) {
-                    state = OperatorState;
-                    tokens.push_back({it->second, conv});
-                    break;
-                }
-                if (!std::isblank(ch)) {
-                    tokens.push_back({Unknown, conv});
-                }
-                break;
-            }
-            case NumberState: {
-                if (std::isdigit(ch)) {
-                    last.value.push_back(ch);
-                    break;
-                }
-                if (ch == '.') {
-                    last.value.push_back(ch);
-                    state = FractionState;
-                    break;
-                }
-                if (std::isalpha(ch)) {
-                    tokens.push_back({Mul, "*"});
-                    tokens.push_back({Variable, conv});
-                    state = VariableState;
-                    break;
-                }
-                if (auto it = ops.find(ch); it != ops.end()) {
-                    if (it->second == LeftPars) tokens.push_back({Mul, "*"});
-                    tokens.push_back({it->second, conv});
-                    state = OperatorState;
-                    break;
-                }
-                if (ch == '\'') {
-                    break;
-                }
-                if (std::isblank(ch)) {
-                    state = ReadState;
-                    break;
-                }
-                tokens.push_back({Unknown, conv});
-                break;
-            }
+                        const auto name = names.find(&ch, 1);
+                        if (name.constant != Unknown) {
+                            tokens.push_back({name.constant, conv});
+                            break;
+                        }
 
-            case FractionState: {
-                if (std::isdigit(ch)) {
-                    last.value.push_back(ch);
-                    break;
-                }
-                if (std::isalpha(ch)) {
-                    tokens.push_back({Mul, "*"});
-                    tokens.push_back({Variable, conv});
-                    state = VariableState;
-                    break;
-                }
-                if (auto it = ops.find(ch); it != ops.end()) {
-                    if (it->second == LeftPars) tokens.push_back({Mul, "*"});
-                    tokens.push_back({it->second, conv});
-                    state = OperatorState;
-                    break;
-                }
-                if (std::isblank(ch)) {
-                    state = ReadState;
-                    break;
-                }
-                tokens.push_back({Unknown, conv});
-                break;
-            }
+                        if (name.generator != Unknown) {
+                            tokens.push_back({name.generator, conv});
+                            break;
+                        }
 
-            case VariableState: {
-                if (std::isdigit(ch)) {
-                    last.value.push_back(ch);
+                        tokens.push_back({Variable, conv});
+                        break;
+                    }
+                    if (const auto op = ops[uint8_t(ch)]; op != Unknown) {
+                        state = OperatorState;
+                        tokens.push_back({op, conv});
+                        break;
+                    }
+                    if (!isBlank(ch)) {
+                        tokens.push_back({Unknown, conv});
+                    }
                     break;
                 }
-                if (std::isalpha(ch)) {
-                    last.value.push_back(ch);
-
-                    if (auto it = funcs.find(last.value); it != funcs.end()) {
-                        last.spec = it->second;
-                        state = FunctionState;
+                case NumberState: {
+                    if (isDigit(ch)) {
+                        last.value.push_back(ch);
                         break;
                     }
-
-                    if (auto it = consts.find(last.value); it != consts.end()) {
-                        last.spec = it->second;
+                    if (ch == '.') {
+                        last.value.push_back(ch);
+                        state = FractionState;
                         break;
                     }
-
-                    if (auto it = gens.find(last.value); it != gens.end()) {
-                        last.spec = it->second;
+                    if (isLetter(ch)) {
+                        tokens.push_back({Mul, "*"});
+                        tokens.push_back({Variable, conv});
+                        state = VariableState;
                         break;
                     }
-
-                    last.spec = Variable;
+                    if (const auto op = ops[uint8_t(ch)]; op != Unknown) {
+                        if (op == LeftPars) tokens.push_back({Mul, "*"});
+                        tokens.push_back({op, conv});
+                        state = OperatorState;
+                        break;
+                    }
+                    if (ch == '\'') {
+                        break;
+                    }
+                    if (isBlank(ch)) {
+                        state = ReadState;
+                        break;
+                    }
+                    tokens.push_back({Unknown, conv});
                     break;
                 }
-                if (auto it = ops.find(ch); it != ops.end()) {
-                    tokens.push_back({it->second, conv});
-                    state = OperatorState;
 
-                    if (auto cit = consts.find(last.value); cit != consts.end()) {
-                        last.spec = cit->second;
+                case FractionState: {
+                    if (isDigit(ch)) {
+                        last.value.push_back(ch);
                         break;
                     }
-
-                    if (auto cit = gens.find(last.value); cit != gens.end())
-                        last.spec = cit->second;
-
-                    break;
-                }
-                if (std::isblank(ch)) {
-                    state = ReadState;
-                    break;
-                }
-                tokens.push_back({Unknown, conv});
-                break;
-            }
-            case OperatorState: {
-                if (std::isdigit(ch)) {
-                    tokens.push_back({Number, conv});
-                    state = NumberState;
-                    break;
-                }
-                if (ch == '.') {
-                    tokens.push_back({Number, conv});
-                    state = FractionState;
+                    if (isLetter(ch)) {
+                        tokens.push_back({Mul, "*"});
+                        tokens.push_back({Variable, conv});
+                        state = VariableState;
+                        break;
+                    }
+                    if (const auto op = ops[uint8_t(ch)]; op != Unknown) {
+                        if (op == LeftPars) tokens.push_back({Mul, "*"});
+                        tokens.push_back({op, conv});
+                        state = OperatorState;
+                        break;
+                    }
+                    if (isBlank(ch)) {
+                        state = ReadState;
+                        break;
+                    }
+                    tokens.push_back({Unknown, conv});
                     break;
                 }
-                if (std::isalpha(ch)) {
-                    tokens.push_back({Variable, conv});
-                    state = VariableState;
+
+                case VariableState: {
+                    if (isDigit(ch)) {
+                        last.value.push_back(ch);
+                        break;
+                    }
+                    if (isLetter(ch)) {
+                        last.value.push_back(ch);
+                        const auto name = names.find(last.value);
+
+                        if (name.function != Unknown) {
+                            last.spec = name.function;
+                            state = FunctionState;
+                            break;
+                        }
+
+                        if (name.constant != Unknown) {
+                            last.spec = name.constant;
+                            break;
+                        }
+
+                        if (name.generator != Unknown) {
+                            last.spec = name.generator;
+                            break;
+                        }
+
+                        last.spec = Variable;
+                        break;
+                    }
+                    if (const auto op = ops[uint8_t(ch)]; op != Unknown) {
+                        // before push_back, which may invalidate last
+                        if (const auto name = names.find(last.value); name.constant != Unknown)
+                            last.spec = name.constant;
+                        else if (name.generator != Unknown)
+                            last.spec = name.generator;
+
+                        tokens.push_back({op, conv});
+                        state = OperatorState;
+                        break;
+                    }
+                    if (isBlank(ch)) {
+                        state = ReadState;
+                        break;
+                    }
+                    tokens.push_back({Unknown, conv});
                     break;
                 }
-                if (auto it = ops.find(ch); it != ops.end()) {
-                    auto& curr = it->second;
-                    auto& prev = last.spec;
-                    if (curr == LeftPars and prev == RightPars) {
-                        tokens.push_back({Mul, "*"});
+                case OperatorState:
+                case SpacedOperatorState: {
+                    if (isDigit(ch)) {
+                        tokens.push_back({Number, conv});
+                        state = NumberState;
                         break;
                     }
-                    if (curr == Mul and prev == Mul) {
-                        prev = Pow;
-                        last.value.push_back('*');
+                    if (ch == '.') {
+                        tokens.push_back({Number, conv});
+                        state = FractionState;
                         break;
                     }
-                    if (curr == Sub and prev != RightPars and not isUnaryOp(prev)) {
-                        tokens.push_back({Number, "-1"});
-                        tokens.push_back({Mul, "*"});
-                        state = UnaryOperatorState;
+                    if (isLetter(ch)) {
+                        tokens.push_back({Variable, conv});
+                        state = VariableState;
                         break;
                     }
-                    if (curr == Add and prev != RightPars and not isUnaryOp(prev)) {
-                        state = UnaryOperatorState;
+                    if (const auto op = ops[uint8_t(ch)]; op != Unknown) {
+                        const auto curr = op;
+                        auto& prev = last.spec;
+                        const auto adjacent = state == OperatorState;
+                        state = OperatorState;
+                        if (curr == LeftPars and prev == RightPars) {
+                            tokens.push_back({Mul, "*"});
+                            tokens.push_back({op, conv});
+                            break;
+                        }
+                        if (adjacent and curr == Mul and prev == Mul) {
+                            prev = Pow;
+                            last.value.push_back('*');
+                            break;
+                        }
+                        // x!==y is a factorial compared, not != followed by a stray =
+                        if (adjacent and curr == Equals and prev == NotEqualTo) {
+                            prev = Fact;
+                            last.value.pop_back();
+                            tokens.push_back({EqualTo, "=="});
+                            break;
+                        }
+                        // two character operators: <=, >=, ==, !=, &&, ||, written without a blank inside
+                        if (const auto merged = adjacent ? mergedOperator(prev, curr, last.value) : Unknown;
+                            merged != Unknown) {
+                            prev = merged;
+                            last.value.push_back(ch);
+                            break;
+                        }
+                        const auto closed = prev == RightPars or prev == RightArrPars;
+                        if (curr == Sub and not closed and not isUnaryOp(prev)) {
+                            tokens.push_back({Number, "-1"});
+                            tokens.push_back({Mul, "*"});
+                            state = UnaryOperatorState;
+                            break;
+                        }
+                        if (curr == Add and not closed and not isUnaryOp(prev)) {
+                            state = UnaryOperatorState;
+                            break;
+                        }
+
+                        tokens.push_back({op, conv});
                         break;
                     }
-
-                    tokens.push_back({it->second, conv});
+                    if (isBlank(ch)) {
+                        state = SpacedOperatorState;
+                        break;
+                    }
+                    tokens.push_back({Unknown, conv});
                     break;
                 }
-                if (!std::isblank(ch)) {
+                case UnaryOperatorState: {
+                    if (isDigit(ch)) {
+                        tokens.push_back({Number, conv});
+                        state = NumberState;
+                        break;
+                    }
+                    if (ch == '.') {
+                        tokens.push_back({Number, conv});
+                        state = FractionState;
+                        break;
+                    }
+                    if (isLetter(ch)) {
+                        tokens.push_back({Variable, conv});
+                        state = VariableState;
+                        break;
+                    }
+                    if (const auto op = ops[uint8_t(ch)]; op != Unknown) {
+                        if (op == LeftPars)
+                            state = OperatorState;
+                        tokens.push_back({op, conv});
+                        break;
+                    }
+                    if (isBlank(ch)) {
+                        state = ReadState;
+                        break;
+                    }
                     tokens.push_back({Unknown, conv});
-                }
-                break;
-            }
-            case UnaryOperatorState: {
-                if (std::isdigit(ch)) {
-                    tokens.push_back({Number, conv});
-                    state = NumberState;
                     break;
                 }
-                if (ch == '.') {
-                    tokens.push_back({Number, conv});
-                    state = FractionState;
+                case FunctionState: {
+                    if (isDigit(ch) or isLetter(ch)) {
+                        last.value.push_back(ch);
+                        // is it still a function or some unknown stuff
+                        if (const auto name = names.find(last.value); name.function != Unknown) {
+                            last.spec = name.function;
+                            break;
+                        }
+                        last.spec = Variable;
+                        state = VariableState;
+                        break;
+                    }
+                    if (const auto op = ops[uint8_t(ch)]; op != Unknown) {
+                        tokens.push_back({op, conv});
+                        state = OperatorState;
+                        break;
+                    }
+                    if (!isBlank(ch)) {
+                        tokens.push_back({Unknown, conv});
+                        break;
+                    }
                     break;
                 }
-                if (std::isalpha(ch)) {
-                    tokens.push_back({Variable, conv});
-                    state = VariableState;
-                    break;
+            }
+        }
+
+        this->tokens = std::move(tokens);
+        this->state = state;
+    }
+
+    TokenContainer tokens{};
+    State state = BeginState;
+};
+
+TokenContainer tokenize(const std::string& expression) {
+    KOROWA_STATS_TIMER(Tokenize);
+
+    Tokenizer tokenizer;
+    tokenizer.tokens.reserve(expression.size());
+    tokenizer.feed(expression.data(), expression.data() + expression.size());
+
+    KOROWA_STATS_ADD(Tokens, tokenizer.tokens.size());
+    return std::move(tokenizer.tokens);
+}
+
+/// @return whether parse rejects el before parsing anything
+static bool isUnknownSymbol(const Token& el) {
+    return el.spec == Unknown or
+           (el.spec == Number and el.value == ".") or
+           ((el.spec == And or el.spec == Or) and el.value.size() == 1);
+}
+
+static SyntaxError unknownSymbol(const TokenContainer& tokens, size_t index) {
+    return SyntaxError(SyntaxError::Code::UnknownSymbol, tokens[index].value,
+                       SyntaxError::Span{uint32_t(index), uint32_t(index + 1)});
+}
+
+/**
+ * @brief Shunting-yard parser of a token container, fed a prefix of it at a time.
+ * The output only grows and the operator stack is persistent: a pop moves the top down to
+ * the node below and pushed nodes never change, so the state after a prefix of the tokens
+ * is a few sizes, see checkpoint. Nodes refer to tokens by index, tokens before the parsed
+ * prefix must stay unchanged.
+ */
+class Parser {
+   public:
+    explicit Parser(const TokenContainer& tokens) : tokens(tokens) {}
+
+    /// @brief State after some prefix of the tokens, see restore
+    struct Checkpoint {
+        size_t output = 0, nodes = 0, index = 0;
+        uint32_t top = UINT32_MAX;
+        bool failed = false;
+    };
+
+    Checkpoint checkpoint() const { return {output.size(), nodes.size(), index, top, !!err}; }
+
+    /**
+     * @brief Returns to checkpoint taken after a prefix of the tokens fed since.
+     * An error of the prefix is still the current one, later tokens are ignored after it.
+     */
+    void restore(const Checkpoint& at) {
+        output.resize(at.output);
+        nodes.resize(at.nodes);
+        index = at.index;
+        top = at.top;
+        if (not at.failed) err = SyntaxError();
+    }
+
+    /// @brief Parses the tokens before end the previous calls didn't, stops at an error
+    void feed(size_t end) {
+        for (; index < end and not err; ++index) {
+            const auto& token = tokens[index];
+
+            if (token.spec == Number or token.spec == Variable or
+                isConstant(token.spec) or isGenerator(token.spec))
+                output.push_back(token);
+
+            else if (isUnaryOp(token.spec))
+                output.push_back(token);
+
+            else if (isFunction(token.spec) or token.spec == LeftPars or
+                     token.spec == LeftArrPars)
+                push(index, 1);  // element count of an open [
+
+            else if (isBinaryOp(token.spec)) {
+                while (not empty() and getPrecedence(back().spec) >= getPrecedence(token.spec)) {
+                    output.push_back(back());
+                    pop();
                 }
-                if (auto it = ops.find(ch); it != ops.end()) {
-                    if (it->second == LeftPars)
-                        state = OperatorState;
-                    tokens.push_back({it->second, conv});
-                    break;
+                push(index, 0);
+            }
+
+            else if (token.spec == Comma) {
+                if (empty())
+                    return fail(SyntaxError::Code::MismatchedSeparator);
+                while (back().spec != LeftPars and back().spec != LeftArrPars) {
+                    output.push_back(back());
+                    pop();
+                    if (empty())
+                        return fail(SyntaxError::Code::MismatchedSeparator);
                 }
-                if (std::isblank(ch)) {
-                    state = ReadState;
-                    break;
+                if (back().spec == LeftArrPars) {
+                    // a copy with one more element, the node itself may be below a checkpoint's top
+                    const auto node = nodes[top];
+                    pop();
+                    push(node.token, node.elements + 1);
                 }
-                tokens.push_back({Unknown, conv});
-                break;
             }
-            case FunctionState: {
-                if (std::isdigit(ch) or std::isalpha(ch)) {
-                    last.value.push_back(ch);
-                    // is it still a function or some unknown stuff
-                    if (auto it = funcs.find(last.value); it != funcs.end()) {
-                        last.spec = it->second;
-                        break;
-                    }
-                    last.spec = Variable;
-                    state = VariableState;
-                    break;
+
+            else if (token.spec == RightPars) {
+                if (empty() or back().spec == LeftArrPars) return fail(SyntaxError::Code::MismatchedParenthesis);
+                while (back().spec != LeftPars) {
+                    output.push_back(back());
+                    pop();
+                    if (empty() or back().spec == LeftArrPars) return fail(SyntaxError::Code::MismatchedParenthesis);
                 }
-                if (auto it = ops.find(ch); it != ops.end()) {
-                    tokens.push_back({it->second, conv});
-                    state = OperatorState;
-                    break;
+                pop();
+                if (not empty() and isFunction(back().spec)) {
+                    output.push_back(back());
+                    pop();
                 }
-                if (!std::isblank(ch)) {
-                    tokens.push_back({Unknown, conv});
-                    break;
+            }
+
+            else if (token.spec == RightArrPars) {
+                if (empty() or back().spec == LeftPars) return fail(SyntaxError::Code::MismatchedParenthesis);
+                while (back().spec != LeftArrPars) {
+                    output.push_back(back());
+                    pop();
+                    if (empty() or back().spec == LeftPars) return fail(SyntaxError::Code::MismatchedParenthesis);
+                }
+                const auto elements = nodes[top].elements;
+                pop();
+
+                // ] stays in the output as array constructor, its value is the element count
+                const auto noElements = tokens[index - 1].spec == LeftArrPars;
+                output.push_back({RightArrPars, std::to_string(noElements ? 0 : elements)});
+                if (not empty() and isFunction(back().spec)) {
+                    output.push_back(back());
+                    pop();
                 }
-                break;
             }
         }
     }
 
-    return tokens;
-}
+    /// @brief Moves the operators left on the stack to the output, call checkpoint before to feed more
+    void finish() {
+        if (err) return;
+        while (not empty()) {
+            if (back().spec == LeftPars or back().spec == LeftArrPars)
+                return fail(SyntaxError::Code::MismatchedParenthesis);
+            output.push_back(back());
+            pop();
+        }
+    }
+
+    TokenQueue output{};
+    SyntaxError err = SyntaxError();
+
+   private:
+    static constexpr uint32_t bottom = UINT32_MAX;  // below the first node
+
+    struct Node {
+        uint32_t token = 0;
+        uint32_t below = bottom;
+        size_t elements = 0;
+    };
+
+    bool empty() const { return top == bottom; }
+    const Token& back() const { return tokens[nodes[top].token]; }
+    void pop() { top = nodes[top].below; }
+    void push(size_t token, size_t elements) {
+        nodes.push_back({uint32_t(token), top, elements});
+        top = uint32_t(nodes.size() - 1);
+    }
+
+    void fail(SyntaxError::Code code) {
+        err = SyntaxError(code, SyntaxError::Span{uint32_t(index), uint32_t(index + 1)});
+    }
+
+    const TokenContainer& tokens;
+    std::vector<Node> nodes{};
+    uint32_t top = bottom;
+    size_t index = 0;  // of the next token
+};
 
 TokenQueue parse(const TokenContainer& tokens, SyntaxError& err) {
-    TokenQueue output;
-    TokenStack operators;
-
-    if (auto it = std::find_if(tokens.begin(), tokens.end(),
-                               [](auto el) { return el.spec == Unknown; });
-        it != tokens.end()) {
-        err = SyntaxError(
-            my::format("Unknown symbol: [{}] (:{})",
-                       it->value, std::distance(tokens.begin(), it)),
-            SyntaxError::Type::UnknownToken, {it->value});
-        return output;
+    KOROWA_STATS_TIMER(Parse);
+
+    if (auto it = std::find_if(tokens.begin(), tokens.end(), isUnknownSymbol); it != tokens.end()) {
+        err = unknownSymbol(tokens, std::distance(tokens.begin(), it));
+        return {};
     }
 
-    size_t index = 0;
-    bool arrExpr = false;
-    for (const auto& token : tokens) {
-        if (token.spec == Number or token.spec == Variable or
-            isConstant(token.spec) or isGenerator(token.spec))
-            output.push_back(token);
+    Parser parser(tokens);
+    parser.feed(tokens.size());
+    parser.finish();
 
-        else if (isUnaryOp(token.spec))
-            output.push_back(token);
+    if (parser.err) err = parser.err;
+    return std::move(parser.output);
+}
 
-        else if (isFunction(token.spec) or token.spec == LeftPars)
-            operators.push_back(token);
 
-        else if (isBinaryOp(token.spec)) {
-            while (not operators.empty() and
-                   getPrecedence(operators.back().spec) >= getPrecedence(token.spec)) {
-                output.push_back(operators.back());
-                operators.pop_back();
-            }
-            operators.push_back(token);
+static constexpr size_t maxStackDepth = 1024;  // operands an expression may keep pending
+
+static SyntaxError nestedTooDeeply(size_t depth) {
+    return SyntaxError(my::format("Expression is nested too deeply: {} pending operands, at most {}",
+                                  depth, maxStackDepth),
+                       SyntaxError::Type::Evaluation);
+}
+
+/// @brief Whether expression needs array evaluation, factor() produces an array too
+static bool hasArrays(const TokenQueue& tokenQueue) {
+    return std::any_of(tokenQueue.begin(), tokenQueue.end(), [](const auto& token) {
+        return token.spec == RightArrPars or token.spec == Factor;
+    });
+}
+
+/**
+ * @brief Evaluates parsed expression containing arrays.
+ * Operators and functions apply element-wise, scalars are broadcast over arrays,
+ * an array can't be an element of another one. Intermediate values live in the thread's Arena.
+ *
+ * @param tokenQueue parsed expression
+ * @param err occurred error reference
+ * @param variables saved variables, nullptr if variables are not available
+ * @return Array evaluated result
+ */
+Array evalArrays(TokenQueue& tokenQueue, SyntaxError& err,
+                 Variables* variables) {
+    KOROWA_STATS_TIMER(Evaluate);
+
+    auto& arena = Arena::local();
+    arena.reset();
+
+    std::vector<Operand> evalStack;
+    std::string variable{};
+
+    const auto scalar = [&arena](double value) {
+        auto* data = arena.allocate(1);
+        data[0] = value;
+        return Operand{data, 1, false};
+    };
+    // -0.0 is the identity of +, so sum of a single -0 keeps its sign like the scalar path
+    const auto sum = [](const double* data, size_t size) {
+        return size ? std::accumulate(data, data + size, -0.0) : 0.0;
+    };
+    const auto fail = [&err](const std::string& message) {
+        err = SyntaxError(message, SyntaxError::Type::Evaluation);
+        return Array{};
+    };
+    const auto failWith = [&err](SyntaxError::Code code, double payload = 0) {
+        err = SyntaxError(code, {}, payload);
+        return Array{};
+    };
+
+    if (variables and tokenQueue.front().spec == Variable and tokenQueue.back().spec == Equals) {
+        variable = tokenQueue.front().value;
+        tokenQueue.pop_front();
+    }
+
+    for (; not tokenQueue.empty(); tokenQueue.pop_front()) {
+        KOROWA_STATS_MAX(StackDepth, evalStack.size());
+        if (evalStack.size() > maxStackDepth) {
+            err = nestedTooDeeply(evalStack.size());
+            return {};
+        }
+        const auto& token = tokenQueue.front();
+        const auto spec = token.spec;
+
+        if (spec == Equals) {
+            if (variable.empty())
+                return failWith(SyntaxError::Code::AssignmentToNothing);
+            if (evalStack.empty()) return failWith(SyntaxError::Code::EvaluationError);
+            if (evalStack.size() > 1) return failWith(SyntaxError::Code::RedundantValues, evalStack.size());
+            if (evalStack.back().array) return failWith(SyntaxError::Code::ArrayAssignment);
+            (*variables)[variable] = evalStack.back().data[0];
+            break;
         }
 
-        else if (token.spec == Comma) {
-            if (operators.empty()) {
-                err = SyntaxError(
-                    my::format("Mismatched parenthesis or function argument separators (,) (:{})",
-                               index),
-                    SyntaxError::Type::Parsing);
-                return output;
-            }
-            while (operators.back().spec != LeftPars) {
-                output.push_back(operators.back());
-                operators.pop_back();
-                if (operators.empty()) {
-                    err = SyntaxError(
-                        my::format("Mismatched parenthesis or function argument separators (,) (:{})",
-                                   index),
-                        SyntaxError::Type::Parsing);
-                    return output;
-                }
+        if (spec == RightArrPars) {
+            const auto count = std::stoul(token.value);
+            if (count > evalStack.size()) return failWith(SyntaxError::Code::EvaluationError);
+
+            const auto first = evalStack.end() - count;
+            if (std::any_of(first, evalStack.end(), [](const auto& el) { return el.array; }))
+                return failWith(SyntaxError::Code::NestedArray);
+            size_t total = 0;
+            for (auto it = first; it != evalStack.end(); ++it) total += it->size;
+
+            auto* data = arena.allocate(total);
+            auto* out = data;
+            for (auto it = first; it != evalStack.end(); ++it)
+                out = std::copy(it->data, it->data + it->size, out);
+
+            evalStack.erase(first, evalStack.end());
+            evalStack.push_back({data, (uint32_t)total, true});
+        }
+
+        else if (isTernaryFn(spec)) {
+            if (evalStack.size() < 3) return failWith(SyntaxError::Code::EvaluationError);
+            const Operand operands[]{evalStack.end()[-3], evalStack.end()[-2], evalStack.end()[-1]};
+            evalStack.resize(evalStack.size() - 3);
+
+            uint32_t size = 1;
+            bool array = false;
+            for (const auto& operand : operands) {
+                if (not operand.array) continue;
+                if (array and operand.size != size)
+                    return fail(my::format("Array sizes don't match: {} and {}", size, operand.size));
+                size = operand.size;
+                array = true;
             }
+
+            auto* out = arena.allocate(size);
+            const auto [a, b, c] = operands;
+            for (uint32_t i = 0; i < size; ++i)
+                out[i] = performTernaryFn(spec, a.data[a.array * i], b.data[b.array * i],
+                                          c.data[c.array * i]);
+            evalStack.push_back({out, size, array});
         }
 
-        else if (token.spec == RightPars) {
-            if (operators.empty()) {
-                err = SyntaxError(my::format("Mismatched parenthesis (:{})", index),
-                                  SyntaxError::Type::Parsing);
-                return output;
+        else if (isBinaryFn(spec) or isBinaryOp(spec)) {
+            if (evalStack.size() < 2) return failWith(SyntaxError::Code::EvaluationError);
+            const auto b = evalStack.back();
+            evalStack.pop_back();
+            const auto a = evalStack.back();
+            evalStack.pop_back();
+
+            if (a.array and b.array and a.size != b.size)
+                return fail(my::format("Array sizes don't match: {} and {}", a.size, b.size));
+
+            const uint32_t size = a.array ? a.size : b.size;
+            const size_t strideA = a.array, strideB = b.array;
+            auto* out = arena.allocate(size);
+
+            switch (spec) {
+                case Add:
+                    zipWith(a.data, strideA, b.data, strideB, out, size,
+                            [](double x, double y) { return x + y; });
+                    break;
+                case Sub:
+                    zipWith(a.data, strideA, b.data, strideB, out, size,
+                            [](double x, double y) { return x - y; });
+                    break;
+                case Mul:
+                case Dot:
+                    zipWith(a.data, strideA, b.data, strideB, out, size,
+                            [](double x, double y) { return x * y; });
+                    break;
+                case Div:
+                    zipWith(a.data, strideA, b.data, strideB, out, size,
+                            [](double x, double y) { return x / y; });
+                    break;
+                default:
+                    zipWith(a.data, strideA, b.data, strideB, out, size,
+                            [spec](double x, double y) { return performBinaryFn(spec, x, y); });
             }
-            while (operators.back().spec != LeftPars) {
-                output.push_back(operators.back());
-                operators.pop_back();
-                if (operators.empty()) {
-                    err = SyntaxError(my::format("Mismatched parenthesis (:{})", index),
-                                      SyntaxError::Type::Parsing);
-                    return output;
+
+            if (spec == Dot)
+                evalStack.push_back(scalar(sum(out, size)));
+            else
+                evalStack.push_back({out, size, a.array or b.array});
+        }
+
+        else if (isUnaryFn(spec) or isUnaryOp(spec)) {
+            if (evalStack.empty()) return failWith(SyntaxError::Code::EvaluationError);
+            auto& a = evalStack.back();
+
+            if (spec == Sum) {
+                a = scalar(sum(a.data, a.size));
+            } else if (spec == Len) {
+                a = scalar(a.size);
+            } else if (spec == Factor) {
+                if (a.array) return fail("factor() expects a single number");
+                const auto n = a.data[0];
+                if (n != std::floor(n) or std::fabs(n) >= 0x1p64)
+                    return fail(my::format("Can't factor {}", n));
+
+                // product of the factors is n, so -12 is [-1, 2, 2, 3] and 0, 1 are themselves
+                const auto factors = PrimeTable::instance().factor((uint64_t)std::fabs(n));
+                const size_t sign = n < 0 and n != -1;
+                const auto size = factors.empty() ? 1 : factors.size() + sign;
+                auto* out = arena.allocate(size);
+                if (factors.empty()) out[0] = n;
+                if (sign) out[0] = -1;
+                std::copy(factors.begin(), factors.end(), out + sign);
+                a = {out, (uint32_t)size, true};
+            } else {
+                auto* out = arena.allocate(a.size);
+                if (spec == Sort) {
+                    std::copy(a.data, a.data + a.size, out);
+                    std::sort(out, out + a.size, [](double x, double y) {
+                        return not std::isnan(x) and (std::isnan(y) or x < y);  // NaN last
+                    });
+                } else {
+                    for (uint32_t i = 0; i < a.size; ++i) out[i] = performUnaryFn(spec, a.data[i]);
                 }
-            }
-            operators.pop_back();
-            if (not operators.empty() and isFunction(operators.back().spec)) {
-                output.push_back(operators.back());
-                operators.pop_back();
+                a.data = out;
             }
         }
 
-        else if (token.spec == RightArrPars) {
-            if (operators.empty()) {
-                err = SyntaxError(my::format("Mismatched parenthesis (:{})", index),
-                                  SyntaxError::Type::Parsing);
-                return output;
-            }
-            while (operators.back().spec != LeftArrPars) {
-                output.push_back(operators.back());
-                operators.pop_back();
-                if (operators.empty()) {
-                    err = SyntaxError(my::format("Mismatched parenthesis (:{})", index),
-                                      SyntaxError::Type::Parsing);
-                    return output;
+        else if (isConstant(spec))
+            evalStack.push_back(scalar(getConstant(spec)));
+
+        else if (isGenerator(spec))
+            evalStack.push_back(scalar(getGenerated(spec)));
+
+        else if (spec == Number)
+            evalStack.push_back(scalar(my::parse<double>(token.value)));
+
+        else if (spec == Variable) {
+            if (variables)
+                if (auto it = variables->find(token.value); it != variables->end()) {
+                    evalStack.push_back(scalar(it->second));
+                    continue;
                 }
-            }
-            operators.pop_back();
-            if (not operators.empty() and isFunction(operators.back().spec)) {
-                output.push_back(operators.back());
-                operators.pop_back();
-            }
+            err = SyntaxError(SyntaxError::Code::UnknownVariable, token.value);
+            return {};
         }
-        index++;
-    }
 
-    while (operators.size()) {
-        if (operators.back().spec == LeftPars) {
-            err = SyntaxError(my::format("Mismatched parenthesis (:{})", index),
-                              SyntaxError::Type::Parsing);
-            return output;
+        else {
+            err = SyntaxError(SyntaxError::Code::UnexpectedSymbol, token.value);
+            return {};
         }
-        output.push_back(operators.back());
-        operators.pop_back();
     }
 
-    return output;
+    if (evalStack.empty()) return failWith(SyntaxError::Code::EvaluationError);
+    if (evalStack.size() > 1) return failWith(SyntaxError::Code::RedundantValues, evalStack.size());
+
+    const auto& top = evalStack.back();
+    return {std::vector<double>(top.data, top.data + top.size), not top.array};
+}
+
+/// @brief Single value of array evaluation result, arrays of other sizes are an error
+static double scalarOf(const Array& result, SyntaxError& err) {
+    if (err) return NaN;
+    if (result.values.size() != 1) {
+        err = SyntaxError(SyntaxError::Code::ArrayResult, {}, double(result.values.size()));
+        return NaN;
+    }
+    return result.values.front();
+}
+
+/**
+ * @brief Operand stack depth of RPN, computed once before evaluation
+ *
+ * @param tokenQueue parsed expression
+ * @param assignment whether = ends the expression, otherwise it isn't checked statically
+ * @return peak depth, 0 if some operator lacks operands, values are left over
+ * or a token can't be checked statically
+ */
+static size_t stackDepth(const TokenQueue& tokenQueue, bool assignment) {
+    long depth = 0;
+    size_t peak = 0;
+
+    for (const auto& token : tokenQueue) {
+        const auto spec = token.spec;
+        if (spec == Equals and assignment) break;
+
+        if (isTernaryFn(spec))
+            depth -= 2;
+        else if (isBinaryFn(spec) or (isBinaryOp(spec) and spec != Equals))
+            --depth;
+        else if (isConstant(spec) or isGenerator(spec) or spec == Number or spec == Variable)
+            ++depth;
+        else if (not isUnaryFn(spec) and not isUnaryOp(spec))
+            return 0;
+
+        if (depth <= 0) return 0;
+        peak = std::max<size_t>(peak, depth);
+    }
+    return depth == 1 ? peak : 0;
+}
+
+/**
+ * @brief Evaluates RPN checked by stackDepth up to the end or the first =.
+ * Operands live in a fixed-size buffer and operators don't check for them.
+ *
+ * @param tokenQueue parsed expression, stackDepth of it is in (0, maxStackDepth]
+ * @param variables saved variables, nullptr if variables are disabled
+ * @param missing set to the first unknown variable, the result is NaN then
+ * @return double evaluated result
+ */
+static double evalVerified(const TokenQueue& tokenQueue,
+                           const Variables* variables, std::string& missing) {
+    static const Variables none;
+    const auto& known = variables ? *variables : none;
+
+    double stack[maxStackDepth];
+    size_t size = 0;
+
+    for (const auto& token : tokenQueue) {
+        const auto spec = token.spec;
+        if (spec == Equals) break;
+
+        if (isTernaryFn(spec)) {
+            size -= 2;
+            stack[size - 1] = performTernaryFn(spec, stack[size - 1], stack[size], stack[size + 1]);
+        } else if (isBinaryFn(spec) or isBinaryOp(spec)) {
+            --size;
+            stack[size - 1] = performBinaryFn(spec, stack[size - 1], stack[size]);
+        } else if (isUnaryFn(spec) or isUnaryOp(spec)) {
+            stack[size - 1] = performUnaryFn(spec, stack[size - 1]);
+        } else if (isConstant(spec)) {
+            stack[size++] = getConstant(spec);
+        } else if (isGenerator(spec)) {
+            stack[size++] = getGenerated(spec);
+        } else if (spec == Number) {
+            stack[size++] = my::parse<double>(token.value);
+        } else if (auto it = known.find(token.value); it != known.end()) {
+            stack[size++] = it->second;
+        } else {
+            missing = token.value;
+            return NaN;
+        }
+    }
+    return stack[0];
 }
 
 }  // namespace detail
 
 /**
- * @brief Evaluates math expression with error handling and variable dumping.
- * It is only possible to assign lhs value to rhs number or other variable
+ * @brief Evaluates math expression which may contain arrays, with variable dumping.
  *
  * @param input string representing math expression
  * @param err occurred error reference
  * @param variables reference to map of saved variables
+ * @return Array evaluated result
+ */
+Array evalArray(const std::string& input, SyntaxError& err,
+                Variables& variables) {
+    KOROWA_STATS_ADD(Evaluations, 1);
+    auto tokenQueue = detail::parse(detail::tokenize(input), err);
+    if (err) return {};
+    if (tokenQueue.empty()) {
+        err = SyntaxError(SyntaxError::Code::EmptyExpression);
+        return {};
+    }
+    return detail::evalArrays(tokenQueue, err, &variables);
+}
+
+/**
+ * @brief Evaluates math expression which may contain arrays.
+ *
+ * @param input string representing math expression
+ * @param err occurred error reference
+ * @return Array evaluated result
+ */
+Array evalArray(const std::string& input, SyntaxError& err) {
+    KOROWA_STATS_ADD(Evaluations, 1);
+    auto tokenQueue = detail::parse(detail::tokenize(input), err);
+    if (err) return {};
+    if (tokenQueue.empty()) {
+        err = SyntaxError(SyntaxError::Code::EmptyExpression);
+        return {};
+    }
+    return detail::evalArrays(tokenQueue, err, nullptr);
+}
+
+/**
+ * @brief Evaluates parsed math expression with error handling and variable dumping, see eval
+ *
+ * @param tokenQueue parsed expression
+ * @param err occurred error reference
+ * @param variables reference to map of saved variables
  * @return double evaluated result
  */
-double eval(const std::string& input, SyntaxError& err,
-            std::map<std::string, double>& variables) {
+double evalParsed(detail::TokenQueue tokenQueue, SyntaxError& err,
+                  Variables& variables) {
     using namespace detail;
 
     /////////////forced sacrifice////////////////
 #define getNumOrError(name)                                                   \
     if (evalStack.empty()) {                                                  \
-        err = SyntaxError("Evaluation error", SyntaxError::Type::Evaluation); \
+        err = SyntaxError(SyntaxError::Code::EvaluationError);                \
         return NaN;                                                           \
     }                                                                         \
     auto name = evalStack.back();                                             \
     evalStack.pop_back();
     ////////////////////////////////////////////
 
-    auto tokens = tokenize(input);
-    auto tokenQueue = parse(tokens, err);
-#ifdef KOROWA_PRINT_TOKENS
-    my::printf("\n  {}\n", my::join(tokens, "| |", "[|", "|]"));
-    my::printf("\n  {}\n", my::join(tokenQueue, "| |", "[|", "|]"));
-#endif
-
-    if (err) return NaN;
     if (tokenQueue.empty()) {
-        err = SyntaxError("Empty expression",
-                          SyntaxError::Type::Evaluation);
+        err = SyntaxError(SyntaxError::Code::EmptyExpression);
         return NaN;
     }
 
-    std::vector<double> evalStack;
+    if (hasArrays(tokenQueue)) return scalarOf(evalArrays(tokenQueue, err, &variables), err);
+
+    KOROWA_STATS_TIMER(Evaluate);
     std::string variable{};
 
     if (tokenQueue.front().spec == Variable and
@@ -823,27 +1614,56 @@ double eval(const std::string& input, SyntaxError& err,
         tokenQueue.pop_front();
     }
 
+    // well-formed expressions skip the checks below, which remain to report errors
+    if (const auto depth = stackDepth(tokenQueue, not variable.empty()); depth > maxStackDepth) {
+        err = nestedTooDeeply(depth);
+        return NaN;
+    } else if (depth) {
+        KOROWA_STATS_MAX(StackDepth, depth);
+        std::string missing;
+        const auto result = evalVerified(tokenQueue, &variables, missing);
+        if (not missing.empty()) {
+            err = SyntaxError(SyntaxError::Code::UnknownVariable, missing);
+            return NaN;
+        }
+        if (not variable.empty()) variables[variable] = result;
+        return result;
+    }
+
+    std::vector<double> evalStack;
+
     while (not tokenQueue.empty()) {
+        KOROWA_STATS_MAX(StackDepth, evalStack.size());
         const auto currSpec = tokenQueue.front().spec;
         const auto currVal = tokenQueue.front().value;
 
         if (currSpec == Equals) {
             if (evalStack.size() > 1) {
-                err = SyntaxError(my::format("Redundant values: {}",
-                                             my::join(evalStack)),
-                                  SyntaxError::Type::Evaluation);
+                err = SyntaxError(SyntaxError::Code::RedundantValues, {}, double(evalStack.size()));
                 return NaN;
             }
             if (variable.empty()) {
-                err = SyntaxError("Inapropriate use of = operator: trying to assign to \"\"",
-                                  SyntaxError::Type::Evaluation);
+                err = SyntaxError(SyntaxError::Code::AssignmentToNothing);
+                return NaN;
+            }
+            if (evalStack.empty()) {
+                err = SyntaxError(SyntaxError::Code::EvaluationError);
                 return NaN;
             }
             variables[variable] = evalStack.back();
             return evalStack.back();
         }
 
-        if (isBinaryFn(currSpec) or isBinaryOp(currSpec)) {
+        if (isTernaryFn(currSpec)) {
+            getNumOrError(c);
+            getNumOrError(b);
+            getNumOrError(a);
+
+            evalStack.push_back(performTernaryFn(currSpec, a, b, c));
+            tokenQueue.pop_front();
+        }
+
+        else if (isBinaryFn(currSpec) or isBinaryOp(currSpec)) {
             getNumOrError(b);
             getNumOrError(a);
 
@@ -879,15 +1699,13 @@ double eval(const std::string& input, SyntaxError& err,
                 tokenQueue.pop_front();
                 continue;
             }
-            err = SyntaxError(my::format("Unknown variable: [{}]", currVal),
-                              SyntaxError::Type::UnknownToken, {currVal});
+            err = SyntaxError(SyntaxError::Code::UnknownVariable, currVal);
             return NaN;
         }
     }
 
     if (evalStack.size() > 1) {
-        err = SyntaxError(my::format("Redundant values: {}", my::join(evalStack)),
-                          SyntaxError::Type::Evaluation);
+        err = SyntaxError(SyntaxError::Code::RedundantValues, {}, double(evalStack.size()));
         return NaN;
     }
 
@@ -896,46 +1714,91 @@ double eval(const std::string& input, SyntaxError& err,
 }
 
 /**
- * @brief Evaluates math expression with error handling.
+ * @brief Evaluates math expression with error handling and variable dumping.
+ * It is only possible to assign lhs value to rhs number or other variable
  *
  * @param input string representing math expression
  * @param err occurred error reference
+ * @param variables reference to map of saved variables
  * @return double evaluated result
  */
-double eval(const std::string& input, SyntaxError& err) {
+double eval(const std::string& input, SyntaxError& err,
+            Variables& variables) {
+    using namespace detail;
+
+    KOROWA_STATS_ADD(Evaluations, 1);
+    auto tokens = tokenize(input);
+    auto tokenQueue = parse(tokens, err);
+#ifdef KOROWA_PRINT_TOKENS
+    my::printf("\n  {}\n", my::join(tokens, "| |", "[|", "|]"));
+    my::printf("\n  {}\n", my::join(tokenQueue, "| |", "[|", "|]"));
+#endif
+
+    if (err) return NaN;
+    return evalParsed(std::move(tokenQueue), err, variables);
+}
+
+/**
+ * @brief Evaluates parsed math expression with error handling, see eval
+ *
+ * @param tokenQueue parsed expression
+ * @param err occurred error reference
+ * @return double evaluated result
+ */
+double evalParsed(detail::TokenQueue tokenQueue, SyntaxError& err) {
     using namespace detail;
 
     /////////////forced sacrifice////////////////
 #define getNumOrError(name)                                                   \
     if (evalStack.empty()) {                                                  \
-        err = SyntaxError("Evaluation error", SyntaxError::Type::Evaluation); \
+        err = SyntaxError(SyntaxError::Code::EvaluationError);                \
         return NaN;                                                           \
     }                                                                         \
     auto name = evalStack.back();                                             \
     evalStack.pop_back();
     ////////////////////////////////////////////
 
-    auto tokens = tokenize(input);
-    auto tokenQueue = parse(tokens, err);
-#ifdef KOROWA_PRINT_TOKENS
-    my::printf("\n  {}\n", my::join(tokens, "| |", "[|", "|]"));
-    my::printf("\n  {}\n", my::join(tokenQueue, "| |", "[|", "|]"));
-#endif
-
-    if (err) return NaN;
     if (tokenQueue.empty()) {
-        err = SyntaxError("Empty expression",
-                          SyntaxError::Type::Evaluation);
+        err = SyntaxError(SyntaxError::Code::EmptyExpression);
+        return NaN;
+    }
+
+    if (hasArrays(tokenQueue)) return scalarOf(evalArrays(tokenQueue, err, nullptr), err);
+
+    KOROWA_STATS_TIMER(Evaluate);
+
+    // well-formed expressions skip the checks below, which remain to report errors
+    if (const auto depth = stackDepth(tokenQueue, false); depth > maxStackDepth) {
+        err = nestedTooDeeply(depth);
         return NaN;
+    } else if (depth) {
+        KOROWA_STATS_MAX(StackDepth, depth);
+        std::string missing;
+        const auto result = evalVerified(tokenQueue, nullptr, missing);
+        if (not missing.empty()) {
+            err = SyntaxError(SyntaxError::Code::UnknownVariableNoSession, missing);
+            return NaN;
+        }
+        return result;
     }
 
     std::vector<double> evalStack;
 
     while (not tokenQueue.empty()) {
+        KOROWA_STATS_MAX(StackDepth, evalStack.size());
         const auto currSpec = tokenQueue.front().spec;
         const auto currVal = tokenQueue.front().value;
 
-        if (isBinaryFn(currSpec) or isBinaryOp(currSpec)) {
+        if (isTernaryFn(currSpec)) {
+            getNumOrError(c);
+            getNumOrError(b);
+            getNumOrError(a);
+
+            evalStack.push_back(performTernaryFn(currSpec, a, b, c));
+            tokenQueue.pop_front();
+        }
+
+        else if (isBinaryFn(currSpec) or isBinaryOp(currSpec)) {
             getNumOrError(b);
             getNumOrError(a);
 
@@ -966,15 +1829,13 @@ double eval(const std::string& input, SyntaxError& err) {
         }
 
         else if (currSpec == Variable) {
-            err = SyntaxError(my::format("Unknown variable (variables may be disabled): [{}]", currVal),
-                              SyntaxError::Type::UnknownToken, {currVal});
+            err = SyntaxError(SyntaxError::Code::UnknownVariableNoSession, currVal);
             return NaN;
         }
     }
 
     if (evalStack.size() > 1) {
-        err = SyntaxError(my::format("Redundant values: {}", my::join(evalStack)),
-                          SyntaxError::Type::Evaluation);
+        err = SyntaxError(SyntaxError::Code::RedundantValues, {}, double(evalStack.size()));
         return NaN;
     }
 
@@ -982,6 +1843,28 @@ double eval(const std::string& input, SyntaxError& err) {
     return evalStack.back();  // top
 }
 
+/**
+ * @brief Evaluates math expression with error handling.
+ *
+ * @param input string representing math expression
+ * @param err occurred error reference
+ * @return double evaluated result
+ */
+double eval(const std::string& input, SyntaxError& err) {
+    using namespace detail;
+
+    KOROWA_STATS_ADD(Evaluations, 1);
+    auto tokens = tokenize(input);
+    auto tokenQueue = parse(tokens, err);
+#ifdef KOROWA_PRINT_TOKENS
+    my::printf("\n  {}\n", my::join(tokens, "| |", "[|", "|]"));
+    my::printf("\n  {}\n", my::join(tokenQueue, "| |", "[|", "|]"));
+#endif
+
+    if (err) return NaN;
+    return evalParsed(std::move(tokenQueue), err);
+}
+
 /**
  * @brief Evaluates math expression without error handling and variable dumping.
  * Simplified version for in-code usage.
@@ -1000,6 +1883,7 @@ double eval(const std::string& input) {
     evalStack.pop_back();
     ////////////////////////////////////////////
 
+    KOROWA_STATS_ADD(Evaluations, 1);
     korowa::SyntaxError err;
     auto tokens = tokenize(input);
     auto tokenQueue = parse(tokens, err);
@@ -1009,10 +1893,23 @@ double eval(const std::string& input) {
         return NaN;
     }
 
+    if (hasArrays(tokenQueue)) return scalarOf(evalArrays(tokenQueue, err, nullptr), err);
+
+    KOROWA_STATS_TIMER(Evaluate);
+
+    if (const auto depth = stackDepth(tokenQueue, false); depth > maxStackDepth) {
+        return NaN;
+    } else if (depth) {
+        KOROWA_STATS_MAX(StackDepth, depth);
+        std::string missing;
+        return evalVerified(tokenQueue, nullptr, missing);
+    }
+
     std::vector<double> evalStack;
     std::string variable{};
 
     while (not tokenQueue.empty()) {
+        KOROWA_STATS_MAX(StackDepth, evalStack.size());
         const auto currSpec = tokenQueue.front().spec;
         const auto currVal = tokenQueue.front().value;
 
@@ -1020,7 +1917,16 @@ double eval(const std::string& input) {
             return NaN;
         }
 
-        if (isBinaryFn(currSpec) or isBinaryOp(currSpec)) {
+        if (isTernaryFn(currSpec)) {
+            getNumOrError(c);
+            getNumOrError(b);
+            getNumOrError(a);
+
+            evalStack.push_back(performTernaryFn(currSpec, a, b, c));
+            tokenQueue.pop_front();
+        }
+
+        else if (isBinaryFn(currSpec) or isBinaryOp(currSpec)) {
             getNumOrError(b);
             getNumOrError(a);
 
@@ -0,0 +1,379 @@
+#pragma once
+#ifndef KOROWA_LIBRARY_HPP
+#define KOROWA_LIBRARY_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <korowa/Compiler.hpp>
+#include <korowa/MappedFile.hpp>
+#include <korowa/SyntaxError.hpp>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Libraries of compiled formulas, ".kbc" files.
+// The file is mapped into memory and used in place: opening checks only the header,
+// a lookup binary searches the sorted index and checks just the formula it finds,
+// so the cost of a library is proportional to the formulas actually used.
+//
+// layout (little-endian, every section 8 byte aligned):
+//   LibraryHeader
+//   FormulaRecord[count]   sorted by name
+//   Instruction[]          code of every formula, executed in place
+//   StringRef[]            variable names of every formula
+//   char[]                 names, sources and variable names
+
+namespace korowa {
+
+namespace detail {
+
+static constexpr char libraryMagic[4]{'K', 'B', 'C', '\0'};
+static constexpr uint32_t libraryVersion = 1;
+
+struct StringRef {
+    uint32_t offset = 0;  // into the strings section
+    uint32_t length = 0;
+};
+
+struct LibraryHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t fingerprint;  // of the instruction encoding, see specFingerprint
+    uint32_t count;        // formulas
+    uint32_t reserved;
+    uint64_t indexOffset;
+    uint64_t codeOffset;
+    uint64_t symbolsOffset;
+    uint64_t stringsOffset;
+    uint64_t size;  // of the whole file, detects truncation
+};
+
+struct FormulaRecord {
+    StringRef name;
+    StringRef source;
+    StringRef assignTo;
+    uint32_t code;  // first instruction
+    uint32_t codeSize;
+    uint32_t symbols;  // first StringRef
+    uint32_t symbolCount;
+    uint32_t maxDepth;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(Instruction) == 16 and std::is_trivially_copyable_v<Instruction>,
+              "Instruction is stored in libraries as is");
+static_assert(sizeof(LibraryHeader) == 64 and sizeof(FormulaRecord) == 48);
+
+/**
+ * @brief Hash of the spec numbering and of the instruction layout.
+ * Libraries written by a build with different specs are rejected instead of misread.
+ */
+static uint64_t specFingerprint() {
+    static const uint64_t fingerprint = [] {
+        uint64_t hash = 0xcbf29ce484222325;  // FNV-1a
+        const auto mix = [&hash](const void* data, size_t size) {
+            for (size_t i = 0; i < size; ++i) {
+                hash ^= static_cast<const uint8_t*>(data)[i];
+                hash *= 0x100000001b3;
+            }
+        };
+        const uint32_t layout[]{SpecCount, sizeof(Instruction), Number, Variable, Add, Equals};
+        mix(layout, sizeof(layout));
+        for (const auto* table : {&functions(), &constants(), &generators()})
+            for (const auto& [name, spec] : *table) {
+                mix(name.data(), name.size());
+                const uint32_t value = spec;
+                mix(&value, sizeof(value));
+            }
+        return hash;
+    }();
+    return fingerprint;
+}
+
+}  // namespace detail
+
+/**
+ * @brief Formula of a library, every member points into the mapped file
+ */
+struct Formula {
+    std::string_view name{};
+    std::string_view source{};    // expression it was compiled from
+    std::string_view assignTo{};  // target of "name = (...)", empty if none
+    ProgramView program{};
+    const detail::StringRef* symbols = nullptr;
+    uint32_t symbolCount = 0;
+    const char* strings = nullptr;
+
+    std::string_view symbol(uint32_t slot) const {
+        return {strings + symbols[slot].offset, symbols[slot].length};
+    }
+
+    /// @return owning copy, e.g. to save it into another library
+    Program toProgram() const {
+        Program result;
+        result.code.assign(program.begin(), program.end());
+        for (uint32_t i = 0; i < symbolCount; ++i) result.symbols.emplace_back(symbol(i));
+        result.assignTo = assignTo;
+        result.maxDepth = program.maxDepth;
+        return result;
+    }
+};
+
+/**
+ * @brief Library of compiled formulas mapped from a .kbc file
+ */
+class Library {
+   public:
+    /**
+     * @brief Maps library file, only the header is read
+     *
+     * @param path .kbc file written by saveLibrary
+     * @param err occurred error reference, set if file is missing, truncated or incompatible
+     * @return Library empty on error
+     */
+    static Library open(const std::string& path, SyntaxError& err) {
+        using namespace detail;
+
+        Library library;
+        library.file = MappedFile::open(path, err);
+        if (err) return {};
+
+        const auto fail = [&err, &path](const char* reason) {
+            err = SyntaxError(my::format("Invalid formula library {}: {}", path, reason),
+                              SyntaxError::Type::Io);
+            return Library{};
+        };
+
+        const auto size = library.file.size();
+        if (size < sizeof(LibraryHeader)) return fail("too short");
+
+        LibraryHeader header;
+        std::memcpy(&header, library.file.data(), sizeof(header));
+        if (std::memcmp(header.magic, libraryMagic, sizeof(libraryMagic)) != 0)
+            return fail("not a .kbc file");
+        if (header.version != libraryVersion or header.fingerprint != specFingerprint() or
+            not littleEndian())
+            return fail("written by an incompatible version");
+        if (header.size != size) return fail("truncated");
+
+        const auto section = [size](uint64_t offset, uint64_t end) {
+            return offset % 8 == 0 and offset <= end and end <= size;
+        };
+        if (not section(header.indexOffset, header.codeOffset) or
+            not section(header.codeOffset, header.symbolsOffset) or
+            not section(header.symbolsOffset, header.stringsOffset) or
+            not section(header.stringsOffset, size) or
+            header.codeOffset - header.indexOffset != uint64_t(header.count) * sizeof(FormulaRecord))
+            return fail("corrupted sections");
+
+        library.header = header;
+        return library;
+    }
+
+    uint32_t size() const { return header.count; }
+
+    /**
+     * @brief Finds formula by name, binary search touching only a few pages of the index
+     *
+     * @param name formula name
+     * @param formula out, set if found
+     * @return false if library has no such formula or its record is corrupted
+     */
+    bool find(std::string_view name, Formula& formula) const {
+        uint32_t low = 0, high = header.count;
+        while (low < high) {
+            const auto middle = low + (high - low) / 2;
+            const auto record = recordAt(middle);
+            const auto current = string(record.name);
+            if (current == name) return at(middle, formula);
+            if (current < name)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Formula at position i of the index, ordered by name
+     *
+     * @return false if its record is corrupted
+     */
+    bool at(uint32_t i, Formula& formula) const {
+        using namespace detail;
+
+        const auto record = recordAt(i);
+        const auto codeCount = (header.symbolsOffset - header.codeOffset) / sizeof(Instruction);
+        const auto symbolsCount = (header.stringsOffset - header.symbolsOffset) / sizeof(StringRef);
+        if (uint64_t(record.code) + record.codeSize > codeCount or
+            uint64_t(record.symbols) + record.symbolCount > symbolsCount)
+            return false;
+
+        const auto* symbols =
+            reinterpret_cast<const StringRef*>(file.data() + header.symbolsOffset) + record.symbols;
+        for (uint32_t slot = 0; slot < record.symbolCount; ++slot)
+            if (not valid(symbols[slot])) return false;
+        if (not valid(record.name) or not valid(record.source) or not valid(record.assignTo))
+            return false;
+
+        formula.name = string(record.name);
+        formula.source = string(record.source);
+        formula.assignTo = string(record.assignTo);
+        formula.program = {
+            reinterpret_cast<const Instruction*>(file.data() + header.codeOffset) + record.code,
+            record.codeSize, record.maxDepth};
+        formula.symbols = symbols;
+        formula.symbolCount = record.symbolCount;
+        formula.strings = file.data() + header.stringsOffset;
+
+        // code is executed as is, so it must be as safe as freshly compiled code
+        return verify(formula.program, formula.symbolCount);
+    }
+
+   private:
+    detail::FormulaRecord recordAt(uint32_t i) const {
+        detail::FormulaRecord record;
+        std::memcpy(&record, file.data() + header.indexOffset + i * sizeof(record), sizeof(record));
+        return record;
+    }
+
+    bool valid(const detail::StringRef& ref) const {
+        return uint64_t(ref.offset) + ref.length <= file.size() - header.stringsOffset;
+    }
+
+    std::string_view string(const detail::StringRef& ref) const {
+        if (not valid(ref)) return {};
+        return {file.data() + header.stringsOffset + ref.offset, ref.length};
+    }
+
+    MappedFile file{};
+    detail::LibraryHeader header{};
+};
+
+/**
+ * @brief Formula to be saved into a library
+ */
+struct LibraryEntry {
+    std::string name;
+    std::string source;
+    Program program;
+};
+
+/**
+ * @brief Writes formulas into a .kbc library, sorted by name, later duplicates win.
+ * The file is written next to path and renamed over it, so a mapped old version stays valid.
+ *
+ * @param path destination file
+ * @param entries formulas to save
+ * @param err occurred error reference
+ * @return size_t number of saved formulas
+ */
+size_t saveLibrary(const std::string& path, std::vector<LibraryEntry> entries, SyntaxError& err) {
+    using namespace detail;
+
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const auto& a, const auto& b) { return a.name < b.name; });
+    // keep the last of equal names
+    std::vector<LibraryEntry> unique;
+    for (auto& entry : entries) {
+        if (not unique.empty() and unique.back().name == entry.name)
+            unique.back() = std::move(entry);
+        else
+            unique.push_back(std::move(entry));
+    }
+
+    std::string strings;
+    const auto addString = [&strings](const std::string& str) {
+        const StringRef ref{(uint32_t)strings.size(), (uint32_t)str.size()};
+        strings += str;
+        return ref;
+    };
+
+    std::vector<FormulaRecord> records;
+    std::vector<Instruction> code;
+    std::vector<StringRef> symbols;
+    for (const auto& entry : unique) {
+        FormulaRecord record{};
+        record.name = addString(entry.name);
+        record.source = addString(entry.source);
+        record.assignTo = addString(entry.program.assignTo);
+        record.code = (uint32_t)code.size();
+        record.codeSize = (uint32_t)entry.program.code.size();
+        record.symbols = (uint32_t)symbols.size();
+        record.symbolCount = (uint32_t)entry.program.symbols.size();
+        record.maxDepth = entry.program.maxDepth;
+        records.push_back(record);
+
+        code.insert(code.end(), entry.program.code.begin(), entry.program.code.end());
+        for (const auto& symbol : entry.program.symbols) symbols.push_back(addString(symbol));
+    }
+
+    const auto aligned = [](uint64_t offset) { return (offset + 7) / 8 * 8; };
+    LibraryHeader header{};
+    std::memcpy(header.magic, libraryMagic, sizeof(libraryMagic));
+    header.version = libraryVersion;
+    header.fingerprint = specFingerprint();
+    header.count = (uint32_t)records.size();
+    header.indexOffset = sizeof(LibraryHeader);
+    header.codeOffset = header.indexOffset + records.size() * sizeof(FormulaRecord);
+    header.symbolsOffset = header.codeOffset + code.size() * sizeof(Instruction);
+    header.stringsOffset = aligned(header.symbolsOffset + symbols.size() * sizeof(StringRef));
+    header.size = header.stringsOffset + strings.size();
+
+    const auto temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        const char padding[8]{};
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(FormulaRecord));
+        out.write(reinterpret_cast<const char*>(code.data()), code.size() * sizeof(Instruction));
+        out.write(reinterpret_cast<const char*>(symbols.data()), symbols.size() * sizeof(StringRef));
+        out.write(padding, header.stringsOffset - header.symbolsOffset - symbols.size() * sizeof(StringRef));
+        out.write(strings.data(), strings.size());
+        if (not out) {
+            err = SyntaxError(my::format("Unable to write {}", temporary), SyntaxError::Type::Io);
+            std::remove(temporary.c_str());
+            return 0;
+        }
+    }
+
+    if (not detail::replaceFile(temporary, path)) {
+        err = SyntaxError(my::format("Unable to replace {}", path), SyntaxError::Type::Io);
+        std::remove(temporary.c_str());
+        return 0;
+    }
+    return unique.size();
+}
+
+/**
+ * @brief Values of formula variables taken from the map, ordered by slot
+ *
+ * @param formula library formula
+ * @param variables map of saved variables
+ * @param err occurred error reference, set if some variable is missing
+ * @return std::vector<double> slot values
+ */
+template <class Variables>
+std::vector<double> bindVariables(const Formula& formula, const Variables& variables,
+                                  SyntaxError& err) {
+    std::vector<double> slots;
+    slots.reserve(formula.symbolCount);
+    for (uint32_t slot = 0; slot < formula.symbolCount; ++slot) {
+        const std::string name(formula.symbol(slot));
+        auto it = variables.find(name);
+        if (it == variables.end()) {
+            err = SyntaxError(SyntaxError::Code::UnknownVariable, name);
+            return {};
+        }
+        slots.push_back(it->second);
+    }
+    return slots;
+}
+
+}  // namespace korowa
+
+#endif  // KOROWA_LIBRARY_HPP
@@ -0,0 +1,336 @@
+#pragma once
+#ifndef KOROWA_LINE_EDITOR_HPP
+#define KOROWA_LINE_EDITOR_HPP
+
+// Line input in raw terminal mode with a live preview of the result.
+// Every key updates an IncrementalExpression, so a keystroke costs the same in a long line
+// as in a short one. The preview is computed once typing pauses for the debounce interval
+// and is drawn in grey after the text, keys arriving meanwhile (e.g. a paste) are all
+// applied before the line is redrawn.
+// Redrawing moves the cursor relative to where it is left, so a line wrapping over several
+// rows, and the terminal scrolling under it, keeps its place.
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <conio.h>
+#include <io.h>
+#include <windows.h>
+#else
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <korowa/Incremental.hpp>
+#include <string>
+#include <thread>
+
+namespace korowa {
+
+class LineEditor {
+   public:
+    /// @brief Text shown after the line, empty shows nothing
+    using Preview = std::function<std::string(const IncrementalExpression&)>;
+
+    explicit LineEditor(Preview preview, std::chrono::milliseconds debounce = std::chrono::milliseconds(50))
+        : preview(std::move(preview)), debounce(debounce) {}
+
+    /// @return whether both input and output are terminals, raw mode needs them
+    static bool available() {
+#ifdef _WIN32
+        return _isatty(_fileno(stdin)) and _isatty(_fileno(stdout));
+#else
+        return isatty(STDIN_FILENO) and isatty(STDOUT_FILENO);
+#endif
+    }
+
+    /**
+     * @brief Reads a line after the prompt, which is already printed.
+     * Ctrl-C drops the line being typed and reads an empty one.
+     *
+     * @param line read line
+     * @return false on end of input (Ctrl-D or Ctrl-Z on an empty line, closed input)
+     */
+    bool readLine(std::string& line) {
+        RawMode raw;
+        text.clear();
+        cursor = 0;
+        expression.update(text);
+        promptColumn = cursorColumn();  // the line starts here, redraw returns to it
+        row = 0;
+
+        for (;;) {
+            auto shown = false;
+            while (not pending(shown ? -1 : debounce.count())) {
+                // typing paused
+                const auto value = preview(expression);
+                redraw(value);
+                shown = true;
+            }
+
+            do {
+                switch (readKey()) {
+                    case Key::Enter:
+                        leave();
+                        line = text;
+                        return true;
+                    case Key::Cancel:
+                        write("^C\r\n");
+                        line.clear();
+                        return true;
+                    case Key::EndOfInput:
+                        if (not text.empty()) break;
+                        write("\r\n");
+                        return false;
+                    case Key::Closed:
+                        leave();
+                        line = text;
+                        return not text.empty();
+                    case Key::Backspace:
+                        if (cursor) text.erase(--cursor, 1);
+                        break;
+                    case Key::Delete:
+                        if (cursor < text.size()) text.erase(cursor, 1);
+                        break;
+                    case Key::Left:
+                        if (cursor) --cursor;
+                        break;
+                    case Key::Right:
+                        if (cursor < text.size()) ++cursor;
+                        break;
+                    case Key::Home:
+                        cursor = 0;
+                        break;
+                    case Key::End:
+                        cursor = text.size();
+                        break;
+                    case Key::Character:
+                        text.insert(cursor++, 1, character);
+                        break;
+                }
+            } while (pending(0));
+
+            expression.update(text);
+            redraw("");
+        }
+    }
+
+    /// @brief Expression of the line being edited
+    const IncrementalExpression& current() const { return expression; }
+
+   private:
+    enum class Key { Character, Enter, Cancel, EndOfInput, Closed, Backspace, Delete, Left, Right, Home, End, None };
+
+    /// @brief Terminal without line buffering, echo and signal keys for its lifetime
+    class RawMode {
+       public:
+#ifdef _WIN32
+        RawMode() {}
+#else
+        RawMode() {
+            tcgetattr(STDIN_FILENO, &saved);
+            auto raw = saved;
+            raw.c_lflag &= ~(ICANON | ECHO | ISIG);
+            raw.c_iflag &= ~ICRNL;
+            raw.c_cc[VMIN] = 1;
+            raw.c_cc[VTIME] = 0;
+            tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+        }
+        ~RawMode() { tcsetattr(STDIN_FILENO, TCSAFLUSH, &saved); }
+
+       private:
+        termios saved{};
+#endif
+    };
+
+    /// @return whether a key arrives within timeout milliseconds, negative waits forever
+    static bool pending(long timeout) {
+#ifdef _WIN32
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+        while (not _kbhit()) {
+            if (timeout >= 0 and std::chrono::steady_clock::now() >= deadline) return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+#else
+        pollfd input{STDIN_FILENO, POLLIN, 0};
+        return poll(&input, 1, int(timeout)) > 0;
+#endif
+    }
+
+    static int readByte() {
+#ifdef _WIN32
+        return _getch();
+#else
+        unsigned char byte;
+        return ::read(STDIN_FILENO, &byte, 1) == 1 ? byte : -1;
+#endif
+    }
+
+    Key readKey() {
+        const auto byte = readByte();
+        switch (byte) {
+            case 3:  // Ctrl-C
+                return Key::Cancel;
+            case -1:
+                return Key::Closed;
+            case 4:   // Ctrl-D
+            case 26:  // Ctrl-Z
+                return Key::EndOfInput;
+            case '\r':
+            case '\n':
+                return Key::Enter;
+            case 8:
+            case 127:
+                return Key::Backspace;
+#ifdef _WIN32
+            case 0:
+            case 224:
+                switch (readByte()) {
+                    case 'K':
+                        return Key::Left;
+                    case 'M':
+                        return Key::Right;
+                    case 'G':
+                        return Key::Home;
+                    case 'O':
+                        return Key::End;
+                    case 'S':
+                        return Key::Delete;
+                }
+                return Key::None;
+#else
+            case 27: {
+                // ESC [ or ESC O, then a letter or digits and ~, a lone escape is ignored
+                if (not pending(0)) return Key::None;
+                readByte();
+                if (not pending(0)) return Key::None;
+                auto code = readByte();
+                auto number = 0;
+                while (code >= '0' and code <= '9' and pending(0)) {
+                    number = number * 10 + code - '0';
+                    code = readByte();
+                }
+                if (code == 'D') return Key::Left;
+                if (code == 'C') return Key::Right;
+                if (code == 'H' or (code == '~' and (number == 1 or number == 7))) return Key::Home;
+                if (code == 'F' or (code == '~' and (number == 4 or number == 8))) return Key::End;
+                if (code == '~' and number == 3) return Key::Delete;
+                return Key::None;
+            }
+#endif
+        }
+        if (byte < ' ') return Key::None;
+        character = char(byte);
+        return Key::Character;
+    }
+
+    static void write(const std::string& data) {
+        std::fwrite(data.data(), 1, data.size(), stdout);
+    }
+
+    /// @return width of the terminal in columns, 80 when it can't be told
+    static size_t columns() {
+#ifdef _WIN32
+        CONSOLE_SCREEN_BUFFER_INFO info;
+        if (GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &info))
+            return size_t(info.srWindow.Right - info.srWindow.Left + 1);
+#else
+        winsize size{};
+        if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 and size.ws_col) return size.ws_col;
+#endif
+        return 80;
+    }
+
+    /// @return column of the cursor from 0, asked from the terminal, 0 when it doesn't answer
+    static size_t cursorColumn() {
+#ifdef _WIN32
+        CONSOLE_SCREEN_BUFFER_INFO info;
+        if (GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &info))
+            return size_t(info.dwCursorPosition.X);
+        return 0;
+#else
+        // the answer is ESC [ row ; column R, keys typed meanwhile are lost
+        write("\x1b[6n");
+        std::fflush(stdout);
+        std::string answer;
+        while (answer.size() < 32 and pending(100)) {
+            const auto byte = readByte();
+            if (byte < 0) break;
+            answer += char(byte);
+            if (byte == 'R') break;
+        }
+        const auto separator = answer.rfind(';');
+        if (answer.rfind("\x1b[", 0) != 0 or answer.back() != 'R' or separator == std::string::npos)
+            return 0;
+        const auto column = std::strtoul(answer.c_str() + separator + 1, nullptr, 10);
+        return column ? column - 1 : 0;
+#endif
+    }
+
+    /// @return columns taken by text, utf-8 continuation bytes take none
+    static size_t displayed(const std::string& text, size_t size = std::string::npos) {
+        size = std::min(size, text.size());
+        return size_t(std::count_if(text.begin(), text.begin() + size,
+                                    [](char ch) { return (static_cast<unsigned char>(ch) & 0xc0) != 0x80; }));
+    }
+
+    /// @return cursor movement by rows up and to column of its row
+    static std::string move(size_t up, size_t column) {
+        std::string result = up ? "\x1b[" + std::to_string(up) + "A\r" : "\r";
+        if (column) result += "\x1b[" + std::to_string(column) + "C";
+        return result;
+    }
+
+    /// @brief Prints the line from its start and value in grey after it, leaves the cursor in place
+    void redraw(const std::string& value) {
+        const auto width = columns();
+        std::string frame = move(row, promptColumn) + "\x1b[J" + text;
+        if (not value.empty()) frame += "\x1b[90m  " + value + "\x1b[0m";
+
+        // a full last row leaves the cursor on it until the next character, \r\n moves on for sure
+        const auto end = promptColumn + displayed(text) + (value.empty() ? 0 : 2 + displayed(value));
+        if (end and end % width == 0) frame += "\r\n";
+
+        const auto target = promptColumn + displayed(text, cursor);
+        if (target != end) frame += move(end / width - target / width, target % width);
+        row = target / width;
+
+        write(frame);
+        std::fflush(stdout);
+    }
+
+    /// @brief Redraws the line without a value and moves below it, also when it wraps
+    void leave() {
+        cursor = text.size();
+        redraw("");
+        // redraw already went to the next row after a line ending in the last column
+        const auto end = promptColumn + displayed(text);
+        if (end == 0 or end % columns() != 0) write("\r\n");
+    }
+
+    Preview preview;
+    std::chrono::milliseconds debounce;
+
+    IncrementalExpression expression{};
+    std::string text{};
+    size_t cursor = 0;
+    char character = 0;
+    size_t promptColumn = 0;  // where the line starts on its first row
+    size_t row = 0;           // of the cursor, counted from the line's first row
+};
+
+}  // namespace korowa
+
+#endif  // KOROWA_LINE_EDITOR_HPP
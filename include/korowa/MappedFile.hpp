@@ -0,0 +1,161 @@
+#pragma once
+#ifndef KOROWA_MAPPED_FILE_HPP
+#define KOROWA_MAPPED_FILE_HPP
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN  // keeps the old winsock.h out, Socket.hpp uses winsock2
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <korowa/SyntaxError.hpp>
+#include <my/printer/Format.hpp>
+#include <string>
+#include <utility>
+
+namespace korowa {
+
+namespace detail {
+
+/// @brief Whether the host is little-endian, the byte order of the binary files and tables
+static bool littleEndian() {
+    const uint16_t probe = 1;
+    uint8_t first;
+    std::memcpy(&first, &probe, 1);
+    return first == 1;
+}
+
+/**
+ * @brief Moves file from over file to, which may be mapped. Mapped files are opened
+ * sharing delete, so on windows one that can't be replaced is renamed out of the way
+ * and deleted once its last mapping is closed.
+ *
+ * @return false if to is left as it was
+ */
+static bool replaceFile(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+    if (MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING)) return true;
+
+    static std::atomic<uint32_t> replaced{0};
+    const auto aside = my::format("{}.{}-{}.old", to, GetCurrentProcessId(), ++replaced);
+    if (not MoveFileExA(to.c_str(), aside.c_str(), 0)) return false;
+    if (not MoveFileExA(from.c_str(), to.c_str(), 0)) {
+        MoveFileExA(aside.c_str(), to.c_str(), 0);
+        return false;
+    }
+    DeleteFileA(aside.c_str());  // pending while it's mapped
+    return true;
+#else
+    return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+}  // namespace detail
+
+/**
+ * @brief Read-only memory mapping of a whole file
+ */
+class MappedFile {
+   public:
+    MappedFile() = default;
+    MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            close();
+            std::swap(bytes, other.bytes);
+            std::swap(length, other.length);
+#ifdef _WIN32
+            std::swap(file, other.file);
+            std::swap(mapping, other.mapping);
+#endif
+        }
+        return *this;
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    static MappedFile open(const std::string& path, SyntaxError& err) {
+        MappedFile result;
+        const auto fail = [&err, &path] {
+            err = SyntaxError(my::format("Unable to map file {}", path), SyntaxError::Type::Io);
+            return MappedFile{};
+        };
+#ifdef _WIN32
+        // sharing delete lets replaceFile rename the file while it's mapped
+        result.file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (result.file == INVALID_HANDLE_VALUE) return fail();
+        LARGE_INTEGER size;
+        if (not GetFileSizeEx(result.file, &size)) return fail();
+        result.length = (size_t)size.QuadPart;
+        if (result.length == 0) return result;
+
+        result.mapping = CreateFileMappingA(result.file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (not result.mapping) return fail();
+        result.bytes = static_cast<const char*>(MapViewOfFile(result.mapping, FILE_MAP_READ, 0, 0, 0));
+        if (not result.bytes) return fail();
+#else
+        const int descriptor = ::open(path.c_str(), O_RDONLY);
+        if (descriptor < 0) return fail();
+        struct stat info;
+        if (fstat(descriptor, &info) != 0) {
+            ::close(descriptor);
+            return fail();
+        }
+        result.length = (size_t)info.st_size;
+        if (result.length == 0) {
+            ::close(descriptor);
+            return result;
+        }
+
+        auto* mapped = mmap(nullptr, result.length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        ::close(descriptor);  // the mapping keeps the file
+        if (mapped == MAP_FAILED) return fail();
+        result.bytes = static_cast<const char*>(mapped);
+#endif
+        return result;
+    }
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+    void close() {
+#ifdef _WIN32
+        if (bytes) UnmapViewOfFile(bytes);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (bytes) munmap(const_cast<char*>(bytes), length);
+#endif
+        bytes = nullptr;
+        length = 0;
+    }
+
+   private:
+    const char* bytes = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+};
+
+}  // namespace korowa
+
+#endif  // KOROWA_MAPPED_FILE_HPP
@@ -0,0 +1,250 @@
+#pragma once
+#ifndef KOROWA_OPTIMIZER_HPP
+#define KOROWA_OPTIMIZER_HPP
+
+// Rewrites of compiled programs into cheaper equivalents for double evaluation.
+// Strict keeps every result bit for bit: constant subexpressions are folded, x^1 is x and
+// division by a power of two multiplies by its exact inverse.
+// Relaxed may round differently: integer powers by squaring, x^0.5 as sqrt, x^(1/3) as cbrt
+// (also real for negative x), division by any constant as multiplication by its inverse and
+// polynomials of one variable in Horner form.
+
+#include <cmath>
+#include <cstdint>
+#include <korowa/Compiler.hpp>
+#include <vector>
+
+namespace korowa {
+
+enum class FloatMode : uint8_t {
+    Strict,   // results identical to the compiled program
+    Relaxed,  // results within a few ulp, edge cases of pow may differ
+};
+
+namespace detail {
+
+static constexpr double maxPowInt = 64;  // larger exponents lose too much to squaring
+static constexpr size_t maxHornerDegree = 32;
+static constexpr size_t maxPolynomialDepth = 64;  // nodes deeper than it aren't inspected
+
+/**
+ * @brief Node of an expression tree rebuilt from RPN, operands are earlier nodes
+ */
+struct TreeNode {
+    Instruction instruction{};
+    uint32_t operands[3]{};
+};
+
+/// @return index of the node equivalent to node, its operands are already simplified
+static uint32_t simplify(std::vector<TreeNode>& tree, TreeNode node, FloatMode mode) {
+    const auto op = node.instruction.op;
+    const auto count = arity(op);
+    const auto relaxed = mode == FloatMode::Relaxed;
+
+    const auto add = [&tree](const TreeNode& added) {
+        tree.push_back(added);
+        return uint32_t(tree.size() - 1);
+    };
+    const auto isNumber = [&tree](uint32_t index) { return tree[index].instruction.op == Number; };
+    const auto value = [&tree](uint32_t index) { return tree[index].instruction.value; };
+    const auto [a, b, c] = node.operands;
+
+    // the runtime would compute the same operation on the same operands
+    if (count and isDeterministic(op) and isNumber(a) and (count < 2 or isNumber(b)) and
+        (count < 3 or isNumber(c))) {
+        const auto folded = count == 1   ? performUnaryFn(op, value(a))
+                            : count == 2 ? performBinaryFn(op, value(a), value(b))
+                                         : performTernaryFn(op, value(a), value(b), value(c));
+        return add({{Number, 0, folded}});
+    }
+
+    if (op == Pow and isNumber(b)) {
+        const auto exponent = value(b);
+        if (exponent == 1) return a;
+        if (relaxed and exponent == 0.5) return add({{Sqrt}, {a}});
+        if (relaxed and exponent == 1.0 / 3) return add({{Cbrt}, {a}});
+        if (relaxed and exponent == std::trunc(exponent) and std::fabs(exponent) <= maxPowInt)
+            node.instruction.op = PowInt;
+    }
+
+    if (op == Div and isNumber(b)) {
+        const auto divisor = value(b), inverse = 1 / divisor;
+        int exponent;
+        // x * 2^-k rounds the same real number as x / 2^k does
+        const auto exact = std::fabs(std::frexp(divisor, &exponent)) == 0.5 and std::isfinite(inverse);
+        if (exact or (relaxed and std::isfinite(divisor) and std::isfinite(inverse) and inverse != 0)) {
+            node.instruction.op = Mul;
+            node.operands[1] = add({{Number, 0, inverse}});
+        }
+    }
+
+    return add(node);
+}
+
+/// @brief Collects node as coefficient * variable^degree
+static bool monomial(const std::vector<TreeNode>& tree, uint32_t index, long& slot, size_t& degree,
+                     double& coefficient, size_t depth) {
+    const auto& node = tree[index];
+    const auto a = node.operands[0], b = node.operands[1];
+    if (depth > maxPolynomialDepth) return false;
+
+    switch (node.instruction.op) {
+        case Number:
+            degree = 0;
+            coefficient = node.instruction.value;
+            return true;
+        case Variable:
+            if (slot >= 0 and slot != (long)node.instruction.slot) return false;
+            slot = node.instruction.slot;
+            degree = 1;
+            coefficient = 1;
+            return true;
+        case Pow:
+        case PowInt: {
+            const auto exponent = tree[b].instruction.value;
+            if (tree[b].instruction.op != Number or exponent != std::trunc(exponent) or
+                exponent < 0 or exponent > maxHornerDegree)
+                return false;
+            if (not monomial(tree, a, slot, degree, coefficient, depth + 1) or degree != 1 or
+                coefficient != 1)
+                return false;
+            degree = (size_t)exponent;
+            return true;
+        }
+        case Mul: {
+            size_t degreeB;
+            double coefficientB;
+            if (not monomial(tree, a, slot, degree, coefficient, depth + 1) or
+                not monomial(tree, b, slot, degreeB, coefficientB, depth + 1))
+                return false;
+            degree += degreeB;
+            coefficient *= coefficientB;
+            return degree <= maxHornerDegree;
+        }
+    }
+    return false;
+}
+
+/// @brief Adds scale * node to coefficients of a polynomial of one variable
+static bool polynomial(const std::vector<TreeNode>& tree, uint32_t index, long& slot,
+                       std::vector<double>& coefficients, double scale, size_t depth) {
+    const auto& node = tree[index];
+    const auto a = node.operands[0], b = node.operands[1];
+    if (depth > maxPolynomialDepth) return false;
+
+    switch (node.instruction.op) {
+        case Add:
+            return polynomial(tree, a, slot, coefficients, scale, depth + 1) and
+                   polynomial(tree, b, slot, coefficients, scale, depth + 1);
+        case Sub:
+            return polynomial(tree, a, slot, coefficients, scale, depth + 1) and
+                   polynomial(tree, b, slot, coefficients, -scale, depth + 1);
+        case Mul:
+            // constant times a polynomial, e.g. 3 * (x^2 + 1)
+            if (tree[a].instruction.op == Number and tree[b].instruction.op != Number)
+                return polynomial(tree, b, slot, coefficients, scale * tree[a].instruction.value,
+                                  depth + 1);
+            if (tree[b].instruction.op == Number and tree[a].instruction.op != Number)
+                return polynomial(tree, a, slot, coefficients, scale * tree[b].instruction.value,
+                                  depth + 1);
+    }
+
+    size_t degree;
+    double coefficient;
+    if (not monomial(tree, index, slot, degree, coefficient, depth)) return false;
+    coefficients[degree] += scale * coefficient;
+    return true;
+}
+
+/// @brief Emits sum node as Horner scheme if it is a polynomial of degree 2 or more
+static bool horner(const std::vector<TreeNode>& tree, uint32_t index, std::vector<Instruction>& code) {
+    long slot = -1;
+    std::vector<double> coefficients(maxHornerDegree + 1, 0);
+    if (not polynomial(tree, index, slot, coefficients, 1, 0) or slot < 0) return false;
+
+    auto degree = maxHornerDegree;
+    while (degree and coefficients[degree] == 0) --degree;
+    if (degree < 2) return false;
+
+    const Instruction variable{Variable, (uint32_t)slot};
+    // (((c_n x + c_n-1) x + ...) x + c_0, a leading 1 needs no multiplication
+    code.push_back(variable);
+    if (coefficients[degree] != 1) {
+        code.push_back({Number, 0, coefficients[degree]});
+        code.push_back({Mul});
+    }
+    for (auto k = degree - 1;; --k) {
+        if (coefficients[k] != 0) {
+            code.push_back({Number, 0, coefficients[k]});
+            code.push_back({Add});
+        }
+        if (k == 0) break;
+        code.push_back(variable);
+        code.push_back({Mul});
+    }
+    return true;
+}
+
+}  // namespace detail
+
+/**
+ * @brief Rewrites program into cheaper operations, see FloatMode for what may change.
+ * Meant for double evaluation, constants are folded in double.
+ *
+ * @param program compiled expression
+ * @param mode which rewrites are allowed
+ * @return Program optimized program with the same symbols and assignment
+ */
+Program optimize(const Program& program, FloatMode mode) {
+    using namespace detail;
+
+    if (program.code.empty()) return program;
+
+    std::vector<TreeNode> tree;
+    tree.reserve(2 * program.code.size());
+    std::vector<uint32_t> stack;
+
+    for (const auto& instruction : program.code) {
+        TreeNode node{instruction};
+        for (auto i = arity(instruction.op); i > 0; --i) {
+            node.operands[i - 1] = stack.back();
+            stack.pop_back();
+        }
+        stack.push_back(simplify(tree, node, mode));
+    }
+
+    Program result;
+    result.symbols = program.symbols;
+    result.assignTo = program.assignTo;
+    result.code.reserve(program.code.size());
+
+    // postorder walk without recursion, long sums are deep trees
+    std::vector<std::pair<uint32_t, bool>> work{{stack.back(), false}};
+    while (not work.empty()) {
+        const auto [index, visited] = work.back();
+        work.pop_back();
+        const auto& node = tree[index];
+        const auto op = node.instruction.op;
+
+        if (visited) {
+            result.code.push_back(node.instruction);
+            continue;
+        }
+        if (mode == FloatMode::Relaxed and (op == Add or op == Sub) and horner(tree, index, result.code))
+            continue;
+
+        work.push_back({index, true});
+        for (auto i = arity(op); i > 0; --i) work.push_back({node.operands[i - 1], false});
+    }
+
+    long depth = 0;
+    for (const auto& instruction : result.code) {
+        depth += 1 - arity(instruction.op);
+        result.maxDepth = std::max<uint32_t>(result.maxDepth, depth);
+    }
+    return result;
+}
+
+}  // namespace korowa
+
+#endif  // KOROWA_OPTIMIZER_HPP
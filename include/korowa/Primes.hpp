@@ -0,0 +1,327 @@
+#pragma once
+#ifndef KOROWA_PRIMES_HPP
+#define KOROWA_PRIMES_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <korowa/ThreadPool.hpp>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <shared_mutex>
+#include <vector>
+
+namespace korowa {
+
+namespace detail {
+
+static uint64_t mulMod(uint64_t a, uint64_t b, uint64_t m) {
+#ifdef __SIZEOF_INT128__
+    return (unsigned __int128)a * b % m;
+#else
+    uint64_t result = 0;
+    for (a %= m; b; b >>= 1) {
+        if (b & 1) result = result >= m - a ? result - (m - a) : result + a;
+        a = a >= m - a ? a - (m - a) : a + a;
+    }
+    return result;
+#endif
+}
+
+static uint64_t powMod(uint64_t base, uint64_t exponent, uint64_t m) {
+    uint64_t result = 1;
+    for (base %= m; exponent; exponent >>= 1) {
+        if (exponent & 1) result = mulMod(result, base, m);
+        base = mulMod(base, base, m);
+    }
+    return result;
+}
+
+/// @brief Strong probable prime test of odd n > 2 to base
+static bool millerRabin(uint64_t n, uint64_t base) {
+    base %= n;
+    if (base == 0) return true;
+
+    uint64_t d = n - 1;
+    int shifts = 0;
+    for (; d % 2 == 0; d /= 2) ++shifts;
+
+    auto x = powMod(base, d, n);
+    if (x == 1 or x == n - 1) return true;
+    for (int i = 1; i < shifts; ++i) {
+        x = mulMod(x, x, n);
+        if (x == n - 1) return true;
+    }
+    return false;
+}
+
+static constexpr size_t presievedPrimes = 6;  // 2, 3, 5, 7, 11, 13
+static constexpr size_t presievePeriod = 3 * 5 * 7 * 11 * 13;
+
+/// @brief Odd multiples of 3..13 repeat every presievePeriod odd numbers, entry i is 2i + 1
+static const std::vector<uint8_t>& presieved() {
+    static const auto pattern = [] {
+        std::vector<uint8_t> result(presievePeriod, 0);
+        for (const uint64_t p : {3, 5, 7, 11, 13})
+            for (auto i = p / 2; i < presievePeriod; i += p) result[i] = 1;
+        return result;
+    }();
+    return pattern;
+}
+
+/**
+ * @brief Sieve of Eratosthenes over odd numbers low, low + 2, ... (count of them)
+ *
+ * @param low odd first number of the segment
+ * @param count number of odd numbers in the segment
+ * @param primes base primes up to at least sqrt of the segment end, starting with 2
+ * @param composite out, composite[i] set if low + 2i is composite
+ */
+static void sieveSegment(uint64_t low, size_t count, const std::vector<uint32_t>& primes,
+                         std::vector<uint8_t>& composite) {
+    const auto high = low + 2 * count;
+    size_t start = 1;  // index of the first prime to cross off
+
+    // copy the repeating pattern of the smallest primes instead of crossing them off
+    if (low > 13 and primes.size() > presievedPrimes) {
+        const auto& pattern = presieved();
+        composite.resize(count);
+        auto offset = (low / 2) % presievePeriod;
+        for (size_t done = 0; done < count;) {
+            const auto length = std::min<size_t>(count - done, presievePeriod - offset);
+            std::copy_n(pattern.begin() + offset, length, composite.begin() + done);
+            done += length;
+            offset = 0;
+        }
+        start = presievedPrimes;
+    } else {
+        composite.assign(count, 0);
+    }
+
+    for (size_t i = start; i < primes.size(); ++i) {
+        const uint64_t p = primes[i];
+        if (p * p >= high) break;
+
+        auto first = std::max(p * p, (low + p - 1) / p * p);
+        if (first % 2 == 0) first += p;
+        for (auto j = (first - low) / 2; j < count; j += p) composite[j] = 1;
+    }
+    if (low == 1) composite[0] = 1;
+}
+
+}  // namespace detail
+
+/**
+ * @brief Deterministic primality test for every 64-bit number.
+ * Trial division by small primes, then Miller-Rabin with a base set
+ * proven to have no 64-bit pseudoprimes.
+ */
+bool isPrime(uint64_t n) {
+    static constexpr uint64_t small[]{2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37};
+    if (n < 2) return false;
+    for (const auto p : small)
+        if (n % p == 0) return n == p;
+    if (n < 37 * 37) return true;
+
+    static constexpr uint64_t bases[]{2, 325, 9375, 28178, 450775, 9780504, 1795265022};
+    return std::all_of(std::begin(bases), std::end(bases),
+                       [n](uint64_t base) { return detail::millerRabin(n, base); });
+}
+
+/**
+ * @brief Primes cached across calls, extended by a segmented sieve on demand.
+ * Counting past the cache sieves in parallel without storing the primes.
+ */
+class PrimeTable {
+   public:
+    static constexpr uint64_t cacheLimit = uint64_t(1) << 26;   // primes below are stored
+    static constexpr size_t segmentOdds = 128 * 1024;           // odd numbers per segment
+
+    static PrimeTable& instance() {
+        static PrimeTable table;
+        return table;
+    }
+
+    /// @return number of primes <= n, n below cacheLimit^2 so the cache holds every base prime
+    uint64_t count(uint64_t n) {
+        if (n < 2) return 0;
+        if (n < cacheLimit) {
+            reserve(n + 1);
+            std::shared_lock lock(mutex);
+            return std::upper_bound(primes.begin(), primes.end(), n) - primes.begin();
+        }
+
+        {
+            std::shared_lock lock(mutex);
+            if (auto it = counts.find(n); it != counts.end()) return it->second;
+        }
+
+        reserve(cacheLimit);
+        uint64_t result;
+        {
+            std::shared_lock lock(mutex);
+            result = primes.size() + countRange(cacheLimit + 1, n + 1);
+        }
+
+        std::unique_lock lock(mutex);
+        counts.emplace(n, result);
+        return result;
+    }
+
+    /// @return k-th prime, 1-based, 0 if k is 0
+    uint64_t nth(uint64_t k) {
+        if (k == 0) return 0;
+
+        // Rosser and Dusart: k (ln k + ln ln k - 1) <= p_k < k (ln k + ln ln k) for k >= 6
+        const double lk = std::log(double(k)), llk = std::log(lk);
+        const auto upper = k < 6 ? 12 : uint64_t(k * (lk + llk)) + 1;
+
+        if (upper < cacheLimit) {
+            reserve(upper + 1);
+            std::shared_lock lock(mutex);
+            if (k <= primes.size()) return primes[k - 1];
+        }
+
+        reserve(cacheLimit);
+        auto low = std::max(cacheLimit + 1, uint64_t(k * (lk + llk - 1))) | 1;
+        auto found = count(low - 1);
+
+        // walk segments from the lower bound counting primes until the k-th
+        std::shared_lock lock(mutex);
+        std::vector<uint8_t> composite;
+        for (;; low += 2 * segmentOdds) {
+            detail::sieveSegment(low, segmentOdds, primes, composite);
+            for (size_t i = 0; i < segmentOdds; ++i)
+                if (not composite[i] and ++found == k) return low + 2 * i;
+        }
+    }
+
+    /// @return smallest prime > n, 0 if it doesn't fit 64 bits
+    uint64_t next(uint64_t n) {
+        if (n < 2) return 2;
+        if (n + 1 < cacheLimit) {
+            reserve(std::min(cacheLimit, 2 * n + 2));  // Bertrand: a prime lies in (n, 2n]
+            std::shared_lock lock(mutex);
+            if (auto it = std::upper_bound(primes.begin(), primes.end(), n); it != primes.end())
+                return *it;
+        }
+        for (auto candidate = (n + 1) | 1; candidate > n; candidate += 2)
+            if (isPrime(candidate)) return candidate;
+        return 0;
+    }
+
+    /// @return prime factors of n with multiplicity, ascending
+    std::vector<uint64_t> factor(uint64_t n) {
+        std::vector<uint64_t> factors;
+        if (n < 2) return factors;
+
+        reserve(1 << 16);
+        {
+            std::shared_lock lock(mutex);
+            for (const uint64_t p : primes) {
+                if (p * p > n or p >= (1 << 16)) break;
+                for (; n % p == 0; n /= p) factors.push_back(p);
+            }
+        }
+
+        if (n > 1) split(n, factors);
+        std::sort(factors.begin(), factors.end());
+        return factors;
+    }
+
+   private:
+    PrimeTable() = default;
+
+    /// @brief Extends the cache to every prime below limit (capped by cacheLimit)
+    void reserve(uint64_t limit) {
+        limit = std::min(limit, cacheLimit);
+        {
+            std::shared_lock lock(mutex);
+            if (limit <= sieved) return;
+        }
+
+        std::unique_lock lock(mutex);
+        if (limit <= sieved) return;
+        if (primes.empty()) {
+            primes = {2, 3, 5, 7};
+            sieved = 11;  // odd, everything below is known
+        }
+
+        // grow geometrically, so repeated small requests don't sieve again and again
+        limit = std::min(cacheLimit, std::max(limit, 2 * sieved));
+        std::vector<uint8_t> composite;
+        while (sieved < limit) {
+            // base primes cover sqrt of the segment as long as it ends below sieved^2
+            const auto count = std::min<uint64_t>(
+                {segmentOdds, (limit - sieved + 1) / 2, (sieved * sieved - sieved) / 2});
+            detail::sieveSegment(sieved, count, primes, composite);
+            for (size_t i = 0; i < count; ++i)
+                if (not composite[i]) primes.push_back(uint32_t(sieved + 2 * i));
+            sieved += 2 * count;
+        }
+    }
+
+    /// @brief Primes in [from, to), from odd and above the cache, counted in parallel
+    uint64_t countRange(uint64_t from, uint64_t to) const {
+        if (to <= from) return 0;
+
+        auto& pool = ThreadPool::shared();
+        const auto segments = (to - from + 2 * segmentOdds - 1) / (2 * segmentOdds);
+        const auto tasks = std::min<uint64_t>(segments, 8 * pool.size());
+        std::vector<uint64_t> found(tasks);
+
+        pool.parallelFor(tasks, [&](size_t task) {
+            std::vector<uint8_t> composite;
+            for (auto segment = task; segment < segments; segment += tasks) {
+                const auto low = from + segment * 2 * segmentOdds;
+                const auto count = std::min<uint64_t>(segmentOdds, (to - low + 1) / 2);
+                detail::sieveSegment(low, count, primes, composite);
+                found[task] += std::count(composite.begin(), composite.end(), 0);
+            }
+        });
+
+        return std::accumulate(found.begin(), found.end(), uint64_t(0));
+    }
+
+    /// @brief Appends prime factors of n without small factors, Pollard-Brent rho
+    static void split(uint64_t n, std::vector<uint64_t>& factors) {
+        if (n == 1) return;
+        if (isPrime(n)) {
+            factors.push_back(n);
+            return;
+        }
+
+        for (uint64_t c = 1;; ++c) {
+            const auto f = [n, c](uint64_t x) {
+                const auto square = detail::mulMod(x, x, n);
+                return square >= n - c ? square - (n - c) : square + c;
+            };
+            uint64_t x = 2, y = 2, d = 1, power = 1, lambda = 1;
+            while (d == 1) {
+                if (power == lambda) {
+                    x = y;
+                    power *= 2;
+                    lambda = 0;
+                }
+                y = f(y);
+                ++lambda;
+                d = std::gcd(x > y ? x - y : y - x, n);
+            }
+            if (d != n) {
+                split(d, factors);
+                split(n / d, factors);
+                return;
+            }
+        }
+    }
+
+    std::vector<uint32_t> primes{};
+    uint64_t sieved = 0;                   // every prime below is in primes
+    std::map<uint64_t, uint64_t> counts{};  // counts past the cache
+    mutable std::shared_mutex mutex;
+};
+
+}  // namespace korowa
+
+#endif  // KOROWA_PRIMES_HPP
@@ -0,0 +1,216 @@
+#pragma once
+#ifndef KOROWA_RANDOM_HPP
+#define KOROWA_RANDOM_HPP
+
+// Random numbers of rnd, rnorm and runif.
+// Every thread draws from its own xoshiro256++ stream, stream i starts i jumps (2^128 steps each)
+// after the seeded state, so streams never overlap and seed(n) makes runs reproducible.
+// A task of ThreadPool::parallelFor draws from a stream of its own instead, seeded from the seed,
+// the call and the task index, so its numbers don't depend on which worker happens to run it.
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <korowa/ThreadPool.hpp>
+#include <random>
+
+namespace korowa {
+
+/**
+ * @brief xoshiro256++ generator, period 2^256 - 1
+ */
+class Xoshiro256 {
+   public:
+    using result_type = uint64_t;
+
+    explicit Xoshiro256(uint64_t seed = 0) {
+        // splitmix64 spreads any seed, 0 included, over the whole state
+        for (auto& word : state) {
+            seed += 0x9e3779b97f4a7c15;
+            auto z = seed;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+            word = z ^ (z >> 31);
+        }
+    }
+
+    static constexpr uint64_t min() { return 0; }
+    static constexpr uint64_t max() { return ~uint64_t(0); }
+
+    uint64_t operator()() {
+        const auto result = rotl(state[0] + state[3], 23) + state[0];
+        const auto t = state[1] << 17;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 45);
+        return result;
+    }
+
+    /// @return uniform number in [0, 1) with 53 random bits
+    double uniform() { return double((*this)() >> 11) * 0x1p-53; }
+
+    /// @brief Advances the generator by 2^128 steps
+    void jump() {
+        static constexpr uint64_t polynomial[]{0x180ec6d33cfd0aba, 0xd5a61266f0c9392c,
+                                               0xa9582618e03fc9aa, 0x39abdc4529b1661c};
+        std::array<uint64_t, 4> jumped{};
+        for (const auto word : polynomial)
+            for (int bit = 0; bit < 64; ++bit) {
+                if (word & uint64_t(1) << bit)
+                    for (size_t i = 0; i < state.size(); ++i) jumped[i] ^= state[i];
+                (*this)();
+            }
+        state = jumped;
+    }
+
+   private:
+    static constexpr uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+    std::array<uint64_t, 4> state{};
+};
+
+namespace random {
+
+namespace detail {
+
+struct Shared {
+    std::atomic<uint64_t> seed{std::random_device{}() ^
+                               (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count()};
+    std::atomic<uint32_t> epoch{0};      // bumped by every seed()
+    std::atomic<uint32_t> streams{0};    // streams handed out to threads
+    std::atomic<uint64_t> firstCall{0};  // parallelFor calls made before the last seed()
+};
+
+inline Shared& shared() {
+    static Shared instance;
+    return instance;
+}
+
+struct Stream {
+    Xoshiro256 generator;
+    uint32_t index;
+    uint32_t epoch = ~uint32_t(0);
+    bool hasSpare = false;  // second normal of the last Box-Muller pair
+    double spare = 0;
+};
+
+/// @brief splitmix64 finalizer, spreads nearby keys apart
+inline uint64_t mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+/// @brief Stream of a parallelFor task, the same for the same call since seed() and index
+inline Stream& taskStream(const ThreadPool::TaskId& task) {
+    thread_local Stream stream{Xoshiro256(), 0};
+    thread_local ThreadPool::TaskId owner{};
+
+    const auto epoch = shared().epoch.load(std::memory_order_acquire);
+    if (stream.epoch != epoch or owner.call != task.call or owner.index != task.index) {
+        const auto call = task.call - shared().firstCall.load(std::memory_order_relaxed);
+        stream.generator = Xoshiro256(shared().seed.load(std::memory_order_relaxed) ^
+                                      mix(call * 0x9e3779b97f4a7c15 + task.index + 1));
+        stream.epoch = epoch;
+        stream.hasSpare = false;
+        owner = task;
+    }
+    return stream;
+}
+
+/// @brief Stream of the calling thread, restarted from the seed after every seed()
+inline Stream& local() {
+    if (const auto* task = ThreadPool::currentTask()) return taskStream(*task);
+
+    thread_local Stream stream{Xoshiro256(), shared().streams.fetch_add(1)};
+
+    if (const auto epoch = shared().epoch.load(std::memory_order_acquire); stream.epoch != epoch) {
+        stream.generator = Xoshiro256(shared().seed.load(std::memory_order_relaxed));
+        for (uint32_t i = 0; i < stream.index; ++i) stream.generator.jump();
+        stream.epoch = epoch;
+        stream.hasSpare = false;
+    }
+    return stream;
+}
+
+/// @brief Pair of independent standard normals from two uniforms, Box-Muller
+inline std::array<double, 2> boxMuller(Xoshiro256& generator) {
+    static constexpr double tau = 6.283185307179586476925;
+    const auto radius = std::sqrt(-2 * std::log(1 - generator.uniform()));  // 1 - u is in (0, 1]
+    const auto angle = tau * generator.uniform();
+    return {radius * std::cos(angle), radius * std::sin(angle)};
+}
+
+}  // namespace detail
+
+/**
+ * @brief Restarts every thread's stream from seed.
+ * The first thread drawing a number owns stream 0, so single threaded runs repeat exactly.
+ */
+inline void seed(uint64_t value) {
+    detail::shared().seed.store(value, std::memory_order_relaxed);
+    detail::shared().firstCall.store(ThreadPool::callCount(), std::memory_order_relaxed);
+    detail::shared().epoch.fetch_add(1, std::memory_order_release);
+}
+
+/// @return uniform number in [0, 1)
+inline double uniform() { return detail::local().generator.uniform(); }
+
+/// @return uniform number in [a, b)
+inline double uniform(double a, double b) { return a + (b - a) * uniform(); }
+
+/// @return standard normal number
+inline double normal() {
+    auto& stream = detail::local();
+    if (stream.hasSpare) {
+        stream.hasSpare = false;
+        return stream.spare;
+    }
+    const auto [first, second] = detail::boxMuller(stream.generator);
+    stream.spare = second;
+    stream.hasSpare = true;
+    return first;
+}
+
+/// @brief Fills out with uniform numbers in [0, 1), the generator stays in registers
+inline void fill(double* out, size_t count) {
+    auto& stream = detail::local();
+    auto generator = stream.generator;
+    for (size_t i = 0; i < count; ++i) out[i] = generator.uniform();
+    stream.generator = generator;
+}
+
+/// @brief Fills out with standard normal numbers, both numbers of every pair are used
+inline void fillNormal(double* out, size_t count) {
+    auto& stream = detail::local();
+    size_t i = 0;
+    if (count and stream.hasSpare) {
+        out[i++] = stream.spare;
+        stream.hasSpare = false;
+    }
+
+    auto generator = stream.generator;
+    for (; i + 1 < count; i += 2) {
+        const auto [first, second] = detail::boxMuller(generator);
+        out[i] = first;
+        out[i + 1] = second;
+    }
+    if (i < count) {
+        const auto [first, second] = detail::boxMuller(generator);
+        out[i] = first;
+        stream.spare = second;
+        stream.hasSpare = true;
+    }
+    stream.generator = generator;
+}
+
+}  // namespace random
+
+}  // namespace korowa
+
+#endif  // KOROWA_RANDOM_HPP
@@ -0,0 +1,268 @@
+#pragma once
+#ifndef KOROWA_SERVER_HPP
+#define KOROWA_SERVER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <korowa/Lexer.hpp>
+#include <korowa/Socket.hpp>
+#include <korowa/SyntaxError.hpp>
+#include <korowa/ThreadPool.hpp>
+#include <korowa/Variables.hpp>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+namespace korowa {
+
+/**
+ * @brief Frame layout of server requests and responses.
+ * Line: payload terminated by '\n' ("\r\n" is accepted too).
+ * Length: 4 byte little-endian payload size followed by payload.
+ */
+enum class Framing : uint8_t {
+    Line,
+    Length,
+};
+
+namespace detail {
+
+static constexpr size_t maxFrameSize = 64 * 1024 * 1024;
+
+/**
+ * @brief Accumulates raw bytes of a stream and splits them into frames.
+ */
+class FrameReader {
+   public:
+    explicit FrameReader(Framing framing) : framing(framing) {}
+
+    void feed(const char* data, size_t size) { buffer.append(data, size); }
+
+    /// @return true if complete frame was extracted into frame
+    bool next(std::string& frame) {
+        if (framing == Framing::Line) {
+            const auto end = buffer.find('\n', begin);
+            if (end == std::string::npos) return incomplete();
+
+            frame.assign(buffer, begin, end - begin);
+            if (not frame.empty() and frame.back() == '\r') frame.pop_back();
+            begin = end + 1;
+            return true;
+        }
+
+        if (buffer.size() - begin < 4) return incomplete();
+        const auto* header = (const unsigned char*)buffer.data() + begin;
+        const size_t size = header[0] | header[1] << 8 | header[2] << 16 | (size_t)header[3] << 24;
+
+        if (size > maxFrameSize) {
+            isBroken = true;
+            return false;
+        }
+        if (buffer.size() - begin - 4 < size) return incomplete();
+
+        frame.assign(buffer, begin + 4, size);
+        begin += 4 + size;
+        return true;
+    }
+
+    /// @brief Stream contains frame exceeding maxFrameSize and can't be recovered
+    bool broken() const { return isBroken; }
+
+   private:
+    bool incomplete() {
+        buffer.erase(0, begin);
+        begin = 0;
+        if (buffer.size() > maxFrameSize) isBroken = true;
+        return false;
+    }
+
+    Framing framing;
+    std::string buffer{};
+    size_t begin = 0;
+    bool isBroken = false;
+};
+
+static void appendFrame(Framing framing, const std::string& payload, std::string& out) {
+    if (framing == Framing::Line) {
+        out += payload;
+        out.push_back('\n');
+        return;
+    }
+    const auto size = (uint32_t)payload.size();
+    for (int shift = 0; shift < 32; shift += 8)
+        out.push_back((char)(size >> shift & 0xff));
+    out += payload;
+}
+
+}  // namespace detail
+
+/**
+ * @brief Long-running evaluation server.
+ * Every frame is a request "<id> <expression>", answered with "<id> ok <result>"
+ * or "<id> err <message>". Requests are evaluated on a worker pool, so responses
+ * of a single connection may arrive out of order and have to be matched by id.
+ * Each connection owns a copy of the session variables it was opened with and has at most
+ * maxInFlight requests queued or evaluating, its socket isn't read while the limit is reached.
+ */
+class Server {
+   public:
+    struct Config {
+        std::string endpoint = "korowa.sock";
+        size_t workers = ThreadPool::defaultSize();
+        Framing framing = Framing::Line;
+        bool enableVariables = true;
+        size_t maxInFlight = 1024;  // requests of one connection, a client can't flood the pool
+    };
+
+    explicit Server(const Config& config, const Variables& session = {})
+        : config(config), session(session), pool(config.workers) {}
+
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    ~Server() {
+        stop();
+        std::unique_lock lock(mutex);
+        readersDone.wait(lock, [this] { return activeReaders == 0; });
+    }
+
+    bool listen(SyntaxError& err) {
+        listener = Socket::listen(config.endpoint, err);
+        return listener.valid();
+    }
+
+    /// @brief Accepts connections until stop() is called
+    void run() {
+        running = true;
+        while (running) {
+            auto client = listener.accept();
+            if (not client.valid()) break;
+
+            auto connection = std::make_shared<Connection>(std::move(client), session);
+
+            std::lock_guard lock(mutex);
+            connections.erase(std::remove_if(connections.begin(), connections.end(),
+                                             [](const auto& el) { return el.expired(); }),
+                              connections.end());
+            connections.push_back(connection);
+            ++activeReaders;
+            std::thread([this, connection] { serve(connection); }).detach();
+        }
+    }
+
+    void stop() {
+        running = false;
+        listener.shutdown();
+
+        std::lock_guard lock(mutex);
+        for (const auto& weak : connections)
+            if (auto connection = weak.lock()) connection->socket.shutdown();
+    }
+
+    const Config& getConfig() const { return config; }
+
+   private:
+    struct Connection {
+        Connection(Socket socket, const Variables& variables)
+            : socket(std::move(socket)), variables(variables) {}
+
+        Socket socket;
+        std::mutex writeMutex{};
+        std::shared_mutex sessionMutex{};
+        Variables variables;
+
+        std::mutex flightMutex{};
+        std::condition_variable landed{};
+        size_t inFlight = 0;
+    };
+
+    void serve(std::shared_ptr<Connection> connection) {
+        detail::FrameReader reader(config.framing);
+        std::vector<char> chunk(64 * 1024);
+        std::string frame;
+
+        for (;;) {
+            const auto received = connection->socket.receive(chunk.data(), chunk.size());
+            if (received <= 0) break;
+
+            reader.feed(chunk.data(), received);
+            while (reader.next(frame)) {
+                {
+                    // responses finish without the reader, so the wait always ends
+                    std::unique_lock lock(connection->flightMutex);
+                    connection->landed.wait(lock, [&] {
+                        return connection->inFlight < std::max<size_t>(config.maxInFlight, 1);
+                    });
+                    ++connection->inFlight;
+                }
+                pool.submit([this, connection, request = std::move(frame)] {
+                    respond(*connection, request);
+
+                    std::lock_guard lock(connection->flightMutex);
+                    --connection->inFlight;
+                    connection->landed.notify_one();
+                });
+            }
+
+            if (reader.broken()) break;
+        }
+
+        std::lock_guard lock(mutex);
+        if (--activeReaders == 0) readersDone.notify_all();
+    }
+
+    void respond(Connection& connection, const std::string& request) const {
+        const auto space = request.find(' ');
+        const auto id = request.substr(0, space);
+        const auto expression = space == std::string::npos ? "" : request.substr(space + 1);
+
+        auto err = SyntaxError();
+        double result{};
+
+        if (not config.enableVariables) {
+            result = eval(expression, err);
+        } else if (expression.find('=') != std::string::npos) {
+            // may assign, so it needs the session exclusively
+            std::unique_lock lock(connection.sessionMutex);
+            result = eval(expression, err, connection.variables);
+        } else {
+            std::shared_lock lock(connection.sessionMutex);
+            result = eval(expression, err, connection.variables);
+        }
+
+        std::string payload = id;
+        if (err) {
+            payload += " err " + err.what();
+        } else {
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "%.17g", result);
+            payload += " ok ";
+            payload += buffer;
+        }
+
+        std::string frame;
+        detail::appendFrame(config.framing, payload, frame);
+
+        std::lock_guard lock(connection.writeMutex);
+        connection.socket.sendAll(frame);
+    }
+
+    Config config;
+    Variables session;
+    Socket listener{};
+    std::atomic<bool> running = false;
+
+    std::mutex mutex{};
+    std::condition_variable readersDone{};
+    std::vector<std::weak_ptr<Connection>> connections{};
+    size_t activeReaders = 0;
+
+    ThreadPool pool;  // last, so pending responses are drained before anything else is destroyed
+};
+
+}  // namespace korowa
+
+#endif  // KOROWA_SERVER_HPP
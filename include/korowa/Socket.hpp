@@ -0,0 +1,230 @@
+#pragma once
+#ifndef KOROWA_SOCKET_HPP
+#define KOROWA_SOCKET_HPP
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+// winsock2 must come first
+#include <afunix.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <korowa/SyntaxError.hpp>
+#include <my/printer/Format.hpp>
+#include <string>
+
+namespace korowa {
+
+/**
+ * @brief Minimal RAII wrapper over a stream socket.
+ * Endpoint is either a port ("8080", "localhost:8080", "127.0.0.1:8080"),
+ * which always binds to the loopback interface, or a path of a unix domain socket.
+ */
+class Socket {
+   public:
+#ifdef _WIN32
+    using Handle = SOCKET;
+    static constexpr Handle invalid = INVALID_SOCKET;
+#else
+    using Handle = int;
+    static constexpr Handle invalid = -1;
+#endif
+
+    Socket() = default;
+    explicit Socket(Handle handle) : handle(handle) {}
+    Socket(Socket&& other) noexcept : handle(other.handle), unixPath(std::move(other.unixPath)) {
+        other.handle = invalid;
+        other.unixPath.clear();
+    }
+    Socket& operator=(Socket&& other) noexcept {
+        if (this != &other) {
+            close();
+            handle = other.handle;
+            unixPath = std::move(other.unixPath);
+            other.handle = invalid;
+            other.unixPath.clear();
+        }
+        return *this;
+    }
+    Socket(const Socket&) = delete;
+    Socket& operator=(const Socket&) = delete;
+    ~Socket() { close(); }
+
+    static Socket listen(const std::string& endpoint, SyntaxError& err) {
+        return open(endpoint, err, true);
+    }
+
+    static Socket connect(const std::string& endpoint, SyntaxError& err) {
+        return open(endpoint, err, false);
+    }
+
+    Socket accept() const {
+        return Socket(::accept(handle, nullptr, nullptr));
+    }
+
+    bool sendAll(const char* data, size_t size) const {
+        while (size) {
+            const auto sent = ::send(handle, data, (int)size, sendFlags);
+            if (sent <= 0) return false;
+            data += sent;
+            size -= sent;
+        }
+        return true;
+    }
+
+    bool sendAll(const std::string& data) const { return sendAll(data.data(), data.size()); }
+
+    /// @return number of bytes received, 0 on orderly shutdown, negative on failure
+    long receive(char* data, size_t size) const {
+        return ::recv(handle, data, (int)size, 0);
+    }
+
+    /// @brief Unblocks pending accept/receive calls without releasing the handle
+    void shutdown() const {
+        if (handle == invalid) return;
+#ifdef _WIN32
+        ::shutdown(handle, SD_BOTH);
+#else
+        ::shutdown(handle, SHUT_RDWR);
+#endif
+    }
+
+    void close() {
+        if (handle == invalid) return;
+#ifdef _WIN32
+        ::closesocket(handle);
+#else
+        ::close(handle);
+#endif
+        handle = invalid;
+        if (not unixPath.empty()) std::remove(unixPath.c_str());
+        unixPath.clear();
+    }
+
+    bool valid() const { return handle != invalid; }
+
+   private:
+#ifdef MSG_NOSIGNAL
+    static constexpr int sendFlags = MSG_NOSIGNAL;
+#else
+    static constexpr int sendFlags = 0;
+#endif
+
+    static bool isPort(const std::string& str) {
+        return not str.empty() and str.size() <= 5 and
+               std::all_of(str.begin(), str.end(), [](char ch) { return std::isdigit(ch); });
+    }
+
+    /// @brief Removes socket file of previous run, any other file at path is left alone
+    static bool removeStale(const std::string& path, SyntaxError& err) {
+#ifdef _WIN32
+        // unix domain sockets are reparse points on windows
+        const auto attributes = ::GetFileAttributesA(path.c_str());
+        if (attributes == INVALID_FILE_ATTRIBUTES) return true;
+        if (attributes & FILE_ATTRIBUTE_REPARSE_POINT) return ::DeleteFileA(path.c_str()), true;
+#else
+        struct stat info {};
+        if (::lstat(path.c_str(), &info) != 0) return true;  // nothing to remove, bind tells the rest
+        if (S_ISSOCK(info.st_mode)) return ::unlink(path.c_str()), true;
+#endif
+        err = SyntaxError(my::format("Not a socket, refusing to replace [{}]", path),
+                          SyntaxError::Type::Io);
+        return false;
+    }
+
+    static Socket open(const std::string& endpoint, SyntaxError& err, bool server) {
+#ifdef _WIN32
+        static const bool started = [] {
+            WSADATA data;
+            return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+        }();
+        if (not started) {
+            err = SyntaxError("Unable to initialize winsock", SyntaxError::Type::Io);
+            return {};
+        }
+#endif
+        auto port = endpoint;
+        for (const auto* host : {"localhost:", "127.0.0.1:"})
+            if (port.rfind(host, 0) == 0) port = port.substr(std::strlen(host));
+
+        if (isPort(port)) {
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_port = htons((uint16_t)std::stoi(port));
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            auto socket = create(AF_INET, endpoint, err);
+            if (not socket.valid()) return socket;
+
+            int yes = 1;
+            ::setsockopt(socket.handle, IPPROTO_TCP, TCP_NODELAY, (const char*)&yes, sizeof(yes));
+            if (server)
+                ::setsockopt(socket.handle, SOL_SOCKET, SO_REUSEADDR, (const char*)&yes, sizeof(yes));
+
+            return finish(std::move(socket), (const sockaddr*)&address, sizeof(address),
+                          endpoint, err, server);
+        }
+
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (endpoint.size() >= sizeof(address.sun_path)) {
+            err = SyntaxError(my::format("Socket path is too long: [{}]", endpoint),
+                              SyntaxError::Type::Io);
+            return {};
+        }
+        std::strcpy(address.sun_path, endpoint.c_str());
+
+        if (server and not removeStale(endpoint, err)) return {};
+        auto socket = create(AF_UNIX, endpoint, err);
+        if (not socket.valid()) return socket;
+
+        socket = finish(std::move(socket), (const sockaddr*)&address, sizeof(address),
+                        endpoint, err, server);
+        if (server and socket.valid()) socket.unixPath = endpoint;
+        return socket;
+    }
+
+    static Socket create(int family, const std::string& endpoint, SyntaxError& err) {
+        Socket socket(::socket(family, SOCK_STREAM, 0));
+        if (not socket.valid())
+            err = SyntaxError(my::format("Unable to create socket for [{}]", endpoint),
+                              SyntaxError::Type::Io);
+        return socket;
+    }
+
+    static Socket finish(Socket socket, const sockaddr* address, int size,
+                         const std::string& endpoint, SyntaxError& err, bool server) {
+        if (server) {
+            if (::bind(socket.handle, address, size) != 0 or ::listen(socket.handle, SOMAXCONN) != 0) {
+                err = SyntaxError(my::format("Unable to listen on [{}]", endpoint),
+                                  SyntaxError::Type::Io);
+                return {};
+            }
+            return socket;
+        }
+        if (::connect(socket.handle, address, size) != 0) {
+            err = SyntaxError(my::format("Unable to connect to [{}]", endpoint),
+                              SyntaxError::Type::Io);
+            return {};
+        }
+        return socket;
+    }
+
+    Handle handle = invalid;
+    std::string unixPath{};
+};
+
+}  // namespace korowa
+
+#endif  // KOROWA_SOCKET_HPP
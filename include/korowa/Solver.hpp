@@ -0,0 +1,520 @@
+#pragma once
+#ifndef KOROWA_SOLVER_HPP
+#define KOROWA_SOLVER_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <korowa/Compiler.hpp>
+#include <korowa/Dual.hpp>
+#include <korowa/Optimizer.hpp>
+#include <korowa/SyntaxError.hpp>
+#include <korowa/ThreadPool.hpp>
+#include <korowa/Variables.hpp>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace korowa {
+
+/**
+ * @brief Compiled expression as a function of one variable.
+ * Not thread safe, every thread works on its own copy.
+ */
+class Objective {
+   public:
+    Objective() = default;
+
+    Objective(Program program, std::vector<double> slots, long slot)
+        : program(std::move(program)), slots(std::move(slots)), slot(slot) {}
+
+    double operator()(double x) {
+        ++evaluations;
+        if (slot >= 0) slots[slot] = x;
+        return execute(program, slots.data(), stack);
+    }
+
+    /// @brief Value and derivative at x
+    Tangent tangent(double x) {
+        ++evaluations;
+        std::vector<Dual<1>> duals(slots.begin(), slots.end());
+        if (slot >= 0) duals[slot] = Dual<1>::variable(x, 0);
+        const auto dual = execute(program, duals.data());
+        return {dual.value, dual.grad[0]};
+    }
+
+    /**
+     * @brief Values at count points, blockSize at a time. A point failing to evaluate
+     * gets NaN and doesn't stop the others.
+     *
+     * @param failed if not null, one word of failed points for every blockSize of them
+     */
+    void operator()(const double* xs, size_t count, double* out, uint64_t* failed = nullptr) {
+        evaluations += count;
+        for (size_t first = 0; first < count; first += blockSize) {
+            const auto load = [&](uint32_t index, size_t lane) {
+                return (long)index == slot ? xs[first + lane] : slots[index];
+            };
+            const auto lanes = std::min(blockSize, count - first);
+            executeBlock(program, lanes, load, out + first, block, accuracy);
+            if (failed) failed[first / blockSize] = failedLanes(out + first, lanes);
+        }
+    }
+
+    /**
+     * @brief Everything f's values depend on as words: the compiled code, the free variable,
+     * values bound to the others and the accuracy. Equal identities mean equal functions.
+     */
+    std::vector<uint64_t> identity() const {
+        std::vector<uint64_t> words;
+        words.reserve(program.code.size() * 3 + slots.size() + 2);
+        for (const auto& instruction : program.code) {
+            uint64_t value;
+            std::memcpy(&value, &instruction.value, sizeof(value));
+            words.push_back(instruction.op);
+            words.push_back(instruction.slot);
+            words.push_back(value);
+        }
+        for (size_t i = 0; i < slots.size(); ++i) {
+            uint64_t value;
+            std::memcpy(&value, &slots[i], sizeof(value));
+            words.push_back((long)i == slot ? 0 : value);
+        }
+        words.push_back(uint64_t(slot));
+        words.push_back(uint64_t(accuracy));
+        return words;
+    }
+
+    /// @return false if f draws random numbers or reads the clock
+    bool deterministic() const {
+        return std::all_of(program.code.begin(), program.code.end(), [](const auto& instruction) {
+            return detail::isDeterministic(instruction.op);
+        });
+    }
+
+    uint64_t evaluations = 0;
+    Accuracy accuracy = Accuracy::Strict;  // of values at many points, single points stay strict
+
+   private:
+    Program program{};
+    std::vector<double> slots{};
+    long slot = -1;
+    std::vector<double> stack{}, block{};
+};
+
+/**
+ * @brief Result of solve, minimize and integrate together with its cost
+ */
+struct Solution {
+    double x = std::numeric_limits<double>::quiet_NaN();      // root or minimum location
+    double value = std::numeric_limits<double>::quiet_NaN();  // f(x) or the integral
+    double error = 0;                                         // estimated absolute error
+    uint64_t evaluations = 0;
+    double milliseconds = 0;
+};
+
+namespace detail {
+
+/// @brief Number of subintervals scanned or integrated independently
+static size_t subintervals() { return 8 * ThreadPool::shared().size(); }
+
+/// @brief Runs solver body measuring its time to solution
+template <class Body>
+static Solution timed(Body&& body) {
+    const auto start = std::chrono::steady_clock::now();
+    auto solution = body();
+    solution.milliseconds = std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() - start)
+                                .count();
+    KOROWA_STATS_ADD(Evaluations, solution.evaluations);
+    return solution;
+}
+
+/// @brief f at count + 1 evenly spaced points of [a, b], evaluated in parallel
+static std::vector<double> scan(const Objective& f, double a, double b, size_t count,
+                                uint64_t& evaluations) {
+    std::vector<double> xs(count + 1), ys(count + 1);
+    for (size_t i = 0; i <= count; ++i) xs[i] = i == count ? b : a + (b - a) * i / count;
+
+    const auto chunks = ThreadPool::shared().size();
+    const auto chunk = (xs.size() + chunks - 1) / chunks;
+    std::vector<uint64_t> counts(chunks);
+
+    ThreadPool::shared().parallelFor(chunks, [&](size_t i) {
+        const auto first = std::min(i * chunk, xs.size());
+        const auto last = std::min(first + chunk, xs.size());
+        auto local = f;
+        local(xs.data() + first, last - first, ys.data() + first);
+        counts[i] = local.evaluations;
+    });
+
+    for (const auto el : counts) evaluations += el;
+    return ys;
+}
+
+/// @brief Brent's method on a bracket with fa and fb of opposite signs
+static double brentRoot(Objective& f, double a, double b, double fa, double fb) {
+    constexpr auto eps = std::numeric_limits<double>::epsilon();
+    double c = a, fc = fa, d = b - a, e = d;
+
+    for (int iteration = 0; iteration < 200; ++iteration) {
+        if ((fb > 0) == (fc > 0)) {
+            c = a, fc = fa;
+            d = e = b - a;
+        }
+        if (std::fabs(fc) < std::fabs(fb)) {
+            a = b, b = c, c = a;
+            fa = fb, fb = fc, fc = fa;
+        }
+
+        const auto tolerance = 2 * eps * std::fabs(b) + std::numeric_limits<double>::min();
+        const auto half = (c - b) / 2;
+        if (std::fabs(half) <= tolerance or fb == 0) return b;
+
+        if (std::fabs(e) >= tolerance and std::fabs(fa) > std::fabs(fb)) {
+            // inverse quadratic interpolation, secant if only two points are distinct
+            double p, q, s = fb / fa;
+            if (a == c) {
+                p = 2 * half * s;
+                q = 1 - s;
+            } else {
+                const auto r = fb / fc;
+                q = fa / fc;
+                p = s * (2 * half * q * (q - r) - (b - a) * (r - 1));
+                q = (q - 1) * (r - 1) * (s - 1);
+            }
+            if (p > 0) q = -q;
+            p = std::fabs(p);
+
+            if (2 * p < std::min(3 * half * q - std::fabs(tolerance * q), std::fabs(e * q))) {
+                e = d;
+                d = p / q;
+            } else {
+                d = e = half;
+            }
+        } else {
+            d = e = half;
+        }
+
+        a = b, fa = fb;
+        b += std::fabs(d) > tolerance ? d : std::copysign(tolerance, half);
+        fb = f(b);
+    }
+    return b;
+}
+
+/// @brief Brent's golden section search with parabolic steps for a minimum inside [a, b]
+static double brentMinimum(Objective& f, double a, double b) {
+    constexpr auto golden = 0.3819660112501051;
+    const auto tolerance = std::sqrt(std::numeric_limits<double>::epsilon());
+
+    double x = a + golden * (b - a), w = x, v = x;
+    double fx = f(x), fw = fx, fv = fx;
+    double d = 0, e = 0;
+
+    for (int iteration = 0; iteration < 200; ++iteration) {
+        const auto middle = (a + b) / 2;
+        const auto tol1 = tolerance * std::fabs(x) + 1e-12, tol2 = 2 * tol1;
+        if (std::fabs(x - middle) <= tol2 - (b - a) / 2) break;
+
+        bool parabolic = false;
+        if (std::fabs(e) > tol1) {
+            auto r = (x - w) * (fx - fv);
+            auto q = (x - v) * (fx - fw);
+            auto p = (x - v) * q - (x - w) * r;
+            q = 2 * (q - r);
+            if (q > 0) p = -p;
+            q = std::fabs(q);
+
+            if (std::fabs(p) < std::fabs(q * e / 2) and p > q * (a - x) and p < q * (b - x)) {
+                e = d;
+                d = p / q;
+                const auto u = x + d;
+                if (u - a < tol2 or b - u < tol2) d = std::copysign(tol1, middle - x);
+                parabolic = true;
+            }
+        }
+        if (not parabolic) {
+            e = (x < middle ? b : a) - x;
+            d = golden * e;
+        }
+
+        const auto u = x + (std::fabs(d) >= tol1 ? d : std::copysign(tol1, d));
+        const auto fu = f(u);
+
+        if (fu <= fx) {
+            (u < x ? b : a) = x;
+            v = w, fv = fw;
+            w = x, fw = fx;
+            x = u, fx = fu;
+        } else {
+            (u < x ? a : b) = u;
+            if (fu <= fw or w == x) {
+                v = w, fv = fw;
+                w = u, fw = fu;
+            } else if (fu <= fv or v == x or v == w) {
+                v = u, fv = fu;
+            }
+        }
+    }
+    return x;
+}
+
+// 15 point Gauss-Kronrod rule, abscissae of [0, 1] half of the symmetric rule
+static constexpr double kronrodNodes[8]{
+    0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+    0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+    0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+    0.207784955007898467600689403773245, 0.000000000000000000000000000000000};
+static constexpr double kronrodWeights[8]{
+    0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+    0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+    0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+    0.204432940075298892414161999234649, 0.209482141084727828012999174891714};
+static constexpr double gaussWeights[4]{  // at odd kronrod nodes
+    0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+    0.381830050505118944950369775488975, 0.417959183673469387755102040816327};
+
+/// @brief Kronrod estimate of the integral over [a, b] and its difference from the Gauss one
+static std::pair<double, double> kronrod(Objective& f, double a, double b) {
+    const auto center = (a + b) / 2, half = (b - a) / 2;
+
+    double xs[15], ys[15];
+    for (size_t i = 0; i < 7; ++i) {
+        xs[i] = center - half * kronrodNodes[i];
+        xs[14 - i] = center + half * kronrodNodes[i];
+    }
+    xs[7] = center;
+    f(xs, 15, ys);
+
+    double kronrodSum = kronrodWeights[7] * ys[7], gaussSum = gaussWeights[3] * ys[7];
+    for (size_t i = 0; i < 7; ++i) {
+        const auto pair = ys[i] + ys[14 - i];
+        kronrodSum += kronrodWeights[i] * pair;
+        if (i % 2) gaussSum += gaussWeights[i / 2] * pair;
+    }
+    return {kronrodSum * half, std::fabs((kronrodSum - gaussSum) * half)};
+}
+
+/// @brief Adaptive Gauss-Kronrod, bisecting the worst interval until the error estimate fits
+static std::pair<double, double> adaptiveKronrod(Objective& f, double a, double b,
+                                                 double absolute, double relative) {
+    struct Interval {
+        double a, b, value, error;
+        bool operator<(const Interval& other) const { return error < other.error; }
+    };
+
+    std::vector<Interval> heap;
+    const auto [value, error] = kronrod(f, a, b);
+    heap.push_back({a, b, value, error});
+    double total = value, totalError = error;
+
+    for (int split = 0; split < 500 and totalError > std::max(absolute, relative * std::fabs(total)); ++split) {
+        std::pop_heap(heap.begin(), heap.end());
+        const auto worst = heap.back();
+        heap.pop_back();
+
+        const auto middle = (worst.a + worst.b) / 2;
+        if (middle <= worst.a or middle >= worst.b) {  // can't split any further
+            heap.push_back(worst);
+            break;
+        }
+
+        const auto [left, leftError] = kronrod(f, worst.a, middle);
+        const auto [right, rightError] = kronrod(f, middle, worst.b);
+        total += left + right - worst.value;
+        totalError += leftError + rightError - worst.error;
+
+        heap.push_back({worst.a, middle, left, leftError});
+        std::push_heap(heap.begin(), heap.end());
+        heap.push_back({middle, worst.b, right, rightError});
+        std::push_heap(heap.begin(), heap.end());
+    }
+
+    // recompute sums to drop the accumulated rounding of incremental updates
+    total = totalError = 0;
+    for (const auto& el : heap) total += el.value, totalError += el.error;
+    return {total, totalError};
+}
+
+}  // namespace detail
+
+/**
+ * @brief Compiles input as a function of variable.
+ * Other variables referenced by input are taken from variables.
+ *
+ * @param input string representing math expression
+ * @param variable name of the free variable
+ * @param err occurred error reference
+ * @param variables values of every other variable the expression references
+ * @param mode rewrites optimize may apply to the compiled function
+ * @return Objective compiled function
+ */
+Objective objective(const std::string& input, const std::string& variable, SyntaxError& err,
+                    Variables variables, FloatMode mode = FloatMode::Strict) {
+    auto program = compile(input, err);
+    if (err) return {};
+    program = optimize(program, mode);
+    if (not program.assignTo.empty()) {
+        err = SyntaxError("Assignment is not allowed here", SyntaxError::Type::Evaluation);
+        return {};
+    }
+
+    variables[variable] = 0;
+    auto slots = bindVariables(program, variables, err);
+    if (err) return {};
+
+    const auto slot = program.slotOf(variable);
+    return Objective(std::move(program), std::move(slots), slot);
+}
+
+/**
+ * @brief Root of f inside [a, b].
+ * Brent's method on the first sign change, found by a parallel scan if f(a) and f(b)
+ * have the same sign. Without any sign change falls back to Newton's method from the
+ * scanned point closest to zero.
+ */
+Solution solve(Objective f, double a, double b, SyntaxError& err) {
+    return detail::timed([&] {
+        Solution solution;
+
+        if (a > b) std::swap(a, b);
+        auto fa = f(a), fb = f(b);
+
+        if ((fa > 0) == (fb > 0) and fa != 0 and fb != 0) {
+            const auto count = detail::subintervals();
+            const auto ys = detail::scan(f, a, b, count, f.evaluations);
+
+            size_t closest = 0;
+            for (size_t i = 0; i <= count; ++i) {
+                if (std::fabs(ys[i]) < std::fabs(ys[closest]) or std::isnan(ys[closest])) closest = i;
+                if (i and (ys[i - 1] > 0) != (ys[i] > 0) and not std::isnan(ys[i - 1]) and
+                    not std::isnan(ys[i])) {
+                    const auto step = (b - a) / count;
+                    b = i == count ? b : a + step * i;
+                    a = a + step * (i - 1);
+                    fa = ys[i - 1], fb = ys[i];
+                    closest = count + 1;
+                    break;
+                }
+            }
+
+            if (closest <= count) {
+                // touching roots converge only linearly, so accept whatever is small enough
+                auto x = a + (b - a) * closest / count, step = 0.0;
+                for (int iteration = 0; iteration < 100; ++iteration) {
+                    const auto [y, slope] = f.tangent(x);
+                    if (y == 0) break;
+                    step = y / slope;
+                    if (not std::isfinite(step)) break;
+                    x -= step;
+                    if (std::fabs(step) <= 4 * std::numeric_limits<double>::epsilon() * std::fabs(x))
+                        break;
+                }
+                solution = {x, f(x), std::fabs(step)};
+                solution.evaluations = f.evaluations;
+                if (not (std::fabs(solution.value) <= 1e-9 * (1 + std::fabs(solution.x))))
+                    err = SyntaxError("No root found in the interval", SyntaxError::Type::Evaluation);
+                return solution;
+            }
+        }
+
+        if (std::isnan(fa) or std::isnan(fb)) {
+            err = SyntaxError("Function is undefined on the interval", SyntaxError::Type::Evaluation);
+            solution.evaluations = f.evaluations;
+            return solution;
+        }
+
+        solution.x = fa == 0 ? a : fb == 0 ? b : detail::brentRoot(f, a, b, fa, fb);
+        solution.value = f(solution.x);
+        solution.error = 4 * std::numeric_limits<double>::epsilon() * std::fabs(solution.x);
+        solution.evaluations = f.evaluations;
+        return solution;
+    });
+}
+
+/**
+ * @brief Minimum of f inside [a, b].
+ * Parallel scan picks the lowest point, Brent's search refines it between its neighbours.
+ */
+Solution minimize(Objective f, double a, double b, SyntaxError& err) {
+    return detail::timed([&] {
+        Solution solution;
+
+        if (a > b) std::swap(a, b);
+        const auto count = detail::subintervals();
+        const auto ys = detail::scan(f, a, b, count, f.evaluations);
+
+        size_t lowest = count + 1;
+        for (size_t i = 0; i <= count; ++i)
+            if (not std::isnan(ys[i]) and (lowest > count or ys[i] < ys[lowest])) lowest = i;
+
+        if (lowest > count) {
+            err = SyntaxError("Function is undefined on the interval", SyntaxError::Type::Evaluation);
+            solution.evaluations = f.evaluations;
+            return solution;
+        }
+
+        const auto step = (b - a) / count;
+        const auto left = lowest ? a + step * (lowest - 1) : a;
+        const auto right = lowest < count ? std::min(b, a + step * (lowest + 1)) : b;
+
+        solution.x = detail::brentMinimum(f, left, right);
+        solution.value = f(solution.x);
+        if (ys[lowest] < solution.value) {  // refinement drifted into a worse local minimum
+            solution.x = lowest == count ? b : a + step * lowest;
+            solution.value = ys[lowest];
+        }
+        solution.error = std::sqrt(std::numeric_limits<double>::epsilon()) * (1 + std::fabs(solution.x));
+        solution.evaluations = f.evaluations;
+        return solution;
+    });
+}
+
+/**
+ * @brief Definite integral of f over [a, b].
+ * The interval is split into independent pieces integrated in parallel by adaptive
+ * 15 point Gauss-Kronrod quadrature.
+ */
+Solution integrate(Objective f, double a, double b, SyntaxError& err) {
+    return detail::timed([&] {
+        Solution solution;
+
+        if (a == b) {
+            solution.value = 0;
+            return solution;
+        }
+
+        const auto count = detail::subintervals();
+        const auto step = (b - a) / count;
+        std::vector<std::pair<double, double>> parts(count);
+        std::vector<uint64_t> counts(count);
+
+        ThreadPool::shared().parallelFor(count, [&](size_t i) {
+            auto local = f;
+            const auto from = a + step * i, to = i + 1 == count ? b : a + step * (i + 1);
+            parts[i] = detail::adaptiveKronrod(local, from, to, 1e-15, 1e-12);
+            counts[i] = local.evaluations;
+        });
+
+        solution.value = solution.error = 0;
+        for (size_t i = 0; i < count; ++i) {
+            solution.value += parts[i].first;
+            solution.error += parts[i].second;
+            solution.evaluations += counts[i];
+        }
+        solution.evaluations += f.evaluations;
+
+        if (not std::isfinite(solution.value) or
+            solution.error > std::max(1e-9, 1e-6 * std::fabs(solution.value)))
+            err = SyntaxError("Integral diverges or function is undefined on the interval",
+                              SyntaxError::Type::Evaluation);
+        return solution;
+    });
+}
+
+}  // namespace korowa
+
+#endif  // KOROWA_SOLVER_HPP
@@ -0,0 +1,199 @@
+#pragma once
+#ifndef KOROWA_STATS_HPP
+#define KOROWA_STATS_HPP
+
+// Opt-in instrumentation of the hot path.
+// Define KOROWA_ENABLE_STATS to collect per-stage timings and counters,
+// additionally define KOROWA_STATS_RDTSC to time stages with the cpu timestamp counter.
+// Without KOROWA_ENABLE_STATS every KOROWA_STATS_* macro expands to nothing.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+
+#ifdef KOROWA_STATS_RDTSC
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+namespace korowa {
+
+namespace stats {
+
+#ifdef KOROWA_ENABLE_STATS
+static constexpr bool enabled = true;
+#else
+static constexpr bool enabled = false;
+#endif
+
+enum Stage : uint8_t {
+    Tokenize,
+    Parse,
+    Evaluate,
+    Format,
+    Log,
+    Persist,
+    Startup,
+    StageCount,
+};
+
+enum Counter : uint8_t {
+    Evaluations,
+    Tokens,
+    StackDepth,  // maximum, not a sum
+    Allocations,
+    CacheHits,
+    CacheMisses,
+    CounterCount,
+};
+
+static constexpr const char* stageNames[StageCount]{
+    "tokenize", "parse", "evaluate", "format", "log", "persist", "startup"};
+
+static constexpr const char* counterNames[CounterCount]{
+    "evaluations", "tokens", "maxStackDepth", "allocations", "cacheHits", "cacheMisses"};
+
+struct Registry {
+    std::atomic<uint64_t> stageTicks[StageCount]{};
+    std::atomic<uint64_t> stageCalls[StageCount]{};
+    std::atomic<uint64_t> counters[CounterCount]{};
+};
+
+inline Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+inline uint64_t ticks() {
+#ifdef KOROWA_STATS_RDTSC
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+}
+
+/// @brief Ticks per nanosecond, calibrated once against steady_clock when rdtsc is used
+inline double ticksPerNanosecond() {
+#ifdef KOROWA_STATS_RDTSC
+    static const double ratio = [] {
+        const auto clockStart = std::chrono::steady_clock::now();
+        const auto tickStart = __rdtsc();
+        while (std::chrono::steady_clock::now() - clockStart < std::chrono::milliseconds(10)) {
+        }
+        const auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               std::chrono::steady_clock::now() - clockStart)
+                               .count();
+        return double(__rdtsc() - tickStart) / nanos;
+    }();
+    return ratio;
+#else
+    return 1.0;
+#endif
+}
+
+inline void add(Counter counter, uint64_t value) {
+    registry().counters[counter].fetch_add(value, std::memory_order_relaxed);
+}
+
+inline void max(Counter counter, uint64_t value) {
+    auto& slot = registry().counters[counter];
+    auto current = slot.load(std::memory_order_relaxed);
+    while (current < value and
+           not slot.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+inline void record(Stage stage, uint64_t start) {
+    registry().stageTicks[stage].fetch_add(ticks() - start, std::memory_order_relaxed);
+    registry().stageCalls[stage].fetch_add(1, std::memory_order_relaxed);
+}
+
+class ScopedTimer {
+   public:
+    explicit ScopedTimer(Stage stage) : stage(stage), start(ticks()) {}
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+    ~ScopedTimer() { record(stage, start); }
+
+   private:
+    Stage stage;
+    uint64_t start;
+};
+
+inline void reset() {
+    for (auto& el : registry().stageTicks) el = 0;
+    for (auto& el : registry().stageCalls) el = 0;
+    for (auto& el : registry().counters) el = 0;
+}
+
+inline double nanoseconds(Stage stage) {
+    return registry().stageTicks[stage] / ticksPerNanosecond();
+}
+
+/// @brief Human readable table, used by the stats command
+inline void print(std::ostream& os = std::cout) {
+    const auto flags = os.flags();
+    os << std::fixed << std::setprecision(1) << std::left
+       << "    " << std::setw(14) << "(stage)" << std::right << std::setw(10) << "(calls)"
+       << std::setw(14) << "(total us)" << std::setw(12) << "(avg ns)" << '\n';
+
+    for (uint8_t i = 0; i < StageCount; ++i) {
+        const auto calls = registry().stageCalls[i].load();
+        const auto nanos = nanoseconds(Stage(i));
+        os << "    " << std::left << std::setw(14) << stageNames[i] << std::right
+           << std::setw(10) << calls << std::setw(14) << nanos / 1000.0
+           << std::setw(12) << (calls ? nanos / calls : 0.0) << '\n';
+    }
+    os << '\n';
+
+    for (uint8_t i = 0; i < CounterCount; ++i)
+        os << "    " << std::left << std::setw(14) << counterNames[i]
+           << registry().counters[i].load() << '\n';
+    os << '\n';
+    os.flags(flags);
+}
+
+inline void dumpJson(std::ostream& os) {
+    os << "{\n    \"stages\": {";
+    for (uint8_t i = 0; i < StageCount; ++i)
+        os << (i ? "," : "") << "\n        \"" << stageNames[i]
+           << "\": {\"calls\": " << registry().stageCalls[i].load()
+           << ", \"totalNs\": " << (uint64_t)nanoseconds(Stage(i)) << '}';
+    os << "\n    },\n    \"counters\": {";
+    for (uint8_t i = 0; i < CounterCount; ++i)
+        os << (i ? "," : "") << "\n        \"" << counterNames[i]
+           << "\": " << registry().counters[i].load();
+    os << "\n    }\n}\n";
+}
+
+}  // namespace stats
+
+}  // namespace korowa
+
+#define KOROWA_STATS_CONCAT_IMPL(a, b) a##b
+#define KOROWA_STATS_CONCAT(a, b) KOROWA_STATS_CONCAT_IMPL(a, b)
+
+#ifdef KOROWA_ENABLE_STATS
+#define KOROWA_STATS_TIMER(stage) \
+    korowa::stats::ScopedTimer KOROWA_STATS_CONCAT(statsTimer, __LINE__)(korowa::stats::stage)
+#define KOROWA_STATS_START(name) const auto name = korowa::stats::ticks()
+#define KOROWA_STATS_STOP(stage, name) korowa::stats::record(korowa::stats::stage, name)
+#define KOROWA_STATS_ADD(counter, value) korowa::stats::add(korowa::stats::counter, value)
+#define KOROWA_STATS_MAX(counter, value) korowa::stats::max(korowa::stats::counter, value)
+#else
+#define KOROWA_STATS_TIMER(stage) (void)0
+#define KOROWA_STATS_START(name) (void)0
+#define KOROWA_STATS_STOP(stage, name) (void)0
+// the value stays unevaluated, but still counts as a use of whatever it names
+#define KOROWA_STATS_ADD(counter, value) (void)sizeof(value)
+#define KOROWA_STATS_MAX(counter, value) (void)sizeof(value)
+#endif
+
+#endif  // KOROWA_STATS_HPP
@@ -0,0 +1,271 @@
+#pragma once
+#ifndef KOROWA_STREAM_HPP
+#define KOROWA_STREAM_HPP
+
+// Compiling expressions too large to hold as text or tokens, e.g. generated ones of gigabytes.
+// The input is fed a chunk at a time, the tokenizer keeps only the token it may still extend
+// and every final token goes straight through the shunting-yard into compiled instructions,
+// so memory is the operator stack, which is as deep as the nesting, and the program.
+// The result and the errors are those of compile on the whole text.
+
+#include <algorithm>
+#include <istream>
+#include <korowa/Compiler.hpp>
+#include <korowa/Lexer.hpp>
+#include <korowa/SyntaxError.hpp>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace korowa {
+
+class StreamCompiler {
+   public:
+    /// @brief Feeds the characters in [begin, end), any chunk boundary gives the same tokens
+    void feed(const char* begin, const char* end) {
+        if (unknown) return;
+        tokenizer.feed(begin, end);
+
+        // every token but the last one is final, the next characters may extend it
+        auto& tokens = tokenizer.tokens;
+        if (tokens.size() < 2) return;
+        for (size_t i = 0; i + 1 < tokens.size() and not unknown; ++i) take(tokens[i]);
+        tokens.front() = std::move(tokens.back());
+        tokens.resize(1);
+    }
+
+    /**
+     * @brief Ends the input, the compiler is spent afterwards
+     *
+     * @param err occurred error reference
+     * @return Program compiled expression, empty on error
+     */
+    Program finish(SyntaxError& err) {
+        using namespace detail;
+
+        for (const auto& token : tokenizer.tokens)
+            if (not unknown) take(token);
+        tokenizer.tokens.clear();
+        KOROWA_STATS_ADD(Tokens, index);
+
+        if (unknown) return fail(err, unknown);
+        while (not parseError and not stack.empty()) {
+            if (stack.back() == LeftPars or stack.back() == LeftArrPars)
+                parseError = SyntaxError(SyntaxError::Code::MismatchedParenthesis,
+                                         SyntaxError::Span{uint32_t(index), uint32_t(index + 1)});
+            else
+                pop();
+        }
+        if (parseError) return fail(err, parseError);
+        if (not emitted) return fail(err, SyntaxError(SyntaxError::Code::EmptyExpression));
+
+        // compile drops a variable in front of an expression ending with = as the assigned one
+        const auto assignment = front.has_value() and lastEquals;
+        const auto offset = front.has_value() and not assignment;
+        const auto failedAt = assignment ? failedAssigned : failedPlain;
+
+        if (failedAt < compileErrorAt) return fail(err, SyntaxError(SyntaxError::Code::EvaluationError));
+        if (compileError) return fail(err, compileError);
+        if (not assignment and equalsAt != npos)
+            return fail(err, SyntaxError(SyntaxError::Code::AssignmentToNothing));
+
+        program.maxDepth = uint32_t(peak + offset);
+        if (program.maxDepth > maxStackDepth) return fail(err, nestedTooDeeply(program.maxDepth));
+        if (depth + offset != 1)
+            return fail(err, SyntaxError(SyntaxError::Code::RedundantValues, {}, double(depth + offset)));
+
+        if (assignment)
+            program.assignTo = std::move(*front);
+        else if (front)
+            placeFront(std::move(*front));
+        return std::move(program);
+    }
+
+    /**
+     * @brief Reserves the program for an input of about characters, a token takes two or more.
+     * Capped, so a huge input doesn't claim memory before it's read, the program grows past it.
+     */
+    void reserve(size_t characters) { program.code.reserve(std::min(characters / 2, maxReserved)); }
+
+    /// @return tokens taken so far
+    size_t tokens() const { return index; }
+
+   private:
+    static constexpr size_t npos = size_t(-1);
+    static constexpr size_t maxReserved = size_t(1) << 20;  // instructions, 16 MB
+
+    /// @brief Passes a final token through the parser, as parse does
+    void take(const detail::Token& token) {
+        using namespace detail;
+
+        // parse rejects an unknown symbol anywhere before its first error
+        if (isUnknownSymbol(token)) {
+            unknown = SyntaxError(SyntaxError::Code::UnknownSymbol, token.value,
+                                  SyntaxError::Span{uint32_t(index), uint32_t(index + 1)});
+            return;
+        }
+        const auto at = index++;
+        if (parseError) return;
+
+        const auto spec = token.spec;
+        const auto mismatched = [&](SyntaxError::Code code) {
+            parseError = SyntaxError(code, SyntaxError::Span{uint32_t(at), uint32_t(at + 1)});
+        };
+
+        if (spec == Number or spec == Variable or isConstant(spec) or isGenerator(spec) or
+            isUnaryOp(spec))
+            emit(spec, &token.value);
+
+        else if (isFunction(spec) or spec == LeftPars or spec == LeftArrPars)
+            stack.push_back(spec);
+
+        else if (isBinaryOp(spec)) {
+            while (not stack.empty() and getPrecedence(stack.back()) >= getPrecedence(spec)) pop();
+            stack.push_back(spec);
+        }
+
+        else if (spec == Comma) {
+            while (not stack.empty() and stack.back() != LeftPars and stack.back() != LeftArrPars) pop();
+            if (stack.empty()) mismatched(SyntaxError::Code::MismatchedSeparator);
+        }
+
+        else if (spec == RightPars or spec == RightArrPars) {
+            const auto open = spec == RightPars ? LeftPars : LeftArrPars;
+            const auto other = spec == RightPars ? LeftArrPars : LeftPars;
+            while (not stack.empty() and stack.back() != open and stack.back() != other) pop();
+            if (stack.empty() or stack.back() == other)
+                return mismatched(SyntaxError::Code::MismatchedParenthesis);
+            stack.pop_back();
+            if (spec == RightArrPars) emit(RightArrPars, nullptr);
+            if (not stack.empty() and isFunction(stack.back())) pop();
+        }
+    }
+
+    /// @brief Moves the top operator to the output
+    void pop() {
+        emit(stack.back(), nullptr);
+        stack.pop_back();
+    }
+
+    /**
+     * @brief Compiles a token of the output queue, as compile does. Whether the first one, if it
+     * is a variable, is the assigned one is known only at the end, so it is held back and the
+     * stack depth tracked both ways: failedAssigned and failedPlain are the instructions the
+     * depth first drops to zero at without and with the held back one.
+     *
+     * @param value text of numbers and variables, null for operators
+     */
+    void emit(detail::Spec spec, const std::string* value) {
+        using namespace detail;
+
+        const auto position = emitted++;
+        lastEquals = spec == Equals;
+        if (position == 0 and spec == Variable) {
+            front = *value;
+            return;
+        }
+        // compile stops at the first = and at its first error, in either reading
+        if (equalsAt != npos or compileError or failedPlain != npos) return;
+
+        Instruction instruction{spec};
+        if (spec == Number) {
+            instruction.value = my::parse<double>(*value);
+        } else if (isConstant(spec)) {
+            instruction = {Number, 0, getConstant(spec)};
+        } else if (spec == Variable) {
+            auto [it, added] = slots.try_emplace(*value, uint32_t(program.symbols.size()));
+            if (added) program.symbols.push_back(*value);
+            instruction.slot = it->second;
+        } else if (spec == Equals) {
+            equalsAt = position;
+            return;
+        } else if (spec == RightArrPars or spec == Factor) {
+            compileErrorAt = position;
+            compileError = SyntaxError("Arrays are not supported in compiled expressions",
+                                       SyntaxError::Type::Evaluation);
+            return;
+        } else if (not isOperator(spec) and not isFunction(spec) and not isGenerator(spec)) {
+            compileErrorAt = position;
+            compileError = SyntaxError(SyntaxError::Code::UnknownSymbol, value ? *value : "");
+            return;
+        }
+
+        depth += 1 - arity(instruction.op);
+        if (depth <= 0 and failedAssigned == npos) failedAssigned = position;
+        if (depth + long(front.has_value()) <= 0 and failedPlain == npos) failedPlain = position;
+        peak = std::max(peak, depth);
+        program.code.push_back(instruction);
+    }
+
+    /// @brief Puts the held back variable before the code as slot 0, like compile numbers slots
+    void placeFront(std::string name) {
+        using namespace detail;
+
+        const auto it = slots.find(name);
+        const auto moved = it == slots.end() ? uint32_t(program.symbols.size()) : it->second;
+        for (auto& instruction : program.code)
+            if (instruction.op == Variable)
+                instruction.slot = instruction.slot == moved ? 0
+                                   : instruction.slot < moved ? instruction.slot + 1
+                                                              : instruction.slot;
+        if (it != slots.end()) program.symbols.erase(program.symbols.begin() + moved);
+        program.symbols.insert(program.symbols.begin(), std::move(name));
+        program.code.insert(program.code.begin(), Instruction{Variable, 0, 0});
+    }
+
+    Program fail(SyntaxError& err, SyntaxError error) {
+        err = std::move(error);
+        return {};
+    }
+
+    detail::Tokenizer tokenizer{};
+    std::vector<detail::Spec> stack{};  // operators and open parentheses
+    size_t index = 0;                   // of the next token
+    SyntaxError unknown = SyntaxError(), parseError = SyntaxError();
+
+    Program program{};
+    std::unordered_map<std::string, uint32_t> slots{};
+    std::optional<std::string> front{};  // variable emitted first
+    size_t emitted = 0;
+    bool lastEquals = false;
+    long depth = 0, peak = 0;            // without the front variable
+    size_t equalsAt = npos, failedAssigned = npos, failedPlain = npos, compileErrorAt = npos;
+    SyntaxError compileError = SyntaxError();
+};
+
+/**
+ * @brief Compiles the expression read from input to its end, chunk by chunk
+ *
+ * @param input stream of the expression text, a trailing line break is ignored like blanks
+ * @param err occurred error reference
+ * @param chunk characters read at a time
+ * @return Program compiled expression, empty on error
+ */
+Program compile(std::istream& input, SyntaxError& err, size_t chunk = size_t(1) << 16) {
+    StreamCompiler compiler;
+    if (const auto start = input.tellg(); start != std::istream::pos_type(-1)) {
+        // a file tells its size, a pipe doesn't and the program grows as it's read
+        input.seekg(0, std::ios::end);
+        compiler.reserve(size_t(input.tellg() - start));
+        input.seekg(start);
+    }
+    std::vector<char> buffer(chunk);
+    while (input) {
+        input.read(buffer.data(), std::streamsize(buffer.size()));
+        const auto* end = buffer.data() + input.gcount();
+        // line breaks end the expression for getline, here they are blanks
+        for (auto* ch = buffer.data(); ch != end; ++ch)
+            if (*ch == '\n' or *ch == '\r') *ch = ' ';
+        compiler.feed(buffer.data(), end);
+    }
+    if (input.bad()) {
+        err = SyntaxError("Unable to read the expression", SyntaxError::Type::Io);
+        return {};
+    }
+    return compiler.finish(err);
+}
+
+}  // namespace korowa
+
+#endif  // KOROWA_STREAM_HPP
@@ -0,0 +1,242 @@
+#pragma once
+#ifndef KOROWA_SUGGEST_HPP
+#define KOROWA_SUGGEST_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace korowa {
+
+namespace detail {
+
+/**
+ * @brief Levenshtein distance of a and b, computed exactly up to bound.
+ * Anything farther than bound is reported as bound + 1.
+ */
+static size_t editDistance(const std::string& a, const std::string& b, size_t bound) {
+    const auto& shorter = a.size() < b.size() ? a : b;
+    const auto& longer = a.size() < b.size() ? b : a;
+    if (longer.size() - shorter.size() > bound) return bound + 1;
+
+    thread_local std::vector<size_t> prev, curr;
+    prev.resize(shorter.size() + 1);
+    curr.resize(shorter.size() + 1);
+    for (size_t i = 0; i <= shorter.size(); ++i) prev[i] = i;
+
+    for (size_t row = 1; row <= longer.size(); ++row) {
+        curr[0] = row;
+        size_t rowMin = row;
+        for (size_t col = 1; col <= shorter.size(); ++col) {
+            const size_t cost = longer[row - 1] != shorter[col - 1];
+            curr[col] = std::min({prev[col] + 1, curr[col - 1] + 1, prev[col - 1] + cost});
+            rowMin = std::min(rowMin, curr[col]);
+        }
+        if (rowMin > bound) return bound + 1;
+        std::swap(prev, curr);
+    }
+    return std::min(prev[shorter.size()], bound + 1);
+}
+
+/// @brief Distinct trigrams of word padded with two \0 on both sides
+static void trigrams(const std::string& word, std::vector<uint32_t>& out) {
+    out.clear();
+    uint32_t gram = 0;
+    for (size_t i = 0; i < word.size() + 2; ++i) {
+        const uint8_t ch = i < word.size() ? word[i] : 0;
+        gram = (gram << 8 | ch) & 0xffffff;
+        out.push_back(gram);
+    }
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+}  // namespace detail
+
+/**
+ * @brief Names one edit away from query which exist, found by probing every deletion,
+ * substitution and insertion of a letter or digit. For name sets too large to index:
+ * costs about 125 lookups per character of the query and nothing ahead of it.
+ *
+ * @param exists whether a name exists, e.g. a binary search of a sorted file
+ * @return names ordered alphabetically
+ */
+template <class Exists>
+std::vector<std::string> oneEditAway(const std::string& query, Exists exists) {
+    static const std::string alphabet = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+
+    std::vector<std::string> found;
+    std::string probe;
+    const auto check = [&] {
+        if (not probe.empty() and probe != query and exists(probe)) found.push_back(probe);
+    };
+
+    for (size_t i = 0; i <= query.size(); ++i) {
+        if (i < query.size()) {
+            probe = query;
+            probe.erase(i, 1);
+            check();
+        }
+        for (const auto ch : alphabet) {
+            if (i < query.size() and ch != query[i]) {
+                probe = query;
+                probe[i] = ch;
+                check();
+            }
+            probe = query;
+            probe.insert(i, 1, ch);
+            check();
+        }
+    }
+    std::sort(found.begin(), found.end());
+    found.erase(std::unique(found.begin(), found.end()), found.end());
+    return found;
+}
+
+/**
+ * @brief Trigram index over known names answering top-k nearest by edit distance.
+ * A single edit changes at most three trigrams, so names sharing too few trigrams
+ * with the query are rejected by counting alone; survivors are verified with
+ * bounded Levenshtein. Erased names are skipped until dead ones outnumber
+ * the living and the index is compacted.
+ */
+class SuggestionIndex {
+   public:
+    void insert(const std::string& word) {
+        if (word.empty() or lookup.count(word)) return;
+
+        const auto id = (uint32_t)entries.size();
+        detail::trigrams(word, grams);
+        entries.push_back({word, (uint32_t)grams.size(), true});
+        lookup.emplace(word, id);
+
+        for (const auto gram : grams) postings[gram].push_back(id);
+        if (byLength.size() <= word.size()) byLength.resize(word.size() + 1);
+        byLength[word.size()].push_back(id);
+    }
+
+    void erase(const std::string& word) {
+        auto it = lookup.find(word);
+        if (it == lookup.end()) return;
+
+        entries[it->second].alive = false;
+        lookup.erase(it);
+
+        if (entries.size() > 64 and lookup.size() < entries.size() / 2) rebuild();
+    }
+
+    bool contains(const std::string& word) const { return lookup.count(word); }
+
+    /**
+     * @brief Closest living names to query
+     *
+     * @param query misspelled name
+     * @param count maximum number of suggestions
+     * @param maxDistance maximum edit distance of a suggestion,
+     * additionally capped by a third of the query length
+     * @return suggestions ordered by distance, then alphabetically
+     */
+    std::vector<std::string> suggest(const std::string& query, size_t count = 3,
+                                     size_t maxDistance = 3) const {
+        if (entries.empty() or count == 0 or query.empty()) return {};
+
+        const size_t edits = std::min(maxDistance, std::max<size_t>(1, query.size() / 3));
+        std::vector<std::pair<size_t, uint32_t>> best;  // max-heap by (distance, word)
+
+        const auto worse = [this](const auto& a, const auto& b) {
+            return a.first != b.first ? a.first < b.first
+                                      : entries[a.second].word < entries[b.second].word;
+        };
+
+        const auto consider = [&](uint32_t id) {
+            const auto& entry = entries[id];
+            if (not entry.alive) return;
+
+            const auto radius = best.size() == count ? std::min(edits, best.front().first) : edits;
+            const auto distance = detail::editDistance(query, entry.word, radius);
+            if (distance > radius) return;
+
+            const std::pair candidate{distance, id};
+            if (best.size() < count) {
+                best.push_back(candidate);
+                std::push_heap(best.begin(), best.end(), worse);
+            } else if (worse(candidate, best.front())) {
+                std::pop_heap(best.begin(), best.end(), worse);
+                best.back() = candidate;
+                std::push_heap(best.begin(), best.end(), worse);
+            }
+        };
+
+        thread_local std::vector<uint32_t> queryGrams;
+        detail::trigrams(query, queryGrams);
+        const auto minLength = query.size() > edits ? query.size() - edits : 0;
+        const auto maxLength = std::min(query.size() + edits, byLength.size() - 1);
+
+        if (queryGrams.size() <= 3 * edits) {
+            // too short for the count filter, every name of close length is a candidate
+            for (auto length = minLength; length <= maxLength; ++length)
+                for (const auto id : byLength[length]) consider(id);
+        } else {
+            thread_local std::vector<uint16_t> hits;
+            thread_local std::vector<uint32_t> touched;
+            hits.resize(entries.size());
+            touched.clear();
+
+            for (const auto gram : queryGrams) {
+                auto it = postings.find(gram);
+                if (it == postings.end()) continue;
+                for (const auto id : it->second)
+                    if (hits[id]++ == 0) touched.push_back(id);
+            }
+
+            const auto required = queryGrams.size() - 3 * edits;
+            for (const auto id : touched) {
+                const auto& entry = entries[id];
+                const auto shared = hits[id];
+                hits[id] = 0;
+                if (shared >= required and shared + 3 * edits >= entry.grams and
+                    entry.word.size() >= minLength and entry.word.size() <= maxLength)
+                    consider(id);
+            }
+        }
+
+        std::sort_heap(best.begin(), best.end(), worse);
+
+        std::vector<std::string> result;
+        result.reserve(best.size());
+        for (const auto& el : best) result.push_back(entries[el.second].word);
+        return result;
+    }
+
+    size_t size() const { return lookup.size(); }
+
+   private:
+    struct Entry {
+        std::string word;
+        uint32_t grams;  // number of distinct trigrams
+        bool alive;
+    };
+
+    void rebuild() {
+        auto old = std::move(entries);
+        entries.clear();
+        lookup.clear();
+        postings.clear();
+        byLength.clear();
+        for (auto& entry : old)
+            if (entry.alive) insert(entry.word);
+    }
+
+    std::vector<Entry> entries{};
+    std::unordered_map<std::string, uint32_t> lookup{};
+    std::unordered_map<uint32_t, std::vector<uint32_t>> postings{};  // trigram -> ids
+    std::vector<std::vector<uint32_t>> byLength{};                   // length -> ids
+    std::vector<uint32_t> grams{};                                   // insert scratch
+};
+
+}  // namespace korowa
+
+#endif  // KOROWA_SUGGEST_HPP
@@ -2,12 +2,18 @@
 #ifndef KOROWA_SYNTAX_ERROR_HPP
 #define KOROWA_SYNTAX_ERROR_HPP
 
+#include <cstdint>
 #include <iostream>
 #include <string>
 #include <vector>
 
 namespace korowa {
 
+/**
+ * @brief Error as a code, the tokens it is about and a number, the message is rendered
+ * only when asked for. Coded errors allocate nothing unless their symbol is longer than
+ * the short string buffer, free text errors are for rare and I/O failures.
+ */
 class SyntaxError {
    public:
     enum class Type : uint8_t {
@@ -16,36 +22,169 @@ class SyntaxError {
         Converting,
         UnknownToken,
         Parsing,
+        Io,
     };
 
-    explicit SyntaxError() : status(true), mType(Type::Undefined) {}
+    enum class Code : uint8_t {
+        None,
+        Message,                // free text
+        EmptyExpression,
+        EvaluationError,
+        UnknownSymbol,          // symbol, at span if it isn't empty
+        UnexpectedSymbol,       // symbol
+        UnknownVariable,        // symbol
+        UnknownVariableNoSession,  // symbol, evaluated without variables
+        UnknownFormula,         // symbol
+        MismatchedParenthesis,  // at span
+        MismatchedSeparator,    // at span
+        AssignmentToNothing,
+        ArrayAssignment,
+        ArrayResult,            // payload elements
+        NestedArray,
+        RedundantValues,        // payload values left, 0 if unknown
+    };
+
+    /// @brief Tokens [begin, end) the error is about, none when empty
+    struct Span {
+        uint32_t begin, end;
+    };
+
+    explicit SyntaxError() = default;
     explicit SyntaxError(const std::string& message)
-        : message(message), status(false), mType(Type::Undefined) {}
+        : mCode(Code::Message), mType(Type::Undefined), text(message) {}
     explicit SyntaxError(const std::string& message, Type type)
-        : message(message), status(false), mType(type) {}
-    explicit SyntaxError(const std::string& message, Type type,
-                         const std::vector<std::string>& params)
-        : message(message), status(false), mType(type), mParams(params) {}
+        : mCode(Code::Message), mType(type), text(message) {}
+    explicit SyntaxError(Code code, Span span = {}, double payload = 0)
+        : mCode(code), mType(typeOf(code)), mSpan(span), mPayload(payload) {}
+    explicit SyntaxError(Code code, const std::string& symbol, Span span = {})
+        : mCode(code), mType(typeOf(code)), mSpan(span), text(symbol) {}
 
     friend std::ostream& operator<<(std::ostream& os, const SyntaxError& err) {
-        os << (err.message.empty() ? "Ok" : err.message);
+        os << (err ? err.what() : "Ok");
         return os;
     }
 
-    operator bool() const { return !status; }
+    operator bool() const { return mCode != Code::None; }
     auto log(std::ostream& os = std::cout) const { os << *this; }
-    auto what() const { return message; }
-    auto reset() { status = true; }
+    auto reset() { *this = SyntaxError(); }
     const auto type() const { return mType; }
-    auto params() const { return mParams; }
+    auto code() const { return mCode; }
+    auto span() const { return mSpan; }
+    auto payload() const { return mPayload; }
+    /// @brief Name the error is about, empty for free text errors
+    const std::string& symbol() const {
+        static const std::string none;
+        return mCode == Code::Message ? none : text;
+    }
+
+    /// @brief Message of the error, rendered on every call
+    std::string what() const {
+        const auto bracketed = "[" + text + "]";
+        const auto at = " (:" + std::to_string(mSpan.begin) + ")";
+        switch (mCode) {
+            case Code::None:
+                return "";
+            case Code::Message:
+                return text;
+            case Code::EmptyExpression:
+                return "Empty expression";
+            case Code::EvaluationError:
+                return "Evaluation error";
+            case Code::UnknownSymbol:
+                return "Unknown symbol: " + bracketed + (mSpan.end > mSpan.begin ? at : "");
+            case Code::UnexpectedSymbol:
+                return "Unexpected symbol: " + bracketed;
+            case Code::UnknownVariable:
+                return "Unknown variable: " + bracketed;
+            case Code::UnknownVariableNoSession:
+                return "Unknown variable (variables may be disabled): " + bracketed;
+            case Code::UnknownFormula:
+                return "Unknown formula: " + bracketed;
+            case Code::MismatchedParenthesis:
+                return "Mismatched parenthesis" + at;
+            case Code::MismatchedSeparator:
+                return "Mismatched parenthesis or function argument separators (,)" + at;
+            case Code::AssignmentToNothing:
+                return "Inapropriate use of = operator: trying to assign to \"\"";
+            case Code::ArrayAssignment:
+                return "Arrays can't be assigned to variables";
+            case Code::ArrayResult:
+                return "Result is an array of " + std::to_string(uint64_t(mPayload)) + " elements";
+            case Code::NestedArray:
+                return "Arrays can't be nested, an element has to be a number";
+            case Code::RedundantValues:
+                return mPayload ? "Redundant values: " + std::to_string(uint64_t(mPayload)) + " left on the stack"
+                                : "Redundant values";
+        }
+        return "Unknown error";
+    }
+
+   private:
+    static constexpr Type typeOf(Code code) {
+        switch (code) {
+            case Code::None:
+            case Code::Message:
+                return Type::Undefined;
+            case Code::UnknownSymbol:
+            case Code::UnexpectedSymbol:
+            case Code::UnknownVariable:
+            case Code::UnknownVariableNoSession:
+            case Code::UnknownFormula:
+                return Type::UnknownToken;
+            case Code::MismatchedParenthesis:
+            case Code::MismatchedSeparator:
+                return Type::Parsing;
+        }
+        return Type::Evaluation;
+    }
+
+    Code mCode = Code::None;
+    SyntaxError::Type mType = Type::Undefined;
+    Span mSpan{};
+    double mPayload = 0;
+    std::string text{};  // symbol of coded errors, message of free text ones
+};
+
+/**
+ * @brief Failed rows of a batch, one bit per row. A failing row doesn't stop the batch,
+ * its result is NaN and every other row is evaluated as usual.
+ */
+class ErrorBitmap {
+   public:
+    void resize(size_t rows) {
+        words.assign((rows + 63) / 64, 0);
+        size = rows;
+    }
+
+    /// @brief Bits of rows [64 word, 64 word + 64), e.g. of one block of executeBlock
+    uint64_t* word(size_t word) { return words.data() + word; }
+
+    bool test(size_t row) const { return words[row / 64] >> (row % 64) & 1; }
+
+    /// @return number of failed rows
+    size_t count() const {
+        size_t failed = 0;
+        for (auto word : words)
+            for (; word; word &= word - 1) ++failed;
+        return failed;
+    }
+
+    /// @return first failed row, rows() if none failed
+    size_t first() const {
+        for (size_t i = 0; i < words.size(); ++i)
+            if (words[i])
+                for (size_t bit = 0;; ++bit)
+                    if (words[i] >> bit & 1) return i * 64 + bit;
+        return size;
+    }
+
+    size_t rows() const { return size; }
 
    private:
-    std::string message{};
-    bool status = true;
-    SyntaxError::Type mType;
-    std::vector<std::string> mParams{};
+    std::vector<uint64_t> words{};
+    size_t size = 0;
 };
 
 }  // namespace korowa
 
-#endif  // KOROWA_SYNTAX_ERROR_HPP
\ No newline at end of file
+#endif  // KOROWA_SYNTAX_ERROR_HPP
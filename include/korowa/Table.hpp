@@ -0,0 +1,164 @@
+#pragma once
+#ifndef KOROWA_TABLE_HPP
+#define KOROWA_TABLE_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <korowa/MappedFile.hpp>
+#include <korowa/Solver.hpp>
+#include <korowa/SyntaxError.hpp>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace korowa {
+
+/**
+ * @brief Evenly spaced points from, from + step, ... count of them
+ */
+struct Grid {
+    double from = 0;
+    double step = 1;
+    uint64_t count = 0;
+
+    double at(uint64_t i) const { return from + step * i; }
+
+    /**
+     * @brief Grid over [from, to], to included when it lands on the grid
+     *
+     * @param err set if step doesn't move from towards to
+     */
+    static Grid between(double from, double to, double step, SyntaxError& err) {
+        const auto span = (to - from) / step;
+        if (not std::isfinite(span) or span < 0 or span > 1e15) {
+            err = SyntaxError("Invalid table range or step", SyntaxError::Type::Evaluation);
+            return {};
+        }
+        // tolerate rounding of the division so 0..1 step 0.1 ends with 1
+        return {from, step, (uint64_t)std::floor(span * (1 + 1e-12)) + 1};
+    }
+};
+
+enum class TableFormat : uint8_t {
+    Csv,     // "x,f(x)" lines
+    Binary,  // raw little-endian doubles f(x), x is implied by the grid
+};
+
+struct TableReport {
+    uint64_t rows = 0;
+    uint64_t bytes = 0;
+    double milliseconds = 0;
+    uint64_t failedRows = 0;  // rows whose value is NaN, written as nan
+    uint64_t firstFailed = 0;  // index of the first of them
+};
+
+namespace detail {
+
+static constexpr size_t tableChunk = 64 * blockSize;  // points evaluated by one task
+
+/// @brief Appends chunk of the table to out in the requested format
+static void formatRows(TableFormat format, const double* xs, const double* ys, size_t count,
+                       std::string& out) {
+    out.clear();
+    if (format == TableFormat::Binary) {
+        out.resize(count * sizeof(double));
+        std::memcpy(out.data(), ys, out.size());
+        if (not littleEndian())
+            for (size_t i = 0; i < out.size(); i += sizeof(double))
+                std::reverse(out.begin() + i, out.begin() + i + sizeof(double));
+        return;
+    }
+
+    char line[64];
+    out.reserve(count * 32);
+    for (size_t i = 0; i < count; ++i) {
+        const auto length = std::snprintf(line, sizeof(line), "%.17g,%.17g\n", xs[i], ys[i]);
+        out.append(line, length);
+    }
+}
+
+}  // namespace detail
+
+/**
+ * @brief Evaluates f over every point of grid and streams results to out.
+ * Chunks of the grid are evaluated and formatted in parallel, one round per pool size,
+ * and written in order, so memory use doesn't depend on the grid size.
+ *
+ * @param f compiled expression of the grid variable, Objective or Approximated
+ * @param grid points to evaluate at
+ * @param out destination stream, binary mode for TableFormat::Binary
+ * @param format layout of the rows
+ * @param err occurred error reference, set if writing fails
+ * @return TableReport written rows and bytes, time spent
+ */
+template <class Function>
+TableReport tabulate(const Function& f, const Grid& grid, std::ostream& out,
+                     TableFormat format, SyntaxError& err) {
+    const auto start = std::chrono::steady_clock::now();
+    TableReport report;
+
+    auto& pool = ThreadPool::shared();
+    struct Lane {
+        Function f;
+        std::vector<double> xs, ys;
+        std::string text;
+        ErrorBitmap failed;
+    };
+    std::vector<Lane> lanes(pool.size(), {f, std::vector<double>(detail::tableChunk),
+                                          std::vector<double>(detail::tableChunk), {}, {}});
+
+    if (format == TableFormat::Csv) {
+        static const std::string header = "x,f(x)\n";
+        out << header;
+        report.bytes += header.size();
+    }
+
+    for (uint64_t first = 0; first < grid.count;) {
+        const auto round = std::min<uint64_t>(lanes.size(),
+                                              (grid.count - first + detail::tableChunk - 1) /
+                                                  detail::tableChunk);
+
+        pool.parallelFor(round, [&](size_t i) {
+            auto& lane = lanes[i];
+            const auto begin = first + i * detail::tableChunk;
+            const auto count = std::min<uint64_t>(detail::tableChunk, grid.count - begin);
+
+            for (size_t j = 0; j < count; ++j) lane.xs[j] = grid.at(begin + j);
+            lane.failed.resize(count);
+            lane.f(lane.xs.data(), count, lane.ys.data(), lane.failed.word(0));
+            detail::formatRows(format, lane.xs.data(), lane.ys.data(), count, lane.text);
+        });
+
+        for (size_t i = 0; i < round; ++i) {
+            out.write(lanes[i].text.data(), lanes[i].text.size());
+            report.bytes += lanes[i].text.size();
+            if (const auto failed = lanes[i].failed.count()) {
+                if (not report.failedRows)
+                    report.firstFailed = first + i * detail::tableChunk + lanes[i].failed.first();
+                report.failedRows += failed;
+            }
+        }
+        if (not out) {
+            err = SyntaxError("Unable to write table", SyntaxError::Type::Io);
+            break;
+        }
+
+        first = std::min(grid.count, first + round * detail::tableChunk);
+        report.rows = first;
+    }
+
+    out.flush();
+    for (const auto& lane : lanes) KOROWA_STATS_ADD(Evaluations, lane.f.evaluations);
+    report.milliseconds = std::chrono::duration<double, std::milli>(
+                              std::chrono::steady_clock::now() - start)
+                              .count();
+    return report;
+}
+
+}  // namespace korowa
+
+#endif  // KOROWA_TABLE_HPP
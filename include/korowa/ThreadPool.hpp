@@ -0,0 +1,162 @@
+#pragma once
+#ifndef KOROWA_THREAD_POOL_HPP
+#define KOROWA_THREAD_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace korowa {
+
+/**
+ * @brief Fixed-size pool of worker threads executing submitted tasks in FIFO order.
+ * Destructor drains the queue and joins all workers.
+ */
+class ThreadPool {
+   public:
+    /// @brief Task of a parallelFor: which call in the process, which index within the call
+    struct TaskId {
+        uint64_t call = 0;
+        size_t index = 0;
+    };
+
+    explicit ThreadPool(size_t threads = defaultSize()) {
+        workers.reserve(threads);
+        for (size_t i = 0; i < std::max<size_t>(threads, 1); ++i)
+            workers.emplace_back([this] { loop(); });
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for (auto& worker : workers) worker.join();
+    }
+
+    template <class Task>
+    void submit(Task&& task) {
+        {
+            std::lock_guard lock(mutex);
+            tasks.emplace(std::forward<Task>(task));
+        }
+        wakeUp.notify_one();
+    }
+
+    /**
+     * @brief Runs task(i) for every i in [0, count) on the pool and waits for all of them.
+     * Called from a worker of the same pool runs inline, waiting there could deadlock.
+     * While task(i) runs, currentTask() tells it apart from every other task by its TaskId.
+     */
+    template <class Task>
+    void parallelFor(size_t count, Task&& task) {
+        const auto call = calls().fetch_add(1, std::memory_order_relaxed);
+        if (current() == this) {
+            for (size_t i = 0; i < count; ++i) {
+                const TaskScope scope({call, i});
+                task(i);
+            }
+            return;
+        }
+
+        std::mutex doneMutex;
+        std::condition_variable done;
+        size_t left = count;
+
+        for (size_t i = 0; i < count; ++i)
+            submit([&, i] {
+                {
+                    const TaskScope scope({call, i});
+                    task(i);
+                }
+                std::lock_guard lock(doneMutex);
+                if (--left == 0) done.notify_one();
+            });
+
+        std::unique_lock lock(doneMutex);
+        done.wait(lock, [&] { return left == 0; });
+    }
+
+    size_t size() const { return workers.size(); }
+
+    static size_t defaultSize() {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    /// @brief Process wide pool for data parallel work (solvers, tables, sieving)
+    static ThreadPool& shared() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    /// @return task of a parallelFor the calling thread runs, nullptr outside of one
+    static const TaskId* currentTask() { return runningTask(); }
+
+    /// @return number of parallelFor calls so far, of every pool
+    static uint64_t callCount() { return calls().load(std::memory_order_relaxed); }
+
+   private:
+    /// @brief Marks the calling thread as running id, restores the outer task at scope end
+    class TaskScope {
+       public:
+        explicit TaskScope(TaskId id) : id(id), outer(runningTask()) { runningTask() = &this->id; }
+        TaskScope(const TaskScope&) = delete;
+        TaskScope& operator=(const TaskScope&) = delete;
+        ~TaskScope() { runningTask() = outer; }
+
+       private:
+        TaskId id;
+        const TaskId* outer;
+    };
+
+    static std::atomic<uint64_t>& calls() {
+        static std::atomic<uint64_t> counter{0};
+        return counter;
+    }
+
+    static const TaskId*& runningTask() {
+        thread_local const TaskId* task = nullptr;
+        return task;
+    }
+
+    /// @brief Pool the calling thread works for, nullptr outside of any pool
+    static const ThreadPool*& current() {
+        thread_local const ThreadPool* pool = nullptr;
+        return pool;
+    }
+
+    void loop() {
+        current() = this;
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(mutex);
+                wakeUp.wait(lock, [this] { return stopping or not tasks.empty(); });
+                if (tasks.empty()) return;  // stopping and drained
+                task = std::move(tasks.front());
+                tasks.pop();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    bool stopping = false;
+};
+
+}  // namespace korowa
+
+#endif  // KOROWA_THREAD_POOL_HPP
@@ -0,0 +1,684 @@
+#pragma once
+#ifndef KOROWA_VARIABLES_HPP
+#define KOROWA_VARIABLES_HPP
+
+// Variables of a session, up to millions of them.
+// Names assigned or removed in this process live in a flat open-addressing table whose keys
+// are interned into one character arena. The saved ones stay in the session file, which is
+// mapped and binary searched in place: opening a session reads its header and journal only,
+// a lookup touches a few pages of the file and a listing just the pages it lists.
+// Names in the table shadow the file's, removed ones are kept in it as erased.
+//
+// Copies share both the file and the table, the table is copied on the first change of a
+// shared one, so a snapshot is a copy and costs nothing until either side assigns a name.
+// While a snapshot() is alive the changes are logged, so restoring it touches just them.
+//
+// Saving appends the changed names to the journal next to the session file, which is merged
+// into a new session file once it grows long, so a save costs about as much as the changes.
+//
+// session file layout (little-endian, every section 8 byte aligned):
+//   SessionHeader
+//   VariableRecord[count]   sorted by name
+//   char[]                  names
+// journal (path.log): a line per change, "= name value" or "- name"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <initializer_list>
+#include <korowa/MappedFile.hpp>
+#include <korowa/SyntaxError.hpp>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace korowa {
+
+namespace detail {
+
+static constexpr char sessionMagic[4]{'K', 'V', 'S', '\0'};
+static constexpr uint32_t sessionVersion = 1;
+
+struct SessionHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t count;  // variables
+    uint64_t indexOffset;
+    uint64_t stringsOffset;
+    uint64_t size;  // of the whole file, detects truncation
+    uint64_t reserved;
+};
+
+struct VariableRecord {
+    uint32_t offset = 0;  // of the name, into the strings section
+    uint32_t length = 0;
+    double value = 0;
+};
+
+static_assert(sizeof(SessionHeader) == 48 and sizeof(VariableRecord) == 16);
+
+}  // namespace detail
+
+/**
+ * @brief Saved variables mapped from a session file, sorted by name
+ */
+class SessionFile {
+   public:
+    static constexpr size_t npos = size_t(-1);
+
+    /**
+     * @brief Maps session file, only the header is read
+     *
+     * @param path file written by Variables::save
+     * @param err occurred error reference, set if file is missing, truncated or incompatible
+     * @return nullptr on error
+     */
+    static std::shared_ptr<const SessionFile> open(const std::string& path, SyntaxError& err) {
+        using namespace detail;
+
+        auto session = std::make_shared<SessionFile>();
+        session->file = MappedFile::open(path, err);
+        if (err) return nullptr;
+
+        const auto fail = [&err, &path](const char* reason) {
+            err = SyntaxError(my::format("Invalid session file {}: {}", path, reason),
+                              SyntaxError::Type::Io);
+            return nullptr;
+        };
+
+        const auto size = session->file.size();
+        if (size < sizeof(SessionHeader)) return fail("too short");
+
+        SessionHeader header;
+        std::memcpy(&header, session->file.data(), sizeof(header));
+        if (std::memcmp(header.magic, sessionMagic, sizeof(sessionMagic)) != 0)
+            return fail("not a session file");
+        if (header.version != sessionVersion or not littleEndian())
+            return fail("written by an incompatible version");
+        if (header.size != size) return fail("truncated");
+        if (header.indexOffset != sizeof(SessionHeader) or header.stringsOffset % 8 != 0 or
+            header.stringsOffset > size or
+            header.stringsOffset - header.indexOffset != header.count * sizeof(VariableRecord))
+            return fail("corrupted sections");
+
+        session->header = header;
+        return session;
+    }
+
+    size_t size() const { return header.count; }
+
+    /// @return name of variable i, empty if its record is corrupted
+    std::string_view name(size_t i) const {
+        const auto record = recordAt(i);
+        if (uint64_t(record.offset) + record.length > file.size() - header.stringsOffset) return {};
+        return {file.data() + header.stringsOffset + record.offset, record.length};
+    }
+
+    double value(size_t i) const { return recordAt(i).value; }
+
+    /// @return first variable not ordered before name, binary search touching a few pages
+    size_t lowerBound(std::string_view name) const {
+        size_t low = 0, high = size();
+        while (low < high) {
+            const auto middle = low + (high - low) / 2;
+            if (this->name(middle) < name)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        return low;
+    }
+
+    /// @return index of the variable, npos if there's none
+    size_t find(std::string_view name) const {
+        const auto i = lowerBound(name);
+        return i < size() and this->name(i) == name ? i : npos;
+    }
+
+   private:
+    detail::VariableRecord recordAt(size_t i) const {
+        detail::VariableRecord record;
+        std::memcpy(&record, file.data() + header.indexOffset + i * sizeof(record), sizeof(record));
+        return record;
+    }
+
+    MappedFile file{};
+    detail::SessionHeader header{};
+};
+
+/**
+ * @brief Variables by name, a map of the names in memory over the ones of a session file.
+ * Copies share the file and the table until one of them changes. Iterators, references
+ * and views of names are invalidated by inserting, erasing and saving.
+ */
+class Variables {
+   public:
+    using value_type = std::pair<std::string_view, double>;
+
+    /// @brief Forward iterator, the variables of the file first, then the assigned ones
+    class const_iterator {
+       public:
+        struct Arrow {
+            value_type item;
+            const value_type* operator->() const { return &item; }
+        };
+
+        value_type operator*() const { return owner->at(position); }
+        Arrow operator->() const { return {**this}; }
+
+        const_iterator& operator++() {
+            position = owner->visible(position + 1);
+            return *this;
+        }
+
+        bool operator==(const const_iterator& other) const { return position == other.position; }
+        bool operator!=(const const_iterator& other) const { return position != other.position; }
+
+       private:
+        friend class Variables;
+        const_iterator(const Variables* owner, size_t position) : owner(owner), position(position) {}
+
+        const Variables* owner = nullptr;
+        size_t position = 0;  // below the file size a variable of the file, then one of the table
+    };
+    using iterator = const_iterator;
+
+    Variables() = default;
+    Variables(std::initializer_list<value_type> values) {
+        for (const auto& [name, value] : values) (*this)[name] = value;
+    }
+
+    /**
+     * @brief Variables saved at path, only the session file header and the journal are read
+     *
+     * @param path session file, it and its journal may not exist yet
+     * @param err occurred error reference, set if the session file is invalid
+     * @return Variables empty on error
+     */
+    static Variables open(const std::string& path, SyntaxError& err) {
+        Variables variables;
+        if (std::ifstream(path).good()) {
+            variables.file = SessionFile::open(path, err);
+            if (err) return {};
+        }
+
+        std::ifstream journal(path + ".log");
+        for (std::string line; std::getline(journal, line);) {
+            // an interrupted save may leave a partial last line
+            const auto change = std::string_view(line).substr(std::min<size_t>(2, line.size()));
+            const auto space = change.rfind(' ');
+            if (line.rfind("- ", 0) == 0)
+                variables.erase(change);
+            else if (line.rfind("= ", 0) == 0 and space != std::string_view::npos)
+                variables[change.substr(0, space)] = std::strtod(line.c_str() + 2 + space + 1, nullptr);
+            else
+                continue;
+            ++variables.journaled;
+        }
+        variables.markSaved();
+        return variables;
+    }
+
+    /**
+     * @brief Saves the changes since the last save, appends them to the journal or,
+     * once it grew long, rewrites the session file
+     *
+     * @param path session file
+     * @param err occurred error reference
+     * @return false on error
+     */
+    bool save(const std::string& path, SyntaxError& err) {
+        if (cleared or journaled + table->unsaved.size() > journalLimit) return compact(path, err);
+        if (table->unsaved.empty()) return true;
+
+        std::ofstream journal(path + ".log", std::ios::app);
+        char value[32];
+        for (const auto index : table->unsaved) {
+            const auto& entry = table->entries[index];
+            if (entry.flags & Erased) {
+                journal << "- " << key(entry) << '\n';
+                continue;
+            }
+            std::snprintf(value, sizeof(value), "%.17g", entry.value);
+            journal << "= " << key(entry) << ' ' << value << '\n';
+        }
+        journal.flush();
+        if (not journal) {
+            err = SyntaxError(my::format("Unable to write {}.log", path), SyntaxError::Type::Io);
+            return false;
+        }
+        journaled += table->unsaved.size();
+        markSaved();
+        return true;
+    }
+
+    /**
+     * @brief Writes every variable into a new session file, sorted by name, and drops the journal.
+     * The file is written next to path and renamed over it, so copies mapping the old one stay valid.
+     *
+     * @param path session file
+     * @param err occurred error reference
+     * @return false on error
+     */
+    bool compact(const std::string& path, SyntaxError& err) {
+        using namespace detail;
+
+        std::vector<VariableRecord> records;
+        std::string strings;
+        records.reserve(size());
+        bool fits = true;
+        forEachSorted({}, [&](std::string_view name, double value) {
+            fits &= strings.size() + name.size() <= UINT32_MAX;
+            records.push_back({uint32_t(strings.size()), uint32_t(name.size()), value});
+            strings += name;
+            return true;
+        });
+        if (not fits) {
+            err = SyntaxError(my::format("Unable to write {}: names too long", path), SyntaxError::Type::Io);
+            return false;
+        }
+
+        SessionHeader header{};
+        std::memcpy(header.magic, sessionMagic, sizeof(sessionMagic));
+        header.version = sessionVersion;
+        header.count = records.size();
+        header.indexOffset = sizeof(SessionHeader);
+        header.stringsOffset = header.indexOffset + records.size() * sizeof(VariableRecord);
+        header.size = header.stringsOffset + strings.size();
+
+        const auto temporary = path + ".tmp";
+        {
+            std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(VariableRecord));
+            out.write(strings.data(), strings.size());
+            if (not out) {
+                err = SyntaxError(my::format("Unable to write {}", temporary), SyntaxError::Type::Io);
+                std::remove(temporary.c_str());
+                return false;
+            }
+        }
+
+        if (not detail::replaceFile(temporary, path)) {
+            err = SyntaxError(my::format("Unable to replace {}", path), SyntaxError::Type::Io);
+            std::remove(temporary.c_str());
+            return false;
+        }
+        std::remove((path + ".log").c_str());
+
+        file = SessionFile::open(path, err);
+        if (err) return false;
+        table = emptyTable();
+        journaled = 0;
+        cleared = false;
+        return true;
+    }
+
+    size_t size() const { return fileSize() - table->shadowed + table->live; }
+    bool empty() const { return size() == 0; }
+
+    const_iterator begin() const { return {this, visible(0)}; }
+    const_iterator end() const { return {this, fileSize() + table->entries.size()}; }
+
+    const_iterator find(std::string_view name) const {
+        if (const auto* entry = lookup(name, hashOf(name)))
+            return entry->flags & Erased ? end() : const_iterator(this, fileSize() + (entry - table->entries.data()));
+        const auto saved = file ? file->find(name) : SessionFile::npos;
+        return saved == SessionFile::npos ? end() : const_iterator(this, saved);
+    }
+
+    size_t count(std::string_view name) const { return find(name) != end(); }
+
+    /// @brief Value of the variable, inserted as 0 if there's none
+    double& operator[](std::string_view name) {
+        auto& table = edit();
+        const auto hash = hashOf(name);
+        auto* entry = lookup(name, hash);
+        if (not entry) {
+            const auto saved = file ? file->find(name) : SessionFile::npos;
+            entry = &insert(name, hash, saved == SessionFile::npos ? 0.0 : file->value(saved));
+            if (saved != SessionFile::npos) {
+                entry->flags |= Saved;
+                ++table.shadowed;
+            }
+            ++table.live;
+        } else if (entry->flags & Erased) {
+            entry->flags &= ~Erased;
+            entry->value = 0;
+            ++table.live;
+        }
+        changed(*entry);
+        return entry->value;
+    }
+
+    /// @return false if there's no such variable
+    bool erase(std::string_view name) {
+        if (find(name) == end()) return false;
+        auto& table = edit();
+        const auto hash = hashOf(name);
+        auto* entry = lookup(name, hash);
+        if (not entry) {
+            entry = &insert(name, hash, 0.0);
+            entry->flags |= Saved | Erased;
+            ++table.shadowed;
+        } else {
+            entry->flags |= Erased;
+            --table.live;
+        }
+        changed(*entry);
+        return true;
+    }
+
+    /// @brief Removes every variable, the next save rewrites the session file
+    void clear() {
+        file.reset();
+        table = emptyTable();
+        journaled = 0;
+        cleared = true;
+    }
+
+    /**
+     * @brief Copy to restore later. Changes made while it is alive are logged, other copies
+     * log nothing, so a connection or a scratch copy never grows a log.
+     */
+    Variables snapshot() {
+        auto& table = edit();
+        table.snapshots.push_back(this->table);
+        return *this;
+    }
+
+    /**
+     * @brief Becomes a copy of snapshot, an earlier copy of these variables. Names either of
+     * them assigned or removed since the copy was taken are marked changed, so if both still
+     * map the same session file the next save journals just them, otherwise it rewrites
+     * the session file. A copy not taken by snapshot() has no log, every name is touched.
+     */
+    void restore(const Variables& snapshot) {
+        const auto previous = table;  // keeps the names of the table alive
+        const auto rewrite = cleared or snapshot.cleared or file != snapshot.file;
+        const auto lines = journaled;
+
+        file = snapshot.file;
+        table = snapshot.table;
+        journaled = lines;
+        cleared = rewrite;
+        if (rewrite or previous == table) return;
+
+        const auto logged = std::any_of(previous->snapshots.begin(), previous->snapshots.end(),
+                                        [this](const auto& weak) { return weak.lock() == table; });
+        if (not logged) {
+            for (const auto* changed : {previous.get(), snapshot.table.get()})
+                for (const auto& entry : changed->entries)
+                    touch({changed->names.data() + entry.offset, entry.length});
+            return;
+        }
+
+        // the change logs are shared up to the copy, every change after it has a stamp of its own
+        const auto& mine = previous->log;
+        const auto& theirs = snapshot.table->log;
+        size_t low = 0, high = std::min(mine.size(), theirs.size());
+        while (low < high) {
+            const auto middle = low + (high - low) / 2;
+            if (mine[middle].stamp == theirs[middle].stamp)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+
+        const auto touchChanges = [this, low](const Table& changed) {
+            for (auto i = low; i < changed.log.size(); ++i) {
+                const auto& entry = changed.entries[changed.log[i].entry];
+                touch({changed.names.data() + entry.offset, entry.length});
+            }
+        };
+        touchChanges(*previous);
+        touchChanges(*snapshot.table);
+    }
+
+    /// @brief Makes room for count assigned variables, avoids rehashing while they are inserted
+    void reserve(size_t count) {
+        auto& table = edit();
+        table.entries.reserve(count);
+        if (count * 2 > table.slots.size()) rehash(ceilPowerOfTwo(count * 2));
+    }
+
+    /**
+     * @brief Page of the variables whose names start with prefix, sorted by name.
+     * Costs the page and the skipped variables, plus the assigned ones with the prefix.
+     *
+     * @param from variables skipped
+     * @param count variables listed at most
+     */
+    std::vector<std::pair<std::string, double>> list(std::string_view prefix, size_t from, size_t count) const {
+        std::vector<std::pair<std::string, double>> page;
+        forEachSorted(prefix, [&](std::string_view name, double value) {
+            if (from) {
+                --from;
+                return true;
+            }
+            if (page.size() == count) return false;
+            page.emplace_back(name, value);
+            return true;
+        });
+        return page;
+    }
+
+   private:
+    static constexpr size_t journalLimit = size_t(1) << 16;  // changes before the file is rewritten
+
+    enum Flags : uint8_t {
+        Erased = 1,
+        Saved = 2,  // the name is in the file too
+        Dirty = 4,  // changed since the last save
+    };
+
+    struct Entry {
+        uint32_t offset = 0;  // of the name in names
+        uint32_t length = 0;
+        uint32_t hash = 0;
+        uint8_t flags = 0;
+        double value = 0;
+    };
+
+    struct Change {
+        uint64_t stamp;  // unique in the process, tells copies' changes apart
+        uint32_t entry;
+    };
+
+    struct Table {
+        std::string names{};            // every one interned once
+        std::vector<Entry> entries{};   // in insertion order
+        std::vector<uint32_t> slots{};  // entry index + 1, 0 where empty, linear probing
+        std::vector<uint32_t> unsaved{};
+        std::vector<Change> log{};      // changes while a snapshot is alive, oldest first
+        std::vector<std::weak_ptr<const Table>> snapshots{};  // tables of snapshots taken before
+        size_t live = 0;      // entries not erased
+        size_t shadowed = 0;  // entries whose names the file has too
+    };
+
+    /// @brief Shared by every variables without assigned names, copied by the first assignment
+    static const std::shared_ptr<Table>& emptyTable() {
+        static const auto empty = std::make_shared<Table>();
+        return empty;
+    }
+
+    /// @brief Table to change, copied first if other variables share it
+    Table& edit() {
+        if (table.use_count() > 1) table = std::make_shared<Table>(*table);
+        return *table;
+    }
+
+    static uint32_t hashOf(std::string_view name) {
+        uint64_t hash = 0xcbf29ce484222325;  // FNV-1a
+        for (const auto ch : name) {
+            hash ^= uint8_t(ch);
+            hash *= 0x100000001b3;
+        }
+        return uint32_t(hash ^ hash >> 32);
+    }
+
+    static size_t ceilPowerOfTwo(size_t value) {
+        size_t power = 16;
+        while (power < value) power *= 2;
+        return power;
+    }
+
+    size_t fileSize() const { return file ? file->size() : 0; }
+
+    std::string_view key(const Entry& entry) const { return {table->names.data() + entry.offset, entry.length}; }
+
+    const Entry* lookup(std::string_view name, uint32_t hash) const {
+        const auto& slots = table->slots;
+        if (slots.empty()) return nullptr;
+        const auto mask = slots.size() - 1;
+        for (auto i = size_t(hash) & mask;; i = (i + 1) & mask) {
+            if (not slots[i]) return nullptr;
+            const auto& entry = table->entries[slots[i] - 1];
+            if (entry.hash == hash and key(entry) == name) return &entry;
+        }
+    }
+
+    /// @brief Entry of the table to change, edit it first
+    Entry* lookup(std::string_view name, uint32_t hash) {
+        return const_cast<Entry*>(static_cast<const Variables*>(this)->lookup(name, hash));
+    }
+
+    /// @brief Adds an entry for a name the table doesn't have, edit it first
+    Entry& insert(std::string_view name, uint32_t hash, double value) {
+        auto& names = table->names;
+        auto& entries = table->entries;
+        auto& slots = table->slots;
+        if ((entries.size() + 1) * 2 > slots.size()) rehash(ceilPowerOfTwo((entries.size() + 1) * 2));
+        const auto mask = slots.size() - 1;
+        auto i = size_t(hash) & mask;
+        while (slots[i]) i = (i + 1) & mask;
+
+        entries.push_back({uint32_t(names.size()), uint32_t(name.size()), hash, 0, value});
+        names.append(name);
+        slots[i] = uint32_t(entries.size());
+        return entries.back();
+    }
+
+    void rehash(size_t size) {
+        const auto& entries = table->entries;
+        auto& slots = table->slots;
+        slots.assign(size, 0);
+        const auto mask = size - 1;
+        for (size_t index = 0; index < entries.size(); ++index) {
+            auto i = size_t(entries[index].hash) & mask;
+            while (slots[i]) i = (i + 1) & mask;
+            slots[i] = uint32_t(index + 1);
+        }
+    }
+
+    /// @brief Marks name changed as it is now, absent names as removed
+    void touch(std::string_view name) {
+        auto& table = edit();
+        const auto hash = hashOf(name);
+        auto* entry = lookup(name, hash);
+        if (not entry) {
+            const auto saved = file ? file->find(name) : SessionFile::npos;
+            entry = &insert(name, hash, saved == SessionFile::npos ? 0.0 : file->value(saved));
+            if (saved != SessionFile::npos) {
+                entry->flags |= Saved;
+                ++table.shadowed;
+                ++table.live;
+            } else {
+                entry->flags |= Erased;
+            }
+        }
+        changed(*entry);
+    }
+
+    void changed(Entry& entry) {
+        static std::atomic<uint64_t> stamps{0};
+        const auto index = uint32_t(&entry - table->entries.data());
+
+        // a table being changed isn't shared, so a snapshot of this very one is gone too
+        auto& snapshots = table->snapshots;
+        if (not snapshots.empty())
+            snapshots.erase(std::remove_if(snapshots.begin(), snapshots.end(),
+                                           [this](const auto& weak) {
+                                               const auto snapshot = weak.lock();
+                                               return not snapshot or snapshot == table;
+                                           }),
+                            snapshots.end());
+        if (snapshots.empty())
+            table->log.clear();
+        else
+            table->log.push_back({++stamps, index});
+
+        if (entry.flags & Dirty) return;
+        entry.flags |= Dirty;
+        table->unsaved.push_back(index);
+    }
+
+    void markSaved() {
+        if (table->unsaved.empty()) return;
+        auto& table = edit();
+        for (const auto index : table.unsaved) table.entries[index].flags &= ~Dirty;
+        table.unsaved.clear();
+    }
+
+    /// @return first position from position on which holds a variable, end if none
+    size_t visible(size_t position) const {
+        for (; position < fileSize(); ++position) {
+            const auto name = file->name(position);
+            if (not lookup(name, hashOf(name))) return position;
+        }
+        const auto& entries = table->entries;
+        while (position - fileSize() < entries.size() and entries[position - fileSize()].flags & Erased) ++position;
+        return position;
+    }
+
+    value_type at(size_t position) const {
+        if (position < fileSize()) return {file->name(position), file->value(position)};
+        const auto& entry = table->entries[position - fileSize()];
+        return {key(entry), entry.value};
+    }
+
+    /// @brief Calls visit(name, value) for the variables with the prefix in name order until it returns false
+    template <class Visit>
+    void forEachSorted(std::string_view prefix, Visit visit) const {
+        const auto matches = [&prefix](std::string_view name) {
+            return name.substr(0, prefix.size()) == prefix;
+        };
+
+        std::vector<value_type> assigned;
+        for (const auto& entry : table->entries)
+            if (not(entry.flags & Erased) and matches(key(entry))) assigned.emplace_back(key(entry), entry.value);
+        std::sort(assigned.begin(), assigned.end());
+
+        auto next = assigned.begin();
+        for (auto i = file ? file->lowerBound(prefix) : 0;;) {
+            // the file's variables the table has are shadowed by it
+            std::string_view name;
+            while (i < fileSize() and matches(name = file->name(i)) and lookup(name, hashOf(name))) ++i;
+            const auto inFile = i < fileSize() and matches(name);
+
+            if (inFile and (next == assigned.end() or name < next->first)) {
+                if (not visit(name, file->value(i++))) return;
+            } else if (next != assigned.end()) {
+                if (not visit(next->first, next->second)) return;
+                ++next;
+            } else {
+                return;
+            }
+        }
+    }
+
+    std::shared_ptr<const SessionFile> file{};
+    std::shared_ptr<Table> table = emptyTable();  // names assigned or removed since the file was written
+    size_t journaled = 0;  // lines of the journal
+    bool cleared = false;  // the file's variables were dropped
+};
+
+}  // namespace korowa
+
+#endif  // KOROWA_VARIABLES_HPP
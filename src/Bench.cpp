@@ -0,0 +1,461 @@
+// Micro benchmarks of the evaluation hot paths, results in numbers per second.
+// usage: Bench [name filter] [-n numbers per case]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <korowa/Approx.hpp>
+#include <korowa/Compiler.hpp>
+#include <korowa/Exact.hpp>
+#include <korowa/Fused.hpp>
+#include <korowa/Incremental.hpp>
+#include <korowa/Optimizer.hpp>
+#include <korowa/Random.hpp>
+#include <korowa/Stream.hpp>
+#include <korowa/Variables.hpp>
+#include <my/printer/Format.hpp>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct Settings {
+    std::string filter{};
+    size_t count = 50'000'000;
+};
+
+// keeps results alive so the measured loops aren't optimized out
+volatile double sink = 0;
+
+/// @brief Runs body(count) once to warm up and once measured, prints numbers per second
+template <class Body>
+void measure(const Settings& settings, const std::string& name, Body&& body) {
+    if (name.find(settings.filter) == std::string::npos) return;
+
+    body(settings.count / 10);
+    const auto start = Clock::now();
+    body(settings.count);
+    const auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    const auto padding = std::string(std::max<size_t>(name.size(), 28) - name.size(), ' ');
+    my::printf("{}{} {} M/s\n", name, padding, std::round(settings.count / seconds / 1e5) / 10);
+}
+
+/// @brief Like measure for slow operations, body(count) runs count of them, prints time per one
+template <class Body>
+void measureLatency(const Settings& settings, const std::string& name, size_t count, Body&& body) {
+    if (name.find(settings.filter) == std::string::npos) return;
+
+    body(count / 10 + 1);
+    const auto start = Clock::now();
+    body(count);
+    const auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    const auto padding = std::string(std::max<size_t>(name.size(), 28) - name.size(), ' ');
+    my::printf("{}{} {} us\n", name, padding, std::round(seconds / count * 1e7) / 10);
+}
+
+void randomCases(const Settings& settings) {
+    korowa::random::seed(1);
+
+    measure(settings, "mt19937_64 uniform", [](size_t count) {
+        std::mt19937_64 generator(1);
+        std::uniform_real_distribution<double> distribution;
+        double acc = 0;
+        for (size_t i = 0; i < count; ++i) acc += distribution(generator);
+        sink = acc;
+    });
+
+    measure(settings, "random::uniform", [](size_t count) {
+        double acc = 0;
+        for (size_t i = 0; i < count; ++i) acc += korowa::random::uniform();
+        sink = acc;
+    });
+
+    measure(settings, "random::fill", [](size_t count) {
+        std::vector<double> values(korowa::blockSize);
+        double acc = 0;
+        for (size_t i = 0; i < count; i += values.size()) {
+            korowa::random::fill(values.data(), values.size());
+            acc += values[0];
+        }
+        sink = acc;
+    });
+
+    measure(settings, "random::normal", [](size_t count) {
+        double acc = 0;
+        for (size_t i = 0; i < count; ++i) acc += korowa::random::normal();
+        sink = acc;
+    });
+
+    measure(settings, "random::fillNormal", [](size_t count) {
+        std::vector<double> values(korowa::blockSize);
+        double acc = 0;
+        for (size_t i = 0; i < count; i += values.size()) {
+            korowa::random::fillNormal(values.data(), values.size());
+            acc += values[0];
+        }
+        sink = acc;
+    });
+
+    auto err = korowa::SyntaxError();
+    const auto program = korowa::compile("rnd * 2 - 1", err);
+    measure(settings, "executeBlock rnd * 2 - 1", [&program](size_t count) {
+        std::vector<double> stack, out(korowa::blockSize);
+        const auto load = [](size_t, size_t) { return 0.0; };
+        double acc = 0;
+        for (size_t i = 0; i < count; i += korowa::blockSize) {
+            korowa::executeBlock(program, korowa::blockSize, load, out.data(), stack);
+            acc += out[0];
+        }
+        sink = acc;
+    });
+}
+
+void integerCases(const Settings& settings) {
+    auto err = korowa::SyntaxError();
+    const auto program = korowa::compile("gcd(n, 360) + n % 7 * 3^5 - lcm(n, 12) + 12!", err);
+
+    measure(settings, "integer program, double", [&program](size_t count) {
+        std::vector<double> stack;
+        double acc = 0;
+        for (size_t i = 0; i < count; ++i) {
+            const double n = double(i % 1000 + 1);
+            acc += korowa::execute(program, &n, stack);
+        }
+        sink = acc;
+    });
+
+    measure(settings, "integer program, Exact", [&program](size_t count) {
+        std::vector<korowa::Exact> stack;
+        double acc = 0;
+        for (size_t i = 0; i < count; ++i) {
+            const korowa::Exact n(double(i % 1000 + 1));
+            acc += korowa::execute(program, &n, stack).value;
+        }
+        sink = acc;
+    });
+}
+
+void piecewiseCases(const Settings& settings) {
+    auto err = korowa::SyntaxError();
+    const auto program =
+        korowa::compile("if(x < 0.5, x * x, clamp(1 - x, 0, 0.25)) + step(x - 0.25)", err);
+
+    // selects are branch free, so random points cost the same as sorted ones
+    for (const auto sorted : {true, false})
+        measure(settings, sorted ? "piecewise, sorted x" : "piecewise, random x", [&](size_t count) {
+            std::vector<double> stack, out(korowa::blockSize), points(1 << 16);
+            for (size_t i = 0; i < points.size(); ++i)
+                points[i] = sorted ? double(i) / points.size() : korowa::random::uniform();
+            double acc = 0;
+            for (size_t i = 0; i < count; i += korowa::blockSize) {
+                const auto* block = points.data() + i % points.size();
+                const auto load = [block](size_t, size_t lane) { return block[lane]; };
+                korowa::executeBlock(program, korowa::blockSize, load, out.data(), stack);
+                acc += out[0];
+            }
+            sink = acc;
+        });
+}
+
+void fusedCases(const Settings& settings) {
+    static const char* sources[]{
+        "sin(x) * y", "sin(x) + z", "sqrt(sin(x) * sin(x) + 1)", "exp(-x * x) * sin(x)",
+        "exp(-x * x) * y + z", "y * z - sin(x) * y", "ln(1 + exp(-x * x))", "x * y * z + sin(x)"};
+
+    auto err = korowa::SyntaxError();
+    std::vector<korowa::Program> programs;
+    for (const auto* source : sources) programs.push_back(korowa::compile(source, err));
+    const auto fused = korowa::fuse(programs);
+
+    // numbers per second count one result of every formula as one number
+    measure(settings, "8 formulas, separately", [&](size_t count) {
+        std::vector<double> stack, out(korowa::blockSize);
+        std::vector<std::vector<long>> slots;
+        for (const auto& program : programs)
+            slots.push_back({program.slotOf("x"), program.slotOf("y"), program.slotOf("z")});
+        double acc = 0;
+        for (size_t i = 0; i < count; i += korowa::blockSize) {
+            for (size_t p = 0; p < programs.size(); ++p) {
+                const auto load = [&](size_t slot, size_t lane) {
+                    const auto& names = slots[p];
+                    const double point = double(i + lane) * 1e-6;
+                    return slot == (size_t)names[0] ? point : slot == (size_t)names[1] ? 2.0 : 0.5;
+                };
+                korowa::executeBlock(programs[p], korowa::blockSize, load, out.data(), stack);
+                acc += out[0];
+            }
+        }
+        sink = acc;
+    });
+
+    measure(settings, "8 formulas, fused", [&](size_t count) {
+        std::vector<double> scratch, out(programs.size() * korowa::blockSize);
+        const long names[]{fused.slotOf("x"), fused.slotOf("y"), fused.slotOf("z")};
+        double acc = 0;
+        for (size_t i = 0; i < count; i += korowa::blockSize) {
+            const auto load = [&](size_t slot, size_t lane) {
+                const double point = double(i + lane) * 1e-6;
+                return slot == (size_t)names[0] ? point : slot == (size_t)names[1] ? 2.0 : 0.5;
+            };
+            korowa::executeBlock(fused, korowa::blockSize, load, out.data(), scratch);
+            acc += out[0];
+        }
+        sink = acc;
+    });
+}
+
+void polynomialCases(const Settings& settings) {
+    auto err = korowa::SyntaxError();
+    const auto program = korowa::compile("3 * x^5 - 2 * x^4 + x^3 / 7 + 5 * x^2 - x / 4 + 1", err);
+    const std::pair<const char*, korowa::Program> variants[]{
+        {"polynomial, compiled", program},
+        {"polynomial, strict", korowa::optimize(program, korowa::FloatMode::Strict)},
+        {"polynomial, relaxed", korowa::optimize(program, korowa::FloatMode::Relaxed)},
+    };
+
+    for (const auto& [name, variant] : variants)
+        measure(settings, name, [&variant = variant](size_t count) {
+            std::vector<double> stack, out(korowa::blockSize);
+            double acc = 0;
+            for (size_t i = 0; i < count; i += korowa::blockSize) {
+                const auto load = [i](size_t, size_t lane) { return double(i + lane) * 1e-9; };
+                korowa::executeBlock(variant, korowa::blockSize, load, out.data(), stack);
+                acc += out[0];
+            }
+            sink = acc;
+        });
+}
+
+void accuracyCases(const Settings& settings) {
+    auto err = korowa::SyntaxError();
+    const auto program = korowa::compile("exp(-x) * sin(40 * x) + ln(1 + x) * cos(x)", err);
+    const std::pair<const char*, korowa::Accuracy> accuracies[]{
+        {"transcendental, strict", korowa::Accuracy::Strict},
+        {"transcendental, fast", korowa::Accuracy::Fast},
+        {"transcendental, approx", korowa::Accuracy::Approx},
+    };
+
+    for (const auto& [name, accuracy] : accuracies)
+        measure(settings, name, [&program, accuracy = accuracy](size_t count) {
+            std::vector<double> stack, out(korowa::blockSize);
+            double acc = 0;
+            for (size_t i = 0; i < count; i += korowa::blockSize) {
+                const auto load = [i](size_t, size_t lane) { return double(i + lane) * 1e-9; };
+                korowa::executeBlock(program, korowa::blockSize, load, out.data(), stack, accuracy);
+                acc += out[0];
+            }
+            sink = acc;
+        });
+}
+
+void approximantCases(const Settings& settings) {
+    auto err = korowa::SyntaxError();
+    auto f = korowa::objective("sinh(x) * fact(x) + exp(-x) * sin(3 * x)", "x", err, {});
+    const auto approximant = korowa::approximate(f, 0, 3, 1e-12, err);
+
+    measure(settings, "expensive, compiled", [&](size_t count) {
+        std::vector<double> xs(korowa::blockSize), out(korowa::blockSize);
+        double acc = 0;
+        for (size_t i = 0; i < count; i += korowa::blockSize) {
+            for (size_t lane = 0; lane < xs.size(); ++lane) xs[lane] = double((i + lane) % 3000) * 1e-3;
+            f(xs.data(), xs.size(), out.data());
+            acc += out[0];
+        }
+        sink = acc;
+    });
+
+    measure(settings, "expensive, approximant", [&](size_t count) {
+        std::vector<double> xs(korowa::blockSize), out(korowa::blockSize);
+        double acc = 0;
+        for (size_t i = 0; i < count; i += korowa::blockSize) {
+            for (size_t lane = 0; lane < xs.size(); ++lane) xs[lane] = double((i + lane) % 3000) * 1e-3;
+            approximant.evaluate(xs.data(), xs.size(), out.data());
+            acc += out[0];
+        }
+        sink = acc;
+    });
+}
+
+void keystrokeCases(const Settings& settings) {
+    std::string text;
+    while (text.size() < 10'000) text += "sin(0.5) * (3 + x) - 2^y / 7 + ";
+    text += "1";
+    const auto keystrokes = std::max<size_t>(settings.count / 25'000, 10);
+
+    // a character typed and erased again, both are keystrokes
+    const std::pair<const char*, size_t> positions[]{
+        {"keystroke at end, 10k chars", text.size()},
+        {"keystroke in middle, 10k chars", text.size() / 2},
+        {"keystroke at start, 10k chars", 0},
+    };
+    for (const auto& [name, position] : positions)
+        measureLatency(settings, name, keystrokes, [&text, position = position](size_t count) {
+            korowa::IncrementalExpression expression;
+            expression.update(text);
+            auto edited = text;
+            for (size_t i = 0; i < count; ++i) {
+                if (i % 2)
+                    edited.erase(position, 1);
+                else
+                    edited.insert(position, 1, '5');
+                expression.update(edited);
+            }
+            sink = double(expression.queue().size());
+        });
+
+    measureLatency(settings, "parse(tokenize), 10k chars", keystrokes, [&text](size_t count) {
+        auto err = korowa::SyntaxError();
+        size_t size = 0;
+        for (size_t i = 0; i < count; ++i) size += korowa::detail::parse(korowa::detail::tokenize(text), err).size();
+        sink = double(size);
+    });
+}
+
+void streamCases(const Settings& settings) {
+    // generated expressions are long sums of small terms
+    std::string text;
+    while (text.size() < 1'000'000) text += "(sin(x) * 3.25 - y / 7) + 2.5 * exp(-x / 4) + ";
+    text += "1";
+    const auto inputs = std::max<size_t>(settings.count / 5'000'000, 2);
+
+    measureLatency(settings, "compile(stream), 1 MB", inputs, [&text](size_t count) {
+        size_t size = 0;
+        for (size_t i = 0; i < count; ++i) {
+            std::istringstream input(text);
+            auto err = korowa::SyntaxError();
+            size += korowa::compile(input, err).code.size();
+        }
+        sink = double(size);
+    });
+    measureLatency(settings, "compile(string), 1 MB", inputs, [&text](size_t count) {
+        size_t size = 0;
+        for (size_t i = 0; i < count; ++i) {
+            auto err = korowa::SyntaxError();
+            size += korowa::compile(text, err).code.size();
+        }
+        sink = double(size);
+    });
+}
+
+void errorCases(const Settings& settings) {
+    // rejected inputs, an error costs building it, rendering only happens when printed
+    const auto inputs = std::max<size_t>(settings.count / 100, 10);
+    measureLatency(settings, "eval unknown variable", inputs, [](size_t count) {
+        korowa::Variables variables;
+        size_t failed = 0;
+        for (size_t i = 0; i < count; ++i) {
+            auto err = korowa::SyntaxError();
+            korowa::eval("2 * (velocity + 1)", err, variables);
+            failed += bool(err);
+        }
+        sink = double(failed);
+    });
+    measureLatency(settings, "eval mismatched parenthesis", inputs, [](size_t count) {
+        size_t failed = 0;
+        for (size_t i = 0; i < count; ++i) {
+            auto err = korowa::SyntaxError();
+            korowa::eval("2 * (3 + 1", err);
+            failed += bool(err);
+        }
+        sink = double(failed);
+    });
+
+    auto err = korowa::SyntaxError();
+    auto f = korowa::objective("ln(x) * 2", "x", err, {});
+    measure(settings, "batch half failing, bitmap", [&](size_t count) {
+        std::vector<double> xs(korowa::blockSize), out(korowa::blockSize);
+        uint64_t failed = 0, word;
+        for (size_t i = 0; i < count; i += korowa::blockSize) {
+            for (size_t lane = 0; lane < xs.size(); ++lane) xs[lane] = double(lane) - 31.5;
+            f(xs.data(), xs.size(), out.data(), &word);
+            failed += word & 1;
+        }
+        sink = double(failed);
+    });
+}
+
+void sessionCases(const Settings& settings) {
+    // a session of a million variables, saved once and mapped by every open
+    const std::string names[]{"open session, 1M vars", "eval on session, 1M vars",
+                              "vars page, 1M vars", "snapshot what-if, 1M vars"};
+    if (std::none_of(std::begin(names), std::end(names),
+                     [&settings](const std::string& name) { return name.find(settings.filter) != std::string::npos; }))
+        return;
+
+    const std::string path = "./korowa_bench.kvs";
+    auto err = korowa::SyntaxError();
+    {
+        korowa::Variables variables;
+        variables.reserve(1'000'000);
+        for (size_t i = 0; i < 1'000'000; ++i) variables["v" + std::to_string(i)] = double(i);
+        if (not variables.compact(path, err)) {
+            my::printf("{}\n", err);
+            return;
+        }
+    }
+    const auto inputs = std::max<size_t>(settings.count / 50'000, 10);
+
+    measureLatency(settings, names[0], inputs, [&](size_t count) {
+        size_t size = 0;
+        for (size_t i = 0; i < count; ++i) size += korowa::Variables::open(path, err).size();
+        sink = double(size);
+    });
+
+    auto variables = korowa::Variables::open(path, err);
+    measureLatency(settings, names[1], inputs * 10, [&](size_t count) {
+        double sum = 0;
+        for (size_t i = 0; i < count; ++i) {
+            const auto name = "v" + std::to_string(i * 7919 % 1'000'000);
+            sum += korowa::eval(name + " * 2 + 1", err, variables);
+        }
+        sink = sum;
+    });
+    measureLatency(settings, names[2], inputs, [&](size_t count) {
+        size_t size = 0;
+        for (size_t i = 0; i < count; ++i) size += variables.list("v5", i % 100 * 20, 20).size();
+        sink = double(size);
+    });
+    measureLatency(settings, names[3], inputs * 10, [&](size_t count) {
+        double sum = 0;
+        for (size_t i = 0; i < count; ++i) {
+            const auto snapshot = variables.snapshot();
+            variables["v" + std::to_string(i % 1'000'000)] = -1.0;
+            sum += korowa::eval("v1 + v2", err, variables);
+            variables.restore(snapshot);
+        }
+        sink = sum;
+    });
+
+    variables = {};
+    std::remove(path.c_str());
+    std::remove((path + ".log").c_str());
+}
+
+auto main(int argc, char** argv) -> int {
+    Settings settings;
+
+    const std::vector<std::string> args(argv + 1, argv + argc);
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i] == "-n" and i + 1 < args.size())
+            settings.count = std::stoull(args[++i]);
+        else
+            settings.filter = args[i];
+    }
+
+    randomCases(settings);
+    integerCases(settings);
+    piecewiseCases(settings);
+    fusedCases(settings);
+    polynomialCases(settings);
+    accuracyCases(settings);
+    approximantCases(settings);
+    keystrokeCases(settings);
+    streamCases(settings);
+    errorCases(settings);
+    sessionCases(settings);
+    return 0;
+}
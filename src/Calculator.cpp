@@ -1,9 +1,24 @@
 // #define KOROWA_PRINT_TOKENS
 #include <direct.h>
 
+#include <filesystem>
 #include <fstream>
+#include <korowa/Approx.hpp>
+#include <korowa/Capture.hpp>
 #include <korowa/Converter.hpp>
+#include <korowa/Dual.hpp>
+#include <korowa/Exact.hpp>
+#include <korowa/Fused.hpp>
 #include <korowa/Lexer.hpp>
+#include <korowa/Library.hpp>
+#include <korowa/LineEditor.hpp>
+#include <korowa/Optimizer.hpp>
+#include <korowa/Server.hpp>
+#include <korowa/Solver.hpp>
+#include <korowa/Stats.hpp>
+#include <korowa/Stream.hpp>
+#include <korowa/Table.hpp>
+#include <korowa/Suggest.hpp>
 #include <locale>
 #include <my/extention/ConsoleUtils.hpp>
 #include <my/extention/File.hpp>
@@ -11,10 +26,23 @@
 #include <my/printer/LightTable.hpp>
 #include <my/printer/PrintableBase.hpp>
 #include <my/text/Helpers.hpp>
+#include <new>
 #include <nlohmann/json.hpp>
 
-#define SESSION_FILE "./korowa_session.json"
+#define SESSION_FILE "./korowa_session.kvs"
+#define LEGACY_SESSION_FILE "./korowa_session.json"
 #define CONFIG_FILE "./korowa_config.json"
+#define CONFIG_CACHE_FILE "./korowa_config.bin"
+
+#ifdef KOROWA_ENABLE_STATS
+void* operator new(size_t size) {
+    KOROWA_STATS_ADD(Allocations, 1);
+    if (auto ptr = std::malloc(size ? size : 1)) return ptr;
+    throw std::bad_alloc();
+}
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+#endif
 
 class Options {
    public:
@@ -25,16 +53,27 @@ class Options {
     bool enableDidYouMean = true;
     bool separateThousands = true;
     bool logEnabled = false;
+    bool strictMath = true;  // false lets compiled formulas round differently in the last bits
+    bool livePreview = true;  // result shown while typing, on terminals only
     // bool enableColors = true;
     size_t precision = 10;
     std::string logTimeFormat = "%H:%M:%S|";  // see https://www.cplusplus.com/reference/ctime/strftime/
     std::string logFilePath = "logs/";
     std::string inputSign = "> ";
+    std::string serverEndpoint = "korowa.sock";  // port (loopback tcp) or unix socket path
+    std::string serverFraming = "line";          // line | length
+    size_t serverWorkers = 0;                    // 0 - one per hardware thread
+    std::string statsFile = "korowa_stats.json";  // dumped on exit, when built with KOROWA_ENABLE_STATS
+    std::string mathAccuracy = "strict";          // strict | fast | approx, of tables
+    std::string captureFile = "";                 // evaluations recorded for --replay, empty records none
+    std::string session = "default";              // variables used at start, switched with use session
 
     Options() {
         my::File file(CONFIG_FILE);
 
         if (file.exists()) {
+            if (readCache()) return;
+
             std::string buffer;
             file.read(buffer);
             const auto read = nlohmann::json::parse(buffer);
@@ -50,6 +89,17 @@ class Options {
             logEnabled = read["logEnabled"];
             logFilePath = read["logFilePath"];
             logTimeFormat = read["logTimeFormat"];
+            serverEndpoint = read.value("serverEndpoint", serverEndpoint);
+            serverFraming = read.value("serverFraming", serverFraming);
+            serverWorkers = read.value("serverWorkers", serverWorkers);
+            statsFile = read.value("statsFile", statsFile);
+            strictMath = read.value("strictMath", strictMath);
+            mathAccuracy = read.value("mathAccuracy", mathAccuracy);
+            livePreview = read.value("livePreview", livePreview);
+            captureFile = read.value("captureFile", captureFile);
+            session = read.value("session", session);
+
+            writeCache();
         } else {
             file.create();
 
@@ -67,13 +117,111 @@ class Options {
             write["logEnabled"] = logEnabled;
             write["logFilePath"] = logFilePath;
             write["logTimeFormat"] = logTimeFormat;
+            write["serverEndpoint"] = serverEndpoint;
+            write["serverFraming"] = serverFraming;
+            write["serverWorkers"] = serverWorkers;
+            write["statsFile"] = statsFile;
+            write["strictMath"] = strictMath;
+            write["mathAccuracy"] = mathAccuracy;
+            write["livePreview"] = livePreview;
+            write["captureFile"] = captureFile;
+            write["session"] = session;
 
             file.write(write.dump(4));
         }
     }
+
+   private:
+    // binary copy of parsed CONFIG_FILE, valid while size and modification time of it match
+    static constexpr uint32_t cacheVersion = 6;
+
+    template <class Archive>
+    void fields(Archive& archive) {
+        archive(alwaysShowHelp, showWelcomeScreen, enableVariables, enableConverters,
+                enableDidYouMean, separateThousands, logEnabled, precision, logTimeFormat,
+                logFilePath, inputSign, serverEndpoint, serverFraming, serverWorkers, statsFile,
+                strictMath, mathAccuracy, livePreview, captureFile, session);
+    }
+
+    static auto configStamp() {
+        std::error_code ec;
+        const int64_t time = std::filesystem::last_write_time(CONFIG_FILE, ec).time_since_epoch().count();
+        const uint64_t size = std::filesystem::file_size(CONFIG_FILE, ec);
+        return std::make_pair(time, size);
+    }
+
+    bool readCache() {
+        std::ifstream file(CONFIG_CACHE_FILE, std::ios::binary);
+
+        const auto read = [&file](auto&... values) {
+            const auto one = [&file](auto& value) {
+                if constexpr (std::is_same_v<std::decay_t<decltype(value)>, std::string>) {
+                    uint32_t size = 0;
+                    file.read((char*)&size, sizeof(size));
+                    if (!file or size > 4096) return file.setstate(std::ios::failbit);
+                    value.resize(size);
+                    file.read(value.data(), size);
+                } else {
+                    file.read((char*)&value, sizeof(value));
+                }
+            };
+            (one(values), ...);
+        };
+
+        uint32_t version = 0;
+        auto stamp = configStamp();
+        read(version, stamp.first, stamp.second);
+
+        if (!file or version != cacheVersion or stamp != configStamp()) {
+            KOROWA_STATS_ADD(CacheMisses, 1);
+            return false;
+        }
+
+        Options cached(*this);
+        cached.fields(read);
+        if (!file) {
+            KOROWA_STATS_ADD(CacheMisses, 1);
+            return false;
+        }
+
+        *this = cached;
+        KOROWA_STATS_ADD(CacheHits, 1);
+        return true;
+    }
+
+    void writeCache() {
+        std::ofstream file(CONFIG_CACHE_FILE, std::ios::binary | std::ios::trunc);
+
+        const auto write = [&file](const auto&... values) {
+            const auto one = [&file](const auto& value) {
+                if constexpr (std::is_same_v<std::decay_t<decltype(value)>, std::string>) {
+                    const auto size = (uint32_t)value.size();
+                    file.write((const char*)&size, sizeof(size));
+                    file.write(value.data(), size);
+                } else {
+                    file.write((const char*)&value, sizeof(value));
+                }
+            };
+            (one(values), ...);
+        };
+
+        const auto stamp = configStamp();
+        write(cacheVersion, stamp.first, stamp.second);
+        fields(write);
+    }
 };
 
-auto getStyled(double num, const Options& options) {
+auto floatMode(const Options& options) {
+    return options.strictMath ? korowa::FloatMode::Strict : korowa::FloatMode::Relaxed;
+}
+
+auto accuracy(const Options& options) {
+    if (options.mathAccuracy == "fast") return korowa::Accuracy::Fast;
+    if (options.mathAccuracy == "approx") return korowa::Accuracy::Approx;
+    return korowa::Accuracy::Strict;
+}
+
+auto styledStream(const Options& options) {
     struct ThousandsSep : std::numpunct<char> {
         char do_thousands_sep() const { return '\''; }
         std::string do_grouping() const { return "\3"; }
@@ -82,6 +230,13 @@ auto getStyled(double num, const Options& options) {
     std::stringstream ss;
     if (options.separateThousands)
         ss.imbue(std::locale(ss.getloc(), new ThousandsSep));
+    return ss;
+}
+
+auto getStyled(double num, const Options& options) {
+    KOROWA_STATS_TIMER(Format);
+
+    auto ss = styledStream(options);
 
     ss << (num < 1e40 ? std::fixed : std::scientific)
        << std::setprecision(options.precision) << num;
@@ -97,84 +252,755 @@ auto getStyled(double num, const Options& options) {
     return numStr;
 }
 
-auto createDefaultSession(my::File& file) {
-    file.create();
-    file.write(R"({
-    "version": "0.2.0",
-    "variables" : {}
-})");
-}
+/// @brief Exact integers are printed with every digit, double would round them past 2^53
+auto getStyled(const korowa::Exact& number, const Options& options) {
+    if (!number.exact) return getStyled(number.value, options);
+    KOROWA_STATS_TIMER(Format);
 
-auto readVariables(const Options& options) {
-    if (!options.enableVariables)
-        return std::map<std::string, double>{};
+    auto ss = styledStream(options);
+    ss << number.integer;
+    return ss.str();
+}
 
-    my::File file(SESSION_FILE);
+auto getStyled(const korowa::Array& array, const Options& options) {
+    if (array.scalar) return getStyled(array.values.front(), options);
 
-    if (!file.exists()) {
-        createDefaultSession(file);
-        return std::map<std::string, double>{};
+    std::string styled = "[";
+    for (const auto& el : array.values) {
+        if (styled.size() > 1) styled += ", ";
+        styled += getStyled(el, options);
     }
+    return styled + "]";
+}
+
+/// @brief Whether expression may evaluate to an array: array literals or factor()
+bool producesArray(const std::string& expression) {
+    return expression.find('[') != std::string::npos or
+           expression.find("factor") != std::string::npos;
+}
+
+/// @brief Whether evaluating expression may sieve primes for seconds, too long to wait while typing
+bool slowToEvaluate(const korowa::IncrementalExpression& expression) {
+    return std::any_of(expression.tokens().begin(), expression.tokens().end(), [](const auto& token) {
+        return token.spec == korowa::detail::NthPrime or token.spec == korowa::detail::PrimePi;
+    });
+}
+
+/**
+ * @brief Imports the variables of a json session file, as written by older versions.
+ * The imported file is left in place, the new session file takes precedence once it exists.
+ */
+auto importLegacySession(korowa::Variables& variables) {
+    my::File file(LEGACY_SESSION_FILE);
+    if (!file.exists()) return;
 
     std::string buffer;
     file.read(buffer);
-    const auto read = nlohmann::json::parse(buffer);
+    const auto read = nlohmann::json::parse(buffer, nullptr, false);
+    if (read.is_discarded() or !read.contains("variables")) return;
+
+    for (const auto& [name, value] : read["variables"].items())
+        if (value.is_number()) variables[name] = value.get<double>();
+
+    auto err = korowa::SyntaxError();
+    if (!variables.compact(SESSION_FILE, err)) my::printf(std::cerr, "{}\n", err);
+}
+
+/// @return whether name can name a session, it becomes a part of its file name
+bool validSessionName(const std::string& name) {
+    return !name.empty() and name.size() <= 64 and
+           std::all_of(name.begin(), name.end(), [](unsigned char ch) {
+               return std::isalnum(ch) or ch == '_' or ch == '-';
+           });
+}
+
+/// @return session file of the named session, the default one keeps the old name
+std::string sessionPath(const std::string& name) {
+    return name == "default" ? SESSION_FILE : "./korowa_session." + name + ".kvs";
+}
 
-    return read.at("variables").get<std::map<std::string, double>>();
+auto readVariables(const std::string& name, const Options& options) {
+    if (!options.enableVariables) return korowa::Variables{};
+
+    const auto path = sessionPath(name);
+    auto err = korowa::SyntaxError();
+    auto variables = korowa::Variables::open(path, err);
+    if (err) {
+        my::printf(std::cerr, "{}\n", err);
+        return korowa::Variables{};
+    }
+    if (name == "default" and variables.empty() and !my::File(path).exists()) importLegacySession(variables);
+    return variables;
 }
 
-auto saveVariables(const std::map<std::string, double>& variables, const Options& options) {
+/// @brief Saves the variables changed since the last save
+auto saveVariables(korowa::Variables& variables, const std::string& name, const Options& options) {
     if (!options.enableVariables) return;
-    my::File file(SESSION_FILE);
+    KOROWA_STATS_TIMER(Persist);
 
-    if (!file.exists()) createDefaultSession(file);
+    auto err = korowa::SyntaxError();
+    if (!variables.save(sessionPath(name), err)) my::printf(std::cerr, "{}\n", err);
+}
 
-    std::string buffer;
-    file.read(buffer);
-    auto read = nlohmann::json::parse(buffer);
+/**
+ * @brief Named sessions of variables, each one read from its file on first access only.
+ * Snapshots share the variables with the session until either is changed.
+ */
+class Session {
+   public:
+    explicit Session(const Options& options) : options(options), active(options.session) {}
+
+    /// @brief Variables of the current session
+    auto& variables() {
+        auto& current = sessions[active];
+        if (!current.loaded) {
+            current.values = readVariables(active, options);
+            current.loaded = true;
+        }
+        return current.values;
+    }
+
+    /// @brief Saves the changes of the current session
+    void save() {
+        if (auto& current = sessions[active]; current.loaded) saveVariables(current.values, active, options);
+    }
+
+    /// @brief Switches to the named session, its variables are read when first needed
+    void use(const std::string& name) { active = name; }
+
+    const std::string& name() const { return active; }
+
+    /// @return number of snapshots of the current session, the new one included
+    size_t snapshot() {
+        auto& snapshots = sessions[active].snapshots;
+        snapshots.push_back(variables().snapshot());
+        return snapshots.size();
+    }
+
+    /**
+     * @brief Restores the variables of the last snapshot of the current session and saves them
+     *
+     * @return number of snapshots left, npos if there was none
+     */
+    size_t rollback() {
+        auto& snapshots = sessions[active].snapshots;
+        if (snapshots.empty()) return std::string::npos;
+        variables().restore(snapshots.back());
+        snapshots.pop_back();
+        save();
+        return snapshots.size();
+    }
+
+    /// @brief Expression can't reference variables if it has no letters, so session is not needed
+    bool neededFor(const std::string& expression) const {
+        return options.enableVariables and
+               std::any_of(expression.begin(), expression.end(),
+                           [](unsigned char ch) { return std::isalpha(ch); });
+    }
+
+    struct Defined {
+        std::string source;
+        korowa::Program program;
+    };
+
+    /// @brief Formulas defined with def, they shadow loaded libraries
+    auto& defined() { return formulas; }
+
+    /// @brief Loaded formula libraries, later ones shadow earlier ones
+    auto& libraries() { return mapped; }
+
+   private:
+    struct Named {
+        korowa::Variables values{};
+        bool loaded = false;
+        std::vector<korowa::Variables> snapshots{};  // oldest first
+    };
+
+    const Options& options;
+    std::string active;
+    std::map<std::string, Named> sessions{};
+    std::map<std::string, Defined> formulas{};
+    std::vector<korowa::Library> mapped{};
+};
+
+/**
+ * @brief Did you mean index over every known name. Built on the first unknown token
+ * and kept in sync with the session variables afterwards. Sessions too large to index
+ * are probed for the names one edit away instead, only the assigned names are indexed.
+ */
+class Suggestions {
+   public:
+    /// @return closest known names to query, ordered by distance
+    std::vector<std::string> suggest(const std::string& query, Session& session, const Options& options) {
+        static constexpr size_t count = 3;
+        auto meant = get(session, options).suggest(query, count);
+        if (!probing) return meant;
+
+        auto& variables = session.variables();
+        for (auto& name : korowa::oneEditAway(query, [&variables](const std::string& name) {
+                 return variables.count(name) != 0;
+             }))
+            if (std::find(meant.begin(), meant.end(), name) == meant.end()) meant.push_back(std::move(name));
+
+        std::vector<std::pair<size_t, std::string>> ranked;
+        for (auto& name : meant) ranked.emplace_back(korowa::detail::editDistance(query, name, 3), std::move(name));
+        std::sort(ranked.begin(), ranked.end());
+        ranked.resize(std::min(ranked.size(), count));
+
+        meant.clear();
+        for (auto& [distance, name] : ranked) meant.push_back(std::move(name));
+        return meant;
+    }
 
-    read["variables"].merge_patch(variables);
+    const korowa::SuggestionIndex& get(Session& session, const Options& options) {
+        if (built) return index;
+
+        static const std::vector<std::string> commands{
+            "bin", "oct", "dec", "hex",
+            //
+            "enable log", "disable log",
+            "help", "exit", "cls", "clear", "vars", "cl vars", "stats", "stats reset",
+            "use session", "snapshot", "rollback",
+            //
+            "deriv", "solve", "minimize", "integrate", "table", "seed", "approx",
+            //
+            "def", "run", "save", "load", "fuse"};
+
+        for (const auto* table : {&korowa::detail::functions(),
+                                  &korowa::detail::constants(),
+                                  &korowa::detail::generators()})
+            for (const auto& [name, spec] : *table) index.insert(name);
+
+        for (const auto& name : commands) index.insert(name);
+
+        probing = false;
+        if (options.enableVariables) {
+            if (session.variables().size() <= indexedVariables)
+                for (const auto& [name, value] : session.variables()) index.insert(std::string(name));
+            else
+                probing = true;
+        }
+
+        built = true;
+        return index;
+    }
+
+    void added(const std::string& name) {
+        if (built) index.insert(name);
+    }
+
+    void removed(const std::string& name) {
+        if (built) index.erase(name);
+    }
+
+    /// @brief Drops the index, it's built again on the next unknown token
+    void reset() {
+        index = {};
+        built = false;
+    }
+
+   private:
+    static constexpr size_t indexedVariables = size_t(1) << 14;  // more are probed
 
-    file.clear();
-    file.write(read.dump(4));
+    korowa::SuggestionIndex index{};
+    bool built = false;
+    bool probing = false;  // the session's variables aren't indexed
+};
+
+/**
+ * @brief Splits command call "name(a, b, ...)" into trimmed arguments.
+ * Commas nested in parentheses belong to the argument.
+ *
+ * @return false if buffer is not a call of name
+ */
+auto parseCommand(const std::string& buffer, const std::string& name,
+                  std::vector<std::string>& args) {
+    if (buffer.rfind(name + "(", 0) != 0 or buffer.back() != ')') return false;
+
+    args.assign(1, {});
+    int depth = 0;
+    for (size_t i = name.size() + 1; i + 1 < buffer.size(); ++i) {
+        const auto ch = buffer[i];
+        if (ch == ',' and depth == 0) {
+            args.emplace_back();
+            continue;
+        }
+        depth += (ch == '(' or ch == '[') - (ch == ')' or ch == ']');
+        args.back() += ch;
+    }
+    for (auto& arg : args) my::trim(arg);
+    return true;
 }
 
-auto removeVariable(const std::string& variable, const Options& options) {
-    if (!options.enableVariables) return;
-    my::File file(SESSION_FILE);
+/**
+ * @brief deriv(expression, variable[, point]): value and derivative in a single pass.
+ * Point overrides the session value of variable for this call only.
+ */
+auto differentiate(const std::vector<std::string>& args, Session& session,
+                   const Options& options, korowa::SyntaxError& err) {
+    if (args.size() != 2 and args.size() != 3) {
+        err = korowa::SyntaxError("Expected deriv(expression, variable[, point])",
+                                  korowa::SyntaxError::Type::Parsing);
+        return korowa::Tangent{};
+    }
 
-    if (!file.exists()) createDefaultSession(file);
+    auto variables = options.enableVariables ? session.variables()
+                                             : korowa::Variables{};
+    if (args.size() == 3) {
+        const auto point = korowa::eval(args[2], err, variables);
+        if (err) return korowa::Tangent{};
+        variables[args[1]] = point;
+    }
 
-    std::string buffer;
-    file.read(buffer);
-    auto read = nlohmann::json::parse(buffer);
+    return korowa::derivative(args[0], args[1], err, variables);
+}
+
+/**
+ * @brief solve, minimize and integrate commands: name(expression, variable, from, to).
+ * The expression is compiled once, bounds may be expressions themselves.
+ */
+auto runSolver(const std::string& name, const std::vector<std::string>& args, Session& session,
+               const Options& options, korowa::SyntaxError& err) {
+    if (args.size() != 4) {
+        err = korowa::SyntaxError(my::format("Expected {}(expression, variable, from, to)", name),
+                                  korowa::SyntaxError::Type::Parsing);
+        return korowa::Solution{};
+    }
+
+    auto variables = options.enableVariables ? session.variables()
+                                             : korowa::Variables{};
+    const auto from = korowa::eval(args[2], err, variables);
+    if (err) return korowa::Solution{};
+    const auto to = korowa::eval(args[3], err, variables);
+    if (err) return korowa::Solution{};
 
-    read["variables"].erase(variable);
+    auto f = korowa::objective(args[0], args[1], err, variables, floatMode(options));
+    if (err) return korowa::Solution{};
 
-    file.clear();
-    file.write(read.dump(4));
+    if (name == "solve") return korowa::solve(std::move(f), from, to, err);
+    if (name == "minimize") return korowa::minimize(std::move(f), from, to, err);
+    return korowa::integrate(std::move(f), from, to, err);
 }
 
-auto clearVariables(const Options& options) {
-    if (!options.enableVariables) return;
-    my::File file(SESSION_FILE);
+/**
+ * @brief approx(expression, variable, from, to, tolerance): builds or reuses the cached
+ * approximant of expression over [from, to]
+ */
+auto runApprox(const std::vector<std::string>& args, Session& session, const Options& options,
+               bool& cached, korowa::SyntaxError& err) {
+    if (args.size() != 5) {
+        err = korowa::SyntaxError("Expected approx(expression, variable, from, to, tolerance)",
+                                  korowa::SyntaxError::Type::Parsing);
+        return std::shared_ptr<const korowa::Approximant>{};
+    }
 
-    if (!file.exists()) createDefaultSession(file);
+    auto variables = options.enableVariables ? session.variables()
+                                             : korowa::Variables{};
+    double bounds[3];
+    for (size_t i = 0; i < 3; ++i) {
+        bounds[i] = korowa::eval(args[i + 2], err, variables);
+        if (err) return std::shared_ptr<const korowa::Approximant>{};
+    }
 
-    std::string buffer;
-    file.read(buffer);
-    auto read = nlohmann::json::parse(buffer);
+    const auto f = korowa::objective(args[0], args[1], err, variables, floatMode(options));
+    if (err) return std::shared_ptr<const korowa::Approximant>{};
+    return korowa::ApproximantCache::shared().get(f, bounds[0], bounds[1], bounds[2], err, cached);
+}
+
+/**
+ * @brief seed n, restarts random generators so rnd, rnorm and runif repeat
+ *
+ * @return false if buffer is not a seed command
+ */
+auto runSeed(const std::string& buffer, uint64_t& seed, korowa::SyntaxError& err) {
+    if (buffer.rfind("seed ", 0) != 0) return false;
+
+    auto value = buffer.substr(5);
+    my::trim(value);
+    char* end = nullptr;
+    seed = std::strtoull(value.c_str(), &end, 10);
+    if (value.empty() or *end != '\0' or value.front() == '-') {
+        err = korowa::SyntaxError("Expected seed followed by a non-negative integer",
+                                  korowa::SyntaxError::Type::Parsing);
+        return true;
+    }
+
+    korowa::random::seed(seed);
+    return true;
+}
+
+/**
+ * @brief vars [prefix] [page n], lists a page of the variables whose names start with prefix.
+ * Only the listed page is read from the session file, so it's quick for any number of them.
+ *
+ * @return false if buffer is not a vars command
+ */
+auto listVariables(const std::string& buffer, Session& session, korowa::SyntaxError& err) {
+    static constexpr size_t pageSize = 20;
+
+    std::string argument;
+    if (buffer == "vars" or buffer == "variables")
+        ;
+    else if (buffer.rfind("vars ", 0) == 0)
+        argument = buffer.substr(5);
+    else
+        return false;
+
+    size_t page = 1;
+    if (const auto at = (" " + argument).rfind(" page "); at != std::string::npos) {
+        auto number = argument.substr(at + 5);
+        my::trim(number);
+        char* end = nullptr;
+        page = std::strtoull(number.c_str(), &end, 10);
+        if (number.empty() or *end != '\0' or page == 0) {
+            err = korowa::SyntaxError("Expected vars [prefix] [page n] with n from 1",
+                                      korowa::SyntaxError::Type::Parsing);
+            return true;
+        }
+        argument.resize(at ? at - 1 : 0);
+    }
+    const auto prefix = my::trim(argument);
+
+    // one more than the page tells whether there's a next one
+    auto listed = session.variables().list(prefix, (page - 1) * pageSize, pageSize + 1);
+    const auto more = listed.size() > pageSize;
+    if (more) listed.pop_back();
+
+    if (listed.empty()) {
+        my::printcol("[#orange:No variables{}]\n\n", page > 1 ? " on this page" : "");
+        return true;
+    }
+    my::table(std::map<std::string, double>(listed.begin(), listed.end()), {{4, 0}}, {"(name)", "(value)"});
+    if (more)
+        my::printcol("[#878787:More with: vars {}{}page {}]\n\n", prefix, prefix.empty() ? "" : " ", page + 1);
+    return true;
+}
+
+/**
+ * @brief Formula library commands:
+ * def name = expression, run name, save file.kbc (defined and loaded formulas), load file.kbc
+ *
+ * @param res result message
+ * @return false if buffer is not a library command
+ */
+auto runLibraryCommand(const std::string& buffer, Session& session, const Options& options,
+                       std::string& res, korowa::SyntaxError& err) {
+    const auto space = buffer.find(' ');
+    const auto command = buffer.substr(0, space);
+    auto argument = space == std::string::npos ? std::string() : buffer.substr(space + 1);
+    my::trim(argument);
+
+    const auto isName = [](const std::string& name) {
+        return !name.empty() and std::isalpha((unsigned char)name.front()) and
+               std::all_of(name.begin(), name.end(),
+                           [](unsigned char ch) { return std::isalnum(ch) or ch == '_'; });
+    };
+    const auto fail = [&err](const std::string& message) {
+        err = korowa::SyntaxError(message, korowa::SyntaxError::Type::Parsing);
+        return true;
+    };
+
+    if (command == "def") {
+        const auto equals = argument.find('=');
+        auto name = argument.substr(0, equals);
+        my::trim(name);
+        if (equals == std::string::npos or !isName(name))
+            return fail("Expected def name = expression");
+
+        auto source = argument.substr(equals + 1);
+        my::trim(source);
+        auto program = korowa::compile(source, err);
+        if (err) return true;
+
+        session.defined()[name] = {source, korowa::optimize(program, floatMode(options))};
+        res = my::format("{} defined", name);
+        return true;
+    }
+
+    if (command == "save" or command == "load") {
+        if (argument.size() < 5 or argument.substr(argument.size() - 4) != ".kbc")
+            return fail(my::format("Expected {} file.kbc", command));
+
+        if (command == "load") {
+            auto library = korowa::Library::open(argument, err);
+            if (err) return true;
+            res = my::format("{} formulas loaded", library.size());
+            session.libraries().push_back(std::move(library));
+            return true;
+        }
+
+        std::vector<korowa::LibraryEntry> entries;
+        for (const auto& library : session.libraries())
+            for (uint32_t i = 0; i < library.size(); ++i)
+                if (korowa::Formula formula; library.at(i, formula))
+                    entries.push_back({std::string(formula.name), std::string(formula.source),
+                                       formula.toProgram()});
+        for (const auto& [name, formula] : session.defined())
+            entries.push_back({name, formula.source, formula.program});
+
+        const auto saved = korowa::saveLibrary(argument, std::move(entries), err);
+        if (!err) res = my::format("{} formulas saved", saved);
+        return true;
+    }
+
+    // run without a formula name may be an expression with a variable named run
+    if (command != "run" or !isName(argument)) return false;
+
+    korowa::ProgramView program;
+    std::vector<double> slots;
+    std::string assignTo;
+
+    const auto& libraries = session.libraries();
+    korowa::Formula formula;
+    if (auto it = session.defined().find(argument); it != session.defined().end()) {
+        program = it->second.program.view();
+        assignTo = it->second.program.assignTo;
+        if (!it->second.program.symbols.empty() or !assignTo.empty()) {
+            if (!options.enableVariables) return fail("Variables disabled in config file");
+            slots = korowa::bindVariables(it->second.program, session.variables(), err);
+        }
+    } else if (std::any_of(libraries.rbegin(), libraries.rend(),
+                           [&](const auto& library) { return library.find(argument, formula); })) {
+        program = formula.program;
+        assignTo = formula.assignTo;
+        if (formula.symbolCount or !assignTo.empty()) {
+            if (!options.enableVariables) return fail("Variables disabled in config file");
+            slots = korowa::bindVariables(formula, session.variables(), err);
+        }
+    } else {
+        err = korowa::SyntaxError(korowa::SyntaxError::Code::UnknownFormula, argument);
+        return true;
+    }
+    if (err) return true;
+
+    KOROWA_STATS_ADD(Evaluations, 1);
+    const auto result = korowa::execute(program, slots.data());
+    if (!assignTo.empty()) {
+        session.variables()[assignTo] = result;
+        session.save();
+    }
+    res = getStyled(result, options);
+    return true;
+}
+
+/**
+ * @brief Session commands: use session [name], snapshot, rollback.
+ * A snapshot shares the variables with the session, so it's cheap for any number of them.
+ *
+ * @param res result message
+ * @return false if buffer is not a session command
+ */
+auto runSessionCommand(const std::string& buffer, Session& session, const Options& options,
+                       std::string& res, korowa::SyntaxError& err) {
+    const auto use = buffer == "use session" or buffer.rfind("use session ", 0) == 0;
+    if (!use and buffer != "snapshot" and buffer != "rollback") return false;
+
+    if (!options.enableVariables) {
+        err = korowa::SyntaxError("Variables disabled in config file");
+        return true;
+    }
+
+    if (use) {
+        auto name = buffer.substr(11);
+        my::trim(name);
+        if (name.empty()) {
+            res = my::format("Session: {}", session.name());
+            return true;
+        }
+        if (!validSessionName(name)) {
+            err = korowa::SyntaxError("Expected use session name, of letters, digits, _ and -",
+                                      korowa::SyntaxError::Type::Parsing);
+            return true;
+        }
+        session.use(name);
+        res = my::format("Session: {}", name);
+        return true;
+    }
+
+    if (buffer == "snapshot") {
+        res = my::format("Session {}: snapshot {} taken", session.name(), session.snapshot());
+        return true;
+    }
+
+    const auto left = session.rollback();
+    if (left == std::string::npos) {
+        err = korowa::SyntaxError(my::format("Session {} has no snapshot to roll back to", session.name()));
+        return true;
+    }
+    res = my::format("Session {}: rolled back to snapshot {}", session.name(), left + 1);
+    return true;
+}
+
+/**
+ * @brief fuse expression; expression; ... evaluates the expressions in one pass,
+ * shared subexpressions are computed once
+ *
+ * @param res results separated by "; "
+ * @param fused merged programs, for the node count
+ * @return false if buffer is not a fuse command
+ */
+auto runFuse(const std::string& buffer, Session& session, const Options& options,
+             std::string& res, korowa::FusedProgram& fused, korowa::SyntaxError& err) {
+    if (buffer.rfind("fuse ", 0) != 0) return false;
+
+    std::vector<korowa::Program> programs;
+    std::stringstream ss(buffer.substr(5));
+    for (std::string source; std::getline(ss, source, ';');) {
+        my::trim(source);
+        if (source.empty()) continue;
+        const auto program = korowa::compile(source, err);
+        if (err) return true;
+        programs.push_back(korowa::optimize(program, floatMode(options)));
+    }
+    if (programs.empty()) {
+        err = korowa::SyntaxError("Expected fuse expression; expression; ...",
+                                  korowa::SyntaxError::Type::Parsing);
+        return true;
+    }
+
+    const auto assigns = std::any_of(programs.begin(), programs.end(),
+                                     [](const auto& program) { return !program.assignTo.empty(); });
+    fused = korowa::fuse(programs);
+
+    std::vector<double> slots;
+    if (!fused.symbols.empty() or assigns) {
+        if (!options.enableVariables) {
+            err = korowa::SyntaxError("Variables disabled in config file",
+                                      korowa::SyntaxError::Type::Evaluation);
+            return true;
+        }
+        slots = korowa::bindVariables(fused, session.variables(), err);
+        if (err) return true;
+    }
+
+    KOROWA_STATS_ADD(Evaluations, programs.size());
+    std::vector<double> results(programs.size()), scratch;
+    korowa::execute(fused, slots.data(), results.data(), scratch);
+
+    for (size_t i = 0; i < programs.size(); ++i) {
+        res += (i ? "; " : "") + getStyled(results[i], options);
+        if (!programs[i].assignTo.empty()) session.variables()[programs[i].assignTo] = results[i];
+    }
+    if (assigns) session.save();
+    return true;
+}
 
-    read["variables"].clear();
+/**
+ * @brief Tabulates f over grid into path, stdout if path is empty
+ */
+template <class Function>
+auto writeTable(const Function& f, const korowa::Grid& grid, const std::string& path,
+                korowa::TableReport& report, korowa::SyntaxError& err) {
+    if (path.empty()) {
+        report = korowa::tabulate(f, grid, std::cout, korowa::TableFormat::Csv, err);
+        return true;
+    }
 
-    file.clear();
-    file.write(read.dump(4));
+    const auto binary = path.size() > 4 and path.compare(path.size() - 4, 4, ".bin") == 0;
+    std::vector<char> fileBuffer(1 << 20);
+    std::ofstream file;
+    file.rdbuf()->pubsetbuf(fileBuffer.data(), fileBuffer.size());
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        err = korowa::SyntaxError(my::format("Unable to open {}", path), korowa::SyntaxError::Type::Io);
+        return true;
+    }
+
+    report = korowa::tabulate(f, grid, file,
+                              binary ? korowa::TableFormat::Binary : korowa::TableFormat::Csv, err);
+    return true;
 }
 
+/**
+ * @brief table expression for x = from..to [step s] [strict|fast|approx] [within tolerance]
+ * [to file.csv|file.bin]
+ * Streams the whole grid to the file (stdout without one), memory use doesn't grow with it.
+ * The accuracy word overrides mathAccuracy of the config file, within evaluates the cached
+ * approximant of expression over [from, to] instead of the expression.
+ *
+ * @return false if buffer is not a table command
+ */
+auto runTable(const std::string& buffer, Session& session, const Options& options,
+              korowa::TableReport& report, korowa::SyntaxError& err) {
+    if (buffer.rfind("table ", 0) != 0) return false;
+
+    const auto malformed = [&err] {
+        err = korowa::SyntaxError("Expected table expression for x = from..to [step s] "
+                                  "[strict|fast|approx] [within tolerance] [to file]",
+                                  korowa::SyntaxError::Type::Parsing);
+        return true;
+    };
+
+    const auto forAt = buffer.rfind(" for ");
+    if (forAt == std::string::npos) return malformed();
+    auto expression = buffer.substr(6, forAt - 6);
+    auto range = buffer.substr(forAt + 5);
+
+    std::string path, step = "1";
+    if (const auto at = range.find(" to "); at != std::string::npos) {
+        path = range.substr(at + 4);
+        range.resize(at);
+    }
+    std::string within;
+    if (const auto at = range.find(" within "); at != std::string::npos) {
+        within = range.substr(at + 8);
+        range.resize(at);
+    }
+    auto mode = accuracy(options);
+    static const std::pair<std::string, korowa::Accuracy> accuracies[]{
+        {" strict", korowa::Accuracy::Strict},
+        {" fast", korowa::Accuracy::Fast},
+        {" approx", korowa::Accuracy::Approx}};
+    for (const auto& [word, chosen] : accuracies)
+        if (range.size() > word.size() and range.compare(range.size() - word.size(), word.size(), word) == 0) {
+            mode = chosen;
+            range.resize(range.size() - word.size());
+        }
+    if (const auto at = range.find(" step "); at != std::string::npos) {
+        step = range.substr(at + 6);
+        range.resize(at);
+    }
+
+    const auto equals = range.find('='), dots = range.find("..");
+    if (equals == std::string::npos or dots == std::string::npos or dots < equals)
+        return malformed();
+    auto variable = range.substr(0, equals);
+    auto from = range.substr(equals + 1, dots - equals - 1), to = range.substr(dots + 2);
+    for (auto* part : {&expression, &variable, &from, &to, &step, &path, &within}) my::trim(*part);
+
+    auto variables = options.enableVariables ? session.variables()
+                                             : korowa::Variables{};
+    double bounds[3];
+    for (size_t i = 0; i < 3; ++i) {
+        bounds[i] = korowa::eval(i == 0 ? from : i == 1 ? to : step, err, variables);
+        if (err) return true;
+    }
+    const auto grid = korowa::Grid::between(bounds[0], bounds[1], bounds[2], err);
+    if (err) return true;
+
+    auto f = korowa::objective(expression, variable, err, variables, floatMode(options));
+    if (err) return true;
+    f.accuracy = mode;
+
+    if (!within.empty()) {
+        const auto tolerance = korowa::eval(within, err, variables);
+        if (err) return true;
+        bool cached;
+        auto approximant = korowa::ApproximantCache::shared().get(
+            f, std::min(bounds[0], bounds[1]), std::max(bounds[0], bounds[1]), tolerance, err, cached);
+        if (err) return true;
+        return writeTable(korowa::Approximated(std::move(f), std::move(approximant)), grid, path,
+                          report, err);
+    }
+    return writeTable(f, grid, path, report, err);
+}
+
+
 template <class T>
 auto logToFile(my::File& file, Options& options,
                const std::string& buffer, const T& res) {
     if (options.logEnabled) {
+        KOROWA_STATS_TIMER(Log);
         my::setcol(std::cerr, my::Color::Red);  // to make all file error messages red
 
         if (!file.writef("{} > {}\n",
@@ -193,10 +1019,197 @@ auto logToFile(my::File& file, Options& options,
     }
 }
 
+/**
+ * @brief Capture file, one json object per line:
+ * {"expression": "x * 2", "variables": {"x": 4}, "result": 8, "error": "", "ns": [tokenize, parse, evaluate]}
+ * variables is null when there was no session, results and values out of json range are strings.
+ * Expressions giving arrays (see producesArray) aren't recorded, a record holds one result
+ * and --replay compares only scalars.
+ */
+class Recorder {
+   public:
+    explicit Recorder(const std::string& path) {
+        if (!path.empty()) file.open(path, std::ios::app);
+    }
+
+    /**
+     * @brief Evaluates scalar expression, integer-only ones exactly, and records it if capturing
+     *
+     * @param variables saved variables, nullptr if the expression doesn't need them
+     */
+    korowa::Exact evaluate(const std::string& expression, korowa::SyntaxError& err,
+                           korowa::Variables* variables) {
+        if (!file.is_open())
+            return korowa::evalPreferExact(expression, err, variables);  // <- here all hot stuff happens
+
+        const auto record = korowa::capture(expression, err, variables);
+        file << toJson(record).dump() << '\n';
+        return record.exact;
+    }
+
+    static nlohmann::json toJson(const korowa::Capture& record) {
+        nlohmann::json line;
+        line["expression"] = record.expression;
+        line["variables"] = nullptr;
+        if (record.session) {
+            line["variables"] = nlohmann::json::object();
+            for (const auto& [name, value] : record.variables) line["variables"][name] = number(value);
+        }
+        line["result"] = number(record.result);
+        line["error"] = record.error;
+        line["ns"] = {record.timings.tokenize, record.timings.parse, record.timings.evaluate};
+        return line;
+    }
+
+    /// @brief Record of a line of the capture file, throws nlohmann::json::exception if it isn't one
+    static korowa::Capture fromJson(const nlohmann::json& line) {
+        korowa::Capture record;
+        record.expression = line.at("expression").get<std::string>();
+        record.session = !line.at("variables").is_null();
+        if (record.session)
+            for (const auto& [name, value] : line["variables"].items()) record.variables[name] = number(value);
+        record.result = number(line.at("result"));
+        record.error = line.value("error", "");
+        if (const auto& ns = line.value("ns", nlohmann::json::array()); ns.size() == 3)
+            record.timings = {ns[0].get<uint64_t>(), ns[1].get<uint64_t>(), ns[2].get<uint64_t>()};
+        return record;
+    }
+
+   private:
+    // json has no NaN and infinities
+    static nlohmann::json number(double value) {
+        if (std::isfinite(value)) return value;
+        return std::isnan(value) ? "nan" : value > 0 ? "inf" : "-inf";
+    }
+
+    static double number(const nlohmann::json& value) {
+        return value.is_number() ? value.get<double>() : std::stod(value.get<std::string>());
+    }
+
+    std::ofstream file{};
+};
+
+/**
+ * @brief What a line did, the REPL and -e show it each in their own way
+ */
+struct Reply {
+    std::string result{};      // shown after :: by the REPL, alone by -e
+    std::string detail{};      // cost or size, shown in grey below the result by the REPL only
+    int color = 0x71db00;      // of the result in the REPL
+    bool notice = false;       // a confirmation the REPL shows in orange, -e and the log don't
+    std::string added{};       // variable the line assigned for the first time
+};
+
+/**
+ * @brief Runs a command or evaluates an expression, for the REPL and for -e alike
+ *
+ * @param err occurred error reference, reply is empty then
+ */
+auto dispatch(const std::string& buffer, Session& session, const Options& options,
+              Recorder& recorder, korowa::SyntaxError& err) {
+    Reply reply;
+
+    if (std::vector<std::string> args; parseCommand(buffer, "deriv", args)) {
+        const auto tangent = differentiate(args, session, options, err);
+        if (!err)
+            reply.result = my::format("{}, d/d{} = {}", getStyled(tangent.value, options), args[1],
+                                      getStyled(tangent.derivative, options));
+        return reply;
+    }
+
+    if (runSessionCommand(buffer, session, options, reply.result, err)) return reply;
+    if (runLibraryCommand(buffer, session, options, reply.result, err)) return reply;
+
+    if (korowa::FusedProgram fused; runFuse(buffer, session, options, reply.result, fused, err)) {
+        reply.detail = my::format("{} nodes for {} instructions", fused.nodes.size(), fused.instructions);
+        return reply;
+    }
+
+    if (uint64_t seed; runSeed(buffer, seed, err)) {
+        reply.result = my::format("Random generators seeded with {}", seed);
+        reply.notice = true;
+        return reply;
+    }
+
+    if (korowa::TableReport report; runTable(buffer, session, options, report, err)) {
+        if (err) return reply;
+        reply.result = my::format("{} rows, {} bytes", report.rows, report.bytes);
+        if (report.failedRows)
+            reply.result += my::format(", {} undefined from row {}", report.failedRows, report.firstFailed);
+        reply.detail = my::format("{} ms", std::round(report.milliseconds * 1000) / 1000);
+        return reply;
+    }
+
+    if (std::vector<std::string> args; parseCommand(buffer, "approx", args)) {
+        bool cached = false;
+        const auto approximant = runApprox(args, session, options, cached, err);
+        if (err) return reply;
+        reply.result = my::format("{} pieces of degree {}, max error {}", approximant->pieces,
+                                  approximant->degree, approximant->maxError);
+        reply.detail = cached ? std::string("cached") : my::format("{} samples", approximant->samples);
+        return reply;
+    }
+
+    if (std::vector<std::string> args; parseCommand(buffer, "solve", args) or
+                                       parseCommand(buffer, "minimize", args) or
+                                       parseCommand(buffer, "integrate", args)) {
+        const auto name = buffer.substr(0, buffer.find('('));
+        const auto solution = runSolver(name, args, session, options, err);
+        if (err) return reply;
+        reply.result =
+            name == "integrate"
+                ? my::format("{} (error {})", getStyled(solution.value, options),
+                             getStyled(solution.error, options))
+                : my::format("{} = {}, {} = {}", args[1], getStyled(solution.x, options),
+                             name == "solve" ? "f(" + args[1] + ")" : "min",
+                             getStyled(solution.value, options));
+        reply.detail = my::format("{} evaluations, {} ms", solution.evaluations,
+                                  std::round(solution.milliseconds * 1000) / 1000);
+        return reply;
+    }
+
+    // conversion routine
+    if (options.enableConverters) {
+        auto convertError = korowa::SyntaxError();
+        const auto converted = korowa::convert(buffer, convertError);  // <- small subroutine for converting between different systems
+
+        if (convertError.type() != korowa::SyntaxError::Type::Parsing) {
+            err = convertError;
+            if (!err) reply.result = converted;
+            reply.color = 0xcf760a;
+            return reply;
+        }
+    }
+
+    // eval routine
+    auto* variables = session.neededFor(buffer) ? &session.variables() : nullptr;
+    const auto prevVarsSize = variables ? variables->size() : 0;
+
+    if (producesArray(buffer)) {
+        // not captured, see Recorder
+        const auto array = variables ? korowa::evalArray(buffer, err, *variables)
+                                     : korowa::evalArray(buffer, err);
+        if (!err) reply.result = getStyled(array, options);
+    } else {
+        // integer-only expressions are exact, everything else goes through eval
+        const auto result = recorder.evaluate(buffer, err, variables);
+        if (!err) reply.result = getStyled(result, options);
+    }
+    if (err) return reply;
+
+    if (variables) session.save();
+    if (variables and variables->size() != prevVarsSize) {
+        auto name = buffer.substr(0, buffer.find('='));
+        reply.added = my::trim(name);
+    }
+    return reply;
+}
+
 auto printHelp(const Options& options) {
     my::printcol(R"(
         [#f0b000:The list of supported operators:]
         +, -, /, *, % (modulus), ^ or ** (power), ! (factorial);
+        <, <=, >, >=, ==, !=, && (and), || (or) - 1 if true, 0 if false;
 
         [#f0b000:The list of supported functions:]
             [#f0b000:>] unary: sqrt, cbrt, 
@@ -205,8 +1218,15 @@ auto printHelp(const Options& options) {
                      asin,  acos,  atan,  actan, 
                      sinh,  cosh,  tanh,  ctanh,
                      asinh, acosh, atanh, actanh,
-                     sinc, fact, abs, ceil, floor, round, trunc
-            [#f0b000:>] binary: log, min, max, gcd, lcm
+                     sinc, fact, abs, ceil, floor, round, trunc, step,
+                     sum, len, sort,
+                     isprime, nextprime, nthprime, primepi, factor
+            [#f0b000:>] binary: log, min, max, gcd, lcm, dot,
+                     runif (uniform random number [a, b))
+            [#f0b000:>] ternary: if(condition, a, b), clamp(x, low, high)
+
+        [#f0b000:Arrays:] [1, 2, 3] - operators and functions apply element-wise
+            Example: sum(sqrt([1, 4, 9]) * 2), dot([1, 2], [3, 4]), sort([3, -1, 2])
 
         [#f0b000:The list of supported constants:] 
             [#f0b000:>] pi:  3.1415926535897932384
@@ -215,7 +1235,9 @@ auto printHelp(const Options& options) {
             [#f0b000:>] phi: 1.6180339887498948482
 
         [#f0b000:The list of supported generators:] 
-            [#f0b000:>] rnd: random number [0, 1]
+            [#f0b000:>] rnd: random number [0, 1)
+            [#f0b000:>] rnorm: normally distributed random number
+            [#f0b000:>] prime: random prime below 2^31
             [#f0b000:>] time: time in milliseconds since epoch
 
         [#f0b000:!Usage example:] 
@@ -239,9 +1261,11 @@ auto printHelp(const Options& options) {
             [#f0b000:>] To assign expression to variable use ()
                 Example: x = (9! * 0.001)
                          x = (x * 42)
-            [#f0b000:>] To checkout variables table: type vars
+            [#f0b000:>] To checkout variables table: type vars [prefix] [page n]
             [#f0b000:>] To clear variables: type cl vars
             [#f0b000:>] To remove variable: type rm name
+            [#f0b000:>] To switch to another set of variables: type use session name (default is the first one)
+            [#f0b000:>] To try changes and undo them: type snapshot, then rollback
 
 )");
     my::printcol(R"(
@@ -250,16 +1274,291 @@ auto printHelp(const Options& options) {
         To exit: type exit
         To get help: type help
         To enable log: type enable log
-        To disable log: type disable log]
+        To disable log: type disable log
+        To see hot path statistics: type stats (reset with stats reset)
+        To differentiate: deriv(expression, variable[, point]), e.g. deriv(x^2 * sin(x), x, pi)
+        To find root, minimum or integral: solve|minimize|integrate(expression, variable, from, to)
+        To tabulate: table expression for x = from..to [step s] [strict | fast | approx] [within tolerance]
+                     [to file.csv | file.bin]
+        To approximate on a range: approx(expression, variable, from, to, tolerance), reused by table ... within
+        To repeat random numbers: seed n
+        To keep compiled formulas: def name = expression, run name, save file.kbc, load file.kbc
+        To evaluate related formulas in one pass: fuse expression; expression; ...
+        To evaluate and exit: start with -e "expression" (repeatable), -q to skip banner and help
+        To evaluate an expression of any size and exit: start with -f file (- reads stdin)
+        To record evaluations: start with --capture file.jsonl (or set captureFile in config)
+        To start in another session: start with --session name (or set session in config)
+        To replay them, verify results and time every stage: start with --replay file.jsonl [--repeat n]
+        To run as evaluation server: start with --serve [port | socket path]]
 
 )");
 }
 
-auto main() -> int {
+auto dumpStats(const Options& options) {
+    std::ofstream file(options.statsFile);
+    korowa::stats::dumpJson(file);
+}
+
+auto serve(const Options& options, const std::string& endpoint) {
+    korowa::Server::Config config;
+    config.endpoint = endpoint;
+    config.framing = options.serverFraming == "length" ? korowa::Framing::Length
+                                                       : korowa::Framing::Line;
+    config.enableVariables = options.enableVariables;
+    if (options.serverWorkers) config.workers = options.serverWorkers;
+
+    korowa::Server server(config, readVariables(options.session, options));
+
+    auto error = korowa::SyntaxError();
+    if (!server.listen(error)) {
+        my::printcol("[#red:Error occurred: \"{}\"\n\n]", error);
+        return 1;
+    }
+
+    my::printcol("[#f0b000:Listening on {} ({} workers, {} framing)]\n\n",
+                 config.endpoint, config.workers, options.serverFraming);
+
+    // the server usually ends by being killed, so stats are rewritten while it runs
+    std::mutex statsMutex;
+    std::condition_variable statsWake;
+    bool serving = true;
+    std::thread statsWriter;
+    if (korowa::stats::enabled)
+        statsWriter = std::thread([&] {
+            std::unique_lock lock(statsMutex);
+            while (not statsWake.wait_for(lock, std::chrono::seconds(5), [&] { return not serving; }))
+                dumpStats(options);
+        });
+
+    server.run();
+
+    if (statsWriter.joinable()) {
+        {
+            std::lock_guard lock(statsMutex);
+            serving = false;
+        }
+        statsWake.notify_one();
+        statsWriter.join();
+        dumpStats(options);
+    }
+    return 0;
+}
+
+/**
+ * @brief One-shot mode: evaluates every -e expression, prints plain results and exits.
+ * Nothing but the config is touched unless an expression may reference variables.
+ */
+auto evaluateOnce(const Options& options, const std::vector<std::string>& expressions) {
+    Session session(options);
+    Recorder recorder(options.captureFile);
+    int status = 0;
+
+    for (const auto& expression : expressions) {
+        auto err = korowa::SyntaxError();
+        const auto reply = dispatch(expression, session, options, recorder, err);
+
+        if (err) {
+            my::printf(std::cerr, "Error occurred: \"{}\"\n", err);
+            status = 1;
+            continue;
+        }
+        if (!reply.notice) my::printf("{}\n", reply.result);
+    }
+
+    if (korowa::stats::enabled) dumpStats(options);
+    return status;
+}
+
+/**
+ * @brief One-shot mode for expressions too large for a line, e.g. generated ones: the file is
+ * compiled while it's read, so only the compiled program has to fit in memory.
+ *
+ * @param path file holding one expression, line breaks are blanks, - reads stdin
+ */
+auto evaluateFile(const Options& options, const std::string& path) {
+    auto err = korowa::SyntaxError();
+    korowa::Program program;
+    try {
+        if (path == "-") {
+            program = korowa::compile(std::cin, err);
+        } else if (std::ifstream file(path, std::ios::binary); file) {
+            program = korowa::compile(file, err);
+        } else {
+            err = korowa::SyntaxError(my::format("Unable to open {}", path), korowa::SyntaxError::Type::Io);
+        }
+    } catch (const std::bad_alloc&) {
+        program = {};
+        err = korowa::SyntaxError(my::format("Not enough memory to compile {}", path),
+                                  korowa::SyntaxError::Type::Evaluation);
+    }
+
+    Session session(options);
+    std::vector<double> slots;
+    if (!err and (!program.symbols.empty() or !program.assignTo.empty())) {
+        if (!options.enableVariables)
+            err = korowa::SyntaxError("Variables disabled in config file",
+                                      korowa::SyntaxError::Type::Evaluation);
+        else
+            slots = korowa::bindVariables(program, session.variables(), err);
+    }
+    if (err) {
+        my::printf(std::cerr, "Error occurred: \"{}\"\n", err);
+        return 1;
+    }
+
+    KOROWA_STATS_ADD(Evaluations, 1);
+    const auto result = korowa::execute(program, slots.data());
+    if (!program.assignTo.empty()) {
+        session.variables()[program.assignTo] = result;
+        session.save();
+    }
+    my::printf("{}\n", getStyled(result, options));
+    return 0;
+}
+
+auto percentile(const std::vector<uint64_t>& sorted, double p) {
+    if (sorted.empty()) return uint64_t(0);
+    return sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+}
+
+/// @brief Result or error as compared by replay, results with every digit
+auto outcomeOf(const korowa::Capture& record) {
+    if (!record.error.empty()) return my::format("error \"{}\"", record.error);
+    std::ostringstream ss;
+    ss << std::setprecision(17) << record.result;
+    return ss.str();
+}
+
+/**
+ * @brief Replay mode: evaluates every captured expression again, repeat times, on its recorded
+ * variables. Results are verified on the first run, timings of all runs make the latency
+ * distribution of every stage, printed next to the captured one.
+ *
+ * @param path capture file, see Recorder
+ * @return 1 if a result differs or the file can't be read
+ */
+auto replay(const std::string& path, size_t repeat) {
+    std::ifstream file(path);
+    if (!file) {
+        my::printf(std::cerr, "Error occurred: \"Unable to open {}\"\n", path);
+        return 1;
+    }
+
+    std::vector<korowa::Capture> captured;
+    std::string line;
+    for (size_t number = 1; std::getline(file, line); ++number) {
+        if (my::trim(line).empty()) continue;
+        try {
+            captured.push_back(Recorder::fromJson(nlohmann::json::parse(line)));
+        } catch (const std::exception& e) {
+            my::printf(std::cerr, "Error occurred: \"{}:{}: {}\"\n", path, number, e.what());
+            return 1;
+        }
+    }
+
+    constexpr size_t stages = 3;
+    const char* names[stages]{"tokenize", "parse", "evaluate"};
+    const auto stage = [](const korowa::Timings& timings, size_t i) {
+        return i == 0 ? timings.tokenize : i == 1 ? timings.parse : timings.evaluate;
+    };
+
+    std::vector<uint64_t> before[stages], after[stages];
+    std::vector<std::pair<uint64_t, size_t>> slowest;  // best total of the runs, record
+    size_t verified = 0, random = 0;
+    std::vector<std::pair<size_t, korowa::Capture>> mismatched;
+
+    for (size_t i = 0; i < captured.size(); ++i) {
+        const auto& record = captured[i];
+        for (size_t s = 0; s < stages; ++s) before[s].push_back(stage(record.timings, s));
+
+        const auto checked = korowa::deterministic(record.expression);
+        uint64_t best = UINT64_MAX;
+        for (size_t run = 0; run < repeat; ++run) {
+            const auto again = korowa::replay(record);
+            for (size_t s = 0; s < stages; ++s) after[s].push_back(stage(again.timings, s));
+            best = std::min(best, again.timings.total());
+
+            if (run or !checked) continue;
+            if (korowa::sameOutcome(record, again))
+                ++verified;
+            else
+                mismatched.emplace_back(i, again);
+        }
+        random += !checked;
+        slowest.emplace_back(best, i);
+    }
+
+    my::printf("replayed:     {} expressions, {} runs each\n", captured.size(), repeat);
+    my::printf("verified:     {} same, {} different, {} random not verified\n", verified,
+               mismatched.size(), random);
+    for (size_t s = 0; s < stages; ++s) {
+        std::sort(before[s].begin(), before[s].end());
+        std::sort(after[s].begin(), after[s].end());
+        my::printf("{} ns:{}p50 {} | p90 {} | p99 {} | max {} (captured p50 {} | p99 {})\n", names[s],
+                   std::string(10 - std::strlen(names[s]), ' '), percentile(after[s], 0.5),
+                   percentile(after[s], 0.9), percentile(after[s], 0.99),
+                   after[s].empty() ? 0 : after[s].back(), percentile(before[s], 0.5),
+                   percentile(before[s], 0.99));
+    }
+
+    std::sort(slowest.rbegin(), slowest.rend());
+    slowest.resize(std::min<size_t>(slowest.size(), 5));
+    if (!slowest.empty()) my::printf("\nslowest (best of runs, captured):\n");
+    for (const auto& [best, i] : slowest)
+        my::printf("    {} ns, {} ns: {}\n", best, captured[i].timings.total(), captured[i].expression);
+
+    if (!mismatched.empty()) my::printf("\ndifferent:\n");
+    for (size_t i = 0; i < std::min<size_t>(mismatched.size(), 10); ++i) {
+        const auto& [index, again] = mismatched[i];
+        my::printf("    {}: captured {}, replayed {}\n", captured[index].expression,
+                   outcomeOf(captured[index]), outcomeOf(again));
+    }
+
+    return mismatched.empty() ? 0 : 1;
+}
+
+auto main(int argc, char** argv) -> int {
+    KOROWA_STATS_START(startup);
+
     SET_CONSOLE_VT_MODE();
     SET_UTF8_CONSOLE_CP();
 
     Options options{};
+    if (!validSessionName(options.session)) options.session = "default";
+
+    const std::vector<std::string> args(argv + 1, argv + argc);
+
+    if (!args.empty() and args[0] == "--serve")
+        return serve(options, args.size() > 1 ? args[1] : options.serverEndpoint);
+
+    if (!args.empty() and args[0] == "--replay" and args.size() > 1) {
+        const auto repeat = args.size() > 3 and args[2] == "--repeat" ? std::stoul(args[3]) : 1;
+        return replay(args[1], std::max<size_t>(repeat, 1));
+    }
+
+    std::vector<std::string> oneShot, files;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i] == "-e" and i + 1 < args.size()) {
+            oneShot.push_back(args[++i]);
+        } else if (args[i] == "-f" and i + 1 < args.size()) {
+            files.push_back(args[++i]);
+        } else if (args[i] == "--capture" and i + 1 < args.size()) {
+            options.captureFile = args[++i];
+        } else if (args[i] == "--session" and i + 1 < args.size()) {
+            if (validSessionName(args[i + 1])) options.session = args[i + 1];
+            ++i;
+        } else if (args[i] == "-q" or args[i] == "--no-banner") {
+            options.showWelcomeScreen = false;
+            options.alwaysShowHelp = false;
+        }
+    }
+
+    if (!oneShot.empty() or !files.empty()) {
+        KOROWA_STATS_STOP(Startup, startup);
+        auto status = oneShot.empty() ? 0 : evaluateOnce(options, oneShot);
+        for (const auto& path : files) status |= evaluateFile(options, path);
+        return status;
+    }
 
     const auto welcomeBanner = R"([#f0b000:
                  ┌─────────────────────────────────┐
@@ -310,22 +1609,6 @@ auto main() -> int {
         press any key to exit...
 )";
 
-    const std::vector<std::string> tokens{
-        "sqrt", "cbrt",
-        "ln", "lg", "exp",
-        "sin", "cos", "tan", "ctan", "asin", "acos", "atan", "actan",
-        "sinh", "cosh", "tanh", "ctanh", "asinh", "acosh", "atanh", "actanh",
-        "fact", "abs", "ceil", "floor", "round", "trunc",
-        //
-        "log", "min", "max", "gcd", "lcm",
-        //
-        "bin", "oct", "dec", "hex",
-        //
-        "pi", "phi", "tau", "e", "rnd",
-        //
-        "enable log", "disable log",
-        "help", "exit", "cls", "clear", "vars", "cl vars"};
-
     if (options.showWelcomeScreen)
         my::printcol(welcomeBanner);
 
@@ -342,15 +1625,35 @@ auto main() -> int {
         my::resetcol(std::cerr);
     }
 
-    auto variables = readVariables(options);
+    Session session(options);
+    Suggestions suggestions;
+    Recorder recorder(options.captureFile);
+
+    // random expressions aren't previewed, that would use up the numbers of a seeded sequence,
+    // and neither are the ones which would block typing, the preview runs on every key
+    const korowa::Variables noVariables;
+    korowa::LineEditor editor([&](const korowa::IncrementalExpression& expression) -> std::string {
+        if (expression.error() or not expression.deterministic() or producesArray(expression.text()) or
+            slowToEvaluate(expression))
+            return "";
+        auto err = korowa::SyntaxError();
+        const auto& known = session.neededFor(expression.text()) ? session.variables() : noVariables;
+        // the same value the line prints once entered
+        const auto result = expression.evaluatePreferExact(err, known);
+        return err ? "" : "= " + getStyled(result, options);
+    });
+    const auto live = options.livePreview and korowa::LineEditor::available();
 
     std::string buffer;
 
-    for (;;) {
-        size_t prevVarsSize = variables.size();
+    KOROWA_STATS_STOP(Startup, startup);
 
+    for (;;) {
         my::printcol(options.inputSign.c_str());
-        std::getline(std::cin, buffer);
+        if (!live)
+            std::getline(std::cin, buffer);
+        else if (!editor.readLine(buffer))
+            buffer = "exit";
         my::trim(buffer);
 
         // commands
@@ -358,6 +1661,20 @@ auto main() -> int {
 
         if (buffer == "exit") break;
 
+        if (buffer == "stats" or buffer == "stats reset") {
+            if (!korowa::stats::enabled) {
+                my::printcol("[#orange:Statistics are compiled out (build with -DKOROWA_ENABLE_STATS)]\n\n");
+                continue;
+            }
+            if (buffer == "stats reset") {
+                korowa::stats::reset();
+                my::printcol("[#orange:Statistics: cleared]\n\n");
+                continue;
+            }
+            korowa::stats::print();
+            continue;
+        }
+
         if (buffer == "help") {
             printHelp(options);
             continue;
@@ -369,12 +1686,14 @@ auto main() -> int {
             continue;
         }
 
-        if (buffer == "vars" or buffer == "variables") {
+        if (buffer == "vars" or buffer == "variables" or buffer.rfind("vars ", 0) == 0) {
             if (!options.enableVariables) {
                 my::printcol("[#orange:Variables disabled in config file]\n\n");
                 continue;
             }
-            my::table(variables, {{4, 0}}, {"(name)", "(value)"});
+            auto err = korowa::SyntaxError();
+            listVariables(buffer, session, err);
+            if (err) my::printcol("[#red:Error occurred: \"{}\"\n\n]", err);
             continue;
         }
 
@@ -383,8 +1702,9 @@ auto main() -> int {
                 my::printcol("[#orange:Variables disabled in config file]\n\n");
                 continue;
             }
-            variables.clear();
-            clearVariables(options);
+            suggestions.reset();
+            session.variables().clear();
+            session.save();
             my::printcol("[#orange:Variables: cleared]\n\n");
             continue;
         }
@@ -398,11 +1718,13 @@ auto main() -> int {
             auto tmp = buffer.substr(3);
             const auto name = my::trim(tmp);
 
+            auto& variables = session.variables();
             if (auto it = variables.find(name); it != variables.end()) {
                 my::printcol("[#orange:Variable [{} = {}] removed]\n\n",
                              it->first, it->second);
-                removeVariable(it->first, options);
-                variables.erase(it);
+                suggestions.removed(std::string(it->first));
+                variables.erase(name);
+                session.save();
                 continue;
             }
 
@@ -410,61 +1732,43 @@ auto main() -> int {
             continue;
         }
 
-        // commands
-
-        // conversion routine
-        if (options.enableConverters) {
-            auto convertError = korowa::SyntaxError();
-            const auto converted = korowa::convert(buffer, convertError);  // <- small subroutine for converting between different systems
-
-            if (convertError.type() != korowa::SyntaxError::Type::Parsing) {
-                if (convertError) {
-                    my::printcol("[#red:Error occurred: \"{}\"\n\n]", convertError);
-                    logToFile(file, options, buffer,
-                              my::format("Error occurred: \"{}\"", convertError));
-                    continue;
-                }
-
-                my::printf(0xcf760a, ":: {}\n\n", converted);
-                logToFile(file, options, buffer, converted);
-
-                continue;
-            }
-        }
-        // conversion routine
-
-        // eval routine
-        auto evalError = korowa::SyntaxError();
-        double result{};
+        auto err = korowa::SyntaxError();
+        const auto reply = dispatch(buffer, session, options, recorder, err);
 
-        if (options.enableVariables)
-            result = korowa::eval(buffer, evalError, variables);  // <- here all hot stuff happens
-        else
-            result = korowa::eval(buffer, evalError);
-
-        if (evalError) {
-            my::printcol("[#red:Error occurred: \"{}\"\n\n]", evalError);
-            logToFile(file, options, buffer,
-                      my::format("Error occurred: \"{}\"", evalError));
+        if (err) {
+            my::printcol("[#red:Error occurred: \"{}\"\n\n]", err);
+            logToFile(file, options, buffer, my::format("Error occurred: \"{}\"", err));
 
             if (options.enableDidYouMean) {
-                if (evalError.type() == korowa::SyntaxError::Type::UnknownToken) {
-                    auto meant = my::didYouMean(evalError.params().front(), tokens);
-                    my::printcol("Did you mean: [#orange:{}]?\n\n", meant);
+                if (err.type() == korowa::SyntaxError::Type::UnknownToken) {
+                    const auto meant = suggestions.suggest(err.symbol(), session, options);
+                    if (!meant.empty())
+                        my::printcol("Did you mean: [#orange:{}]?\n\n", my::join(meant, ", "));
                 }
             }
             continue;
         }
 
-        const auto res = getStyled(result, options);
-        my::printf(0x71db00, ":: {}\n\n", res);
-        logToFile(file, options, buffer, res);
+        if (reply.notice) {
+            my::printcol("[#orange:{}]\n\n", reply.result);
+            continue;
+        }
 
-        // eval routine
+        if (reply.detail.empty()) {
+            my::printf(reply.color, ":: {}\n\n", reply.result);
+        } else {
+            my::printf(reply.color, ":: {}\n", reply.result);
+            my::printcol("[#878787:   {}]\n\n", reply.detail);
+        }
+        logToFile(file, options, buffer, reply.result);
 
-        if (variables.size() != prevVarsSize) saveVariables(variables, options);
+        // the names are another session's or a snapshot's now, a snapshot changes none
+        if (buffer == "rollback" or buffer.rfind("use session ", 0) == 0) suggestions.reset();
+        if (!reply.added.empty()) suggestions.added(reply.added);
     }
 
+    if (korowa::stats::enabled) dumpStats(options);
+
     my::printcol(exitBanner);
     system("pause > nul");
 
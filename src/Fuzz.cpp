@@ -0,0 +1,541 @@
+// Fuzzing and differential testing harness for tokenize/parse/eval.
+//
+// Every input is evaluated by the reference path (eval with variables) and by every
+// other evaluation path, results are compared bit for bit (any NaN equals any NaN)
+// together with the error status. Inputs using generators (rnd, time) are only
+// checked for crashes.
+//
+// libFuzzer: clang++ -std=c++17 -g -O1 -fsanitize=fuzzer,address,undefined -DKOROWA_LIBFUZZER
+// AFL:       afl-clang-fast++ -std=c++17 -fsanitize=address,undefined, then afl-fuzz ... -- Fuzz @@
+// offline:   Fuzz --random 100000 [--seed 42]   random expressions of the grammar and mutations of them
+//            Fuzz file...                        replay inputs, - reads stdin
+//            Fuzz --accuracy                     fast math kernels against libm over dense sweeps
+#include <cstdint>
+#include <cstring>
+#include <korowa/FastMath.hpp>
+#include <fstream>
+#include <functional>
+#include <korowa/Capture.hpp>
+#include <korowa/Compiler.hpp>
+#include <korowa/Dual.hpp>
+#include <korowa/Exact.hpp>
+#include <korowa/Fused.hpp>
+#include <korowa/Incremental.hpp>
+#include <korowa/Lexer.hpp>
+#include <korowa/Optimizer.hpp>
+#include <korowa/Stream.hpp>
+#include <my/printer/Format.hpp>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using Variables = korowa::Variables;
+
+const Variables fixture{
+    {"x", 1.5},
+    {"y", -2.0},
+    {"z", 0.0},
+    {"big", 1e300},
+    {"longName", 42.0},
+};
+
+struct Outcome {
+    double value = 0;
+    bool failed = false;
+    bool exactBeyondDouble = false;  // exact integers past 2^53 may differ from double results
+    double tolerance = 0;            // relative difference accepted, 0 asks for the same bits
+};
+
+/**
+ * @brief Evaluation path compared against the reference.
+ * Paths which can't handle variables, assignment or arrays skip such inputs.
+ */
+struct Path {
+    const char* name;
+    bool handlesVariables;
+    bool handlesArrays;
+    std::function<Outcome(const std::string&)> run;
+};
+
+const std::vector<Path>& paths() {
+    static const std::vector<Path> table{
+        {"eval(input, err)", false, true,
+         [](const std::string& input) {
+             auto err = korowa::SyntaxError();
+             const auto value = korowa::eval(input, err);
+             return Outcome{value, !!err};
+         }},
+        {"eval(input)", false, true,
+         [](const std::string& input) {
+             const auto value = korowa::eval(input);
+             return Outcome{value, std::isnan(value)};
+         }},
+        {"execute(compile(input))", true, false,
+         [](const std::string& input) {
+             auto err = korowa::SyntaxError();
+             const auto program = korowa::compile(input, err);
+             const auto slots = err ? std::vector<double>{} : korowa::bindVariables(program, fixture, err);
+             if (err) return Outcome{0, true};
+             return Outcome{korowa::execute(program, slots.data()), false};
+         }},
+        {"execute(compile(stream of input))", true, false,
+         [](const std::string& input) {
+             // chunks of 1 or 3 characters split tokens everywhere
+             std::istringstream stream(input);
+             auto err = korowa::SyntaxError();
+             const auto program = korowa::compile(stream, err, input.size() % 2 ? 1 : 3);
+             const auto slots = err ? std::vector<double>{} : korowa::bindVariables(program, fixture, err);
+             if (err) return Outcome{0, true};
+             return Outcome{korowa::execute(program, slots.data()), false};
+         }},
+        {"execute(optimize(compile(input), Strict))", true, false,
+         [](const std::string& input) {
+             auto err = korowa::SyntaxError();
+             const auto program = korowa::compile(input, err);
+             const auto slots = err ? std::vector<double>{} : korowa::bindVariables(program, fixture, err);
+             if (err) return Outcome{0, true};
+             const auto optimized = korowa::optimize(program, korowa::FloatMode::Strict);
+             return Outcome{korowa::execute(optimized, slots.data()), false};
+         }},
+        {"execute(optimize(compile(input), Relaxed))", true, false,
+         [](const std::string& input) {
+             auto err = korowa::SyntaxError();
+             const auto program = korowa::compile(input, err);
+             const auto slots = err ? std::vector<double>{} : korowa::bindVariables(program, fixture, err);
+             if (err) return Outcome{0, true};
+             // relaxed results are rounded differently, but the program has to stay well formed
+             const auto relaxed = korowa::optimize(program, korowa::FloatMode::Relaxed);
+             if (not korowa::verify(relaxed.view(), relaxed.symbols.size())) return Outcome{0, true};
+             return Outcome{korowa::execute(relaxed, slots.data()), false, false, 1e-9};
+         }},
+        {"gradient(compile(input))", true, false,
+         [](const std::string& input) {
+             auto err = korowa::SyntaxError();
+             const auto program = korowa::compile(input, err);
+             const auto slots = err ? std::vector<double>{} : korowa::bindVariables(program, fixture, err);
+             if (err) return Outcome{0, true};
+             return Outcome{korowa::gradient(program, slots).value, false};
+         }},
+        {"execute<Exact>(compile(input))", true, false,
+         [](const std::string& input) {
+             auto err = korowa::SyntaxError();
+             const auto program = korowa::compile(input, err);
+             const auto values = err ? std::vector<double>{} : korowa::bindVariables(program, fixture, err);
+             if (err) return Outcome{0, true};
+             const std::vector<korowa::Exact> slots(values.begin(), values.end());
+             const auto result = korowa::execute(program, slots.data());
+             return Outcome{result.value, false, result.wide};
+         }},
+        {"executeBlock(fuse(abs(program), program))", true, false,
+         [](const std::string& input) {
+             // abs(program) shares every node but the last, program's result has to be unaffected
+             auto err = korowa::SyntaxError();
+             auto program = korowa::compile(input, err);
+             if (err) return Outcome{0, true};
+             auto absolute = program;
+             absolute.code.push_back({korowa::detail::Abs});
+             const auto fused = korowa::fuse({absolute, program});
+             const auto slots = korowa::bindVariables(fused, fixture, err);
+             if (err) return Outcome{0, true};
+
+             std::vector<double> out(2 * korowa::blockSize), scratch;
+             const auto load = [&slots](size_t slot, size_t) { return slots[slot]; };
+             korowa::executeBlock(fused, 3, load, out.data(), scratch);
+             return Outcome{out[korowa::blockSize + 2], false};
+         }},
+        {"evalArray(input, err, variables)", true, true,
+         [](const std::string& input) {
+             auto variables = fixture;
+             auto err = korowa::SyntaxError();
+             const auto result = korowa::evalArray(input, err, variables);
+             if (err or result.values.size() != 1) return Outcome{0, true};
+             return Outcome{result.values.front(), false};
+         }},
+        {"IncrementalExpression typed, edited", true, true,
+         [](const std::string& input) {
+             // typed character by character, then a character in the middle and then the first
+             // one deleted and retyped, the last edits update without checkpoints
+             korowa::IncrementalExpression expression;
+             for (size_t i = 1; i <= input.size(); ++i) expression.update(input.substr(0, i));
+             for (const auto position : {input.size() / 2, size_t(0)}) {
+                 auto edited = input;
+                 edited.erase(position, input.empty() ? 0 : 1);
+                 expression.update(edited);
+                 expression.update(input);
+             }
+
+             auto err = korowa::SyntaxError();
+             const auto value = expression.evaluate(err, fixture);
+             return Outcome{value, !!err};
+         }},
+        {"IncrementalExpression preferring exact", true, true,
+         [](const std::string& input) {
+             korowa::IncrementalExpression expression;
+             expression.update(input);
+             auto err = korowa::SyntaxError();
+             const auto preview = expression.evaluatePreferExact(err, fixture);
+
+             // the preview differing from what evalPreferExact gives counts as a failure
+             auto variables = fixture;
+             auto expected = korowa::SyntaxError();
+             const auto result = korowa::evalPreferExact(input, expected, &variables);
+             const auto differs = preview.exact != result.exact or preview.integer != result.integer;
+             return Outcome{preview.value, !!err or differs, std::abs(preview.value) >= 0x1p53};
+         }},
+        {"replay(capture(input, variables))", true, true,
+         [](const std::string& input) {
+             // integer-only inputs are evaluated exactly, as in the calculator
+             auto variables = fixture;
+             auto err = korowa::SyntaxError();
+             const auto record = korowa::capture(input, err, &variables);
+             const auto again = korowa::replay(record);
+             // a replay which differs from its capture flips the error status
+             const auto failed = korowa::sameOutcome(record, again) == !!err;
+             return Outcome{again.result, failed, std::abs(again.result) >= 0x1p53};
+         }},
+    };
+    return table;
+}
+
+Outcome reference(const std::string& input) {
+    auto variables = fixture;
+    auto err = korowa::SyntaxError();
+    const auto value = korowa::eval(input, err, variables);
+    return {value, !!err};
+}
+
+bool same(double a, double b) {
+    if (std::isnan(a) and std::isnan(b)) return true;
+    uint64_t ua, ub;
+    std::memcpy(&ua, &a, sizeof(a));
+    std::memcpy(&ub, &b, sizeof(b));
+    return ua == ub;
+}
+
+/// @return whether actual is within relative tolerance of a finite expected, others aren't compared
+bool near(double actual, double expected, double tolerance) {
+    if (not std::isfinite(expected)) return true;
+    // a few units of the last subnormal place cover results rounded to the subnormal grid
+    return std::fabs(actual - expected) <=
+           tolerance * std::max(std::fabs(actual), std::fabs(expected)) +
+               16 * std::numeric_limits<double>::denorm_min();
+}
+
+std::string bits(double value) {
+    uint64_t raw;
+    std::memcpy(&raw, &value, sizeof(value));
+    std::stringstream ss;
+    ss << std::hex << raw;
+    return ss.str();
+}
+
+/// @return false and report on the first path disagreeing with the reference
+bool check(const std::string& input) {
+    const auto expected = reference(input);
+
+    bool usesVariables = false, usesArrays = false, deterministic = true;
+    for (const auto& token : korowa::detail::tokenize(input)) {
+        usesVariables |= token.spec == korowa::detail::Variable or
+                         token.spec == korowa::detail::Equals;
+        usesArrays |= token.spec == korowa::detail::LeftArrPars or
+                      token.spec == korowa::detail::Factor;
+        deterministic &= korowa::detail::isDeterministic(token.spec);
+    }
+    if (not deterministic) {
+        for (const auto& path : paths()) path.run(input);
+        return true;
+    }
+
+    for (const auto& path : paths()) {
+        if ((usesVariables and not path.handlesVariables) or (usesArrays and not path.handlesArrays))
+            continue;
+
+        const auto actual = path.run(input);
+        // NaN is the only error signal of eval(input), so there a NaN result equals an error
+        const auto nanIsError = std::strcmp(path.name, "eval(input)") == 0;
+        const auto expectedFailed = expected.failed or (nanIsError and std::isnan(expected.value));
+
+        const auto agrees = actual.tolerance ? near(actual.value, expected.value, actual.tolerance)
+                                             : same(actual.value, expected.value) or actual.exactBeyondDouble;
+        if (actual.failed != expectedFailed or (not expectedFailed and not agrees)) {
+            my::printf(std::cerr, "mismatch on [{}]\n  reference:  {} ({}){}\n  {}: {} ({}){}\n",
+                       input, expected.value, bits(expected.value), expected.failed ? " error" : "",
+                       path.name, actual.value, bits(actual.value), actual.failed ? " error" : "");
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Random expressions of the calculator grammar, optionally mutated on byte level
+ */
+class Generator {
+   public:
+    explicit Generator(uint64_t seed) : random(seed) {
+        for (const auto& [name, spec] : korowa::detail::functions()) {
+            // sieving time grows with the argument, they get bounded ones of their own
+            if (spec == korowa::detail::NthPrime or spec == korowa::detail::PrimePi)
+                primes.push_back(name);
+            else if (korowa::detail::isTernaryFn(spec))
+                ternary.push_back(name);
+            else
+                (korowa::detail::isBinaryFn(spec) ? binary : unary).push_back(name);
+        }
+        for (const auto& [name, spec] : korowa::detail::constants()) constants.push_back(name);
+        for (const auto& [name, value] : fixture) variables.emplace_back(name);
+    }
+
+    std::string next() {
+        // right-nested chains around the operand stack limit
+        if (pick(500) == 0) return chain(korowa::detail::maxStackDepth - 2 + pick(5));
+
+        auto expression = expr(0);
+        // a mutated digit or operator could lift the bound of a prime function argument
+        if (pick(3) == 0 and expression.find("prime") == std::string::npos) mutate(expression);
+        if (pick(8) == 0) expression = variables[pick(variables.size())] + " = (" + expression + ")";
+        return expression;
+    }
+
+   private:
+    size_t pick(size_t count) { return std::uniform_int_distribution<size_t>(0, count - 1)(random); }
+
+    std::string space() { return pick(4) == 0 ? " " : ""; }
+
+    std::string number() {
+        switch (pick(5)) {
+            case 0:
+                return std::to_string(pick(10));
+            case 1:
+                return std::to_string(pick(1'000'000));
+            case 2:
+                return std::to_string(pick(100)) + "." + std::to_string(pick(1000));
+            case 3:
+                return "." + std::to_string(pick(100));
+            default:
+                return std::to_string(pick(1000)) + "'" + std::to_string(100 + pick(900));
+        }
+    }
+
+    std::string expr(size_t depth) {
+        const auto leaf = depth > 6 or pick(3) == 0;
+        if (leaf) {
+            switch (pick(4)) {
+                case 0:
+                    return constants[pick(constants.size())];
+                case 1:
+                    return variables[pick(variables.size())];
+                default:
+                    return number();
+            }
+        }
+
+        static const char* operators[]{"+", "-", "*", "/", "%", "^", "**", "<", "<=",
+                                        ">", ">=", "==", "!=", "&&", "||"};
+        switch (pick(10)) {
+            case 0:
+                return unary[pick(unary.size())] + "(" + expr(depth + 1) + ")";
+            case 1:
+                return binary[pick(binary.size())] + "(" + expr(depth + 1) + "," + space() +
+                       expr(depth + 1) + ")";
+            case 2:
+                return "(" + expr(depth + 1) + ")";
+            case 3:
+                return "-" + expr(depth + 1);
+            case 4: {
+                // a factorial right before a comparison, x!==y is x! == y
+                static const char* comparisons[]{"==", "!=", "<", "<=", ">", ">="};
+                const auto factorial = std::to_string(pick(8)) + "!";
+                if (pick(2)) return factorial;
+                return factorial + space() + comparisons[pick(std::size(comparisons))] + space() +
+                       expr(depth + 1);
+            }
+            case 8:
+                return ternary[pick(ternary.size())] + "(" + expr(depth + 1) + "," + space() +
+                       expr(depth + 1) + "," + space() + expr(depth + 1) + ")";
+            case 9: {
+                // small exact indices hit the cached table, the modulo the rest of the domain
+                const auto& name = primes[pick(primes.size())];
+                if (pick(2)) return name + "(" + std::to_string(pick(200'000)) + ")";
+                return name + "((" + expr(depth + 1) + ") % 100000)";
+            }
+            case 5: {
+                std::string array = "[";
+                for (size_t i = pick(4); i > 0; --i) array += expr(depth + 1) + (i > 1 ? "," : "");
+                return array + "]";
+            }
+            default:
+                return expr(depth + 1) + space() + operators[pick(std::size(operators))] +
+                       space() + expr(depth + 1);
+        }
+    }
+
+    /// @brief a + (b * (c - ...)), keeps depth operands pending before the innermost operation
+    std::string chain(size_t depth) {
+        static const char* operators[]{"+", "-", "*"};
+        std::string expression;
+        for (size_t i = 1; i < depth; ++i)
+            expression += variables[pick(variables.size())] + operators[pick(std::size(operators))] + "(";
+        return expression + number() + std::string(depth - 1, ')');
+    }
+
+    void mutate(std::string& expression) {
+        static const std::string alphabet = "0123456789.+-*/%^!()[]{},= xyzpie'<>&|";
+        const auto edits = 1 + pick(3);
+        for (size_t i = 0; i < edits; ++i) {
+            const auto at = expression.empty() ? 0 : pick(expression.size());
+            const auto ch = alphabet[pick(alphabet.size())];
+            switch (pick(3)) {
+                case 0:
+                    expression.insert(expression.begin() + at, ch);
+                    break;
+                case 1:
+                    if (not expression.empty()) expression.erase(at, 1);
+                    break;
+                default:
+                    if (not expression.empty()) expression[at] = ch;
+            }
+        }
+    }
+
+    std::mt19937_64 random;
+    std::vector<std::string> unary{}, binary{}, ternary{}, primes{}, constants{}, variables{};
+};
+
+std::string functionName(korowa::detail::Spec op) {
+    for (const auto& [name, spec] : korowa::detail::functions())
+        if (spec == op) return name;
+    return "?";
+}
+
+/// @brief Error of value of op at x, relative for exp, ln and lg, absolute for sin and cos
+double accuracyError(korowa::detail::Spec op, double x, double value) {
+    using namespace korowa::detail;
+    const auto expected = performUnaryFn(op, x);
+    const auto relative = op == Exp or op == Ln or op == Lg;
+    return std::fabs(value - expected) / (relative ? std::max(std::fabs(expected), 0x1p-1022) : 1);
+}
+
+/**
+ * @brief Compares fast math kernels with the strict path over dense sweeps of their domains.
+ * Errors beyond fastmath::maxError fail, so do zero, infinite or NaN results differing from strict ones.
+ *
+ * @return number of failed sweeps
+ */
+size_t checkAccuracy() {
+    using namespace korowa::detail;
+
+    struct Sweep {
+        Spec op;
+        double from, to;
+        bool logarithmic;  // points spread evenly over exponents
+    };
+    static const Sweep sweeps[]{
+        {Exp, -708, 708, false},  {Exp, -1, 1, false},    {Ln, 0x1p-1022, 0x1p1023, true},
+        {Ln, 0.5, 2, false},      {Lg, 0x1p-1022, 0x1p1023, true}, {Lg, 0.5, 2, false},
+        {Sin, -1e5, 1e5, false},  {Sin, -4, 4, false},    {Cos, -1e5, 1e5, false},
+        {Cos, -4, 4, false}};
+    static const double specials[]{0.0, -0.0, 1.0, -1.0, 1e-310, -1e-310, 709.5, -709.5, -745.5,
+                                   1e6, -1e300, 1e300, HUGE_VAL, -HUGE_VAL, NAN};
+    constexpr size_t points = 1 << 20;
+
+    size_t failures = 0;
+    for (const auto accuracy : {korowa::Accuracy::Fast, korowa::Accuracy::Approx}) {
+        for (const auto& sweep : sweeps) {
+            std::vector<double> inputs(points);
+            for (size_t i = 0; i < points; ++i) {
+                const auto t = double(i) / (points - 1);
+                inputs[i] = sweep.logarithmic
+                                ? std::exp2(std::log2(sweep.from) * (1 - t) + std::log2(sweep.to) * t)
+                                : sweep.from + (sweep.to - sweep.from) * t;
+            }
+            auto outputs = inputs;
+            korowa::fastmath::apply(sweep.op, outputs.data(), points, accuracy);
+
+            double worst = 0, worstAt = 0;
+            for (size_t i = 0; i < points; ++i) {
+                const auto error = accuracyError(sweep.op, inputs[i], outputs[i]);
+                if (not(error <= worst)) worst = error, worstAt = inputs[i];
+            }
+
+            const auto bound = korowa::fastmath::maxError(sweep.op, accuracy);
+            const auto failed = not(worst <= bound);
+            failures += failed;
+            my::printf("{} {} [{}, {}]: max error 2^{} at {}, bound 2^{}{}\n",
+                       accuracy == korowa::Accuracy::Fast ? "fast" : "approx",
+                       functionName(sweep.op), sweep.from, sweep.to,
+                       std::round(std::log2(worst) * 100) / 100, worstAt, std::log2(bound),
+                       failed ? " FAILED" : "");
+        }
+
+        for (const auto op : {Exp, Ln, Lg, Sin, Cos}) {
+            double values[std::size(specials)];
+            std::copy(std::begin(specials), std::end(specials), values);
+            korowa::fastmath::apply(op, values, std::size(values), accuracy);
+            for (size_t i = 0; i < std::size(values); ++i) {
+                const auto expected = performUnaryFn(op, specials[i]);
+                if (expected != 0 and std::isfinite(expected)
+                        ? accuracyError(op, specials[i], values[i]) <= korowa::fastmath::maxError(op, accuracy)
+                        : same(values[i], expected))
+                    continue;
+                ++failures;
+                my::printf("{}({}) = {} differs from strict {}\n", functionName(op),
+                           specials[i], values[i], performUnaryFn(op, specials[i]));
+            }
+        }
+    }
+    return failures;
+}
+
+#ifdef KOROWA_LIBFUZZER
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    if (not check(std::string((const char*)data, size))) std::abort();
+    return 0;
+}
+
+#else
+
+auto main(int argc, char** argv) -> int {
+    const std::vector<std::string> args(argv + 1, argv + argc);
+
+    size_t count = 0;
+    uint64_t seed = 42;
+    std::vector<std::string> files;
+
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i] == "--accuracy") {
+            const auto failures = checkAccuracy();
+            my::printf("{} accuracy failures\n", failures);
+            return failures ? 1 : 0;
+        }
+        if (args[i] == "--random" and i + 1 < args.size())
+            count = std::stoull(args[++i]);
+        else if (args[i] == "--seed" and i + 1 < args.size())
+            seed = std::stoull(args[++i]);
+        else
+            files.push_back(args[i]);
+    }
+
+    size_t failures = 0;
+
+    for (const auto& name : files) {
+        std::stringstream ss;
+        if (name == "-") {
+            ss << std::cin.rdbuf();
+        } else {
+            std::ifstream file(name, std::ios::binary);
+            ss << file.rdbuf();
+        }
+        failures += not check(ss.str());
+    }
+
+    Generator generator(seed);
+    for (size_t i = 0; i < count; ++i) failures += not check(generator.next());
+
+    my::printf("{} inputs, {} mismatches (seed {})\n", files.size() + count, failures, seed);
+    return failures ? 1 : 0;
+}
+
+#endif
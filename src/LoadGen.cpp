@@ -0,0 +1,133 @@
+// Load generator for the calculator server mode (Calculator --serve).
+// usage: LoadGen [endpoint] [-c connections] [-d pipeline depth] [-n requests per connection]
+//                [--length] [-e expression]...
+#include <algorithm>
+#include <chrono>
+#include <korowa/Server.hpp>
+#include <my/printer/Format.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct Settings {
+    std::string endpoint = "korowa.sock";
+    size_t connections = 4;
+    size_t depth = 32;
+    size_t requests = 100'000;
+    korowa::Framing framing = korowa::Framing::Line;
+    std::vector<std::string> expressions{};
+};
+
+struct Report {
+    std::vector<uint64_t> latencies{};  // ns
+    size_t errors = 0;
+    bool failed = false;
+};
+
+auto drive(const Settings& settings, Report& report) {
+    auto error = korowa::SyntaxError();
+    auto socket = korowa::Socket::connect(settings.endpoint, error);
+    if (!socket.valid()) {
+        my::printf(std::cerr, "{}\n", error);
+        report.failed = true;
+        return;
+    }
+
+    korowa::detail::FrameReader reader(settings.framing);
+    std::vector<Clock::time_point> sent(settings.requests);
+    std::vector<char> chunk(64 * 1024);
+    std::string out, frame;
+    report.latencies.reserve(settings.requests);
+
+    size_t next = 0, done = 0;
+    while (done < settings.requests) {
+        out.clear();
+        while (next < settings.requests and next - done < settings.depth) {
+            const auto& expression = settings.expressions[next % settings.expressions.size()];
+            korowa::detail::appendFrame(settings.framing, std::to_string(next) + ' ' + expression, out);
+            sent[next++] = Clock::now();
+        }
+        if (!out.empty() and !socket.sendAll(out)) break;
+
+        const auto received = socket.receive(chunk.data(), chunk.size());
+        if (received <= 0) break;
+        reader.feed(chunk.data(), received);
+
+        const auto now = Clock::now();
+        while (reader.next(frame)) {
+            const auto id = std::stoull(frame.substr(0, frame.find(' ')));
+            report.latencies.push_back(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(now - sent[id]).count());
+            if (frame.find(" err ", 0) != std::string::npos) report.errors++;
+            done++;
+        }
+    }
+    report.failed = done != settings.requests;
+}
+
+auto percentile(const std::vector<uint64_t>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    return sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))] / 1000.0;
+}
+
+auto main(int argc, char** argv) -> int {
+    Settings settings;
+
+    const std::vector<std::string> args(argv + 1, argv + argc);
+    for (size_t i = 0; i < args.size(); ++i) {
+        const auto hasValue = i + 1 < args.size();
+        if (args[i] == "-c" and hasValue)
+            settings.connections = std::stoul(args[++i]);
+        else if (args[i] == "-d" and hasValue)
+            settings.depth = std::max(1ul, std::stoul(args[++i]));
+        else if (args[i] == "-n" and hasValue)
+            settings.requests = std::stoul(args[++i]);
+        else if (args[i] == "-e" and hasValue)
+            settings.expressions.push_back(args[++i]);
+        else if (args[i] == "--length")
+            settings.framing = korowa::Framing::Length;
+        else
+            settings.endpoint = args[i];
+    }
+
+    if (settings.expressions.empty())
+        settings.expressions = {
+            "2 + 2 * 2",
+            "sin(max(10 ** 2 - 4, 56) * -1) * (9! * 0.001) % 255",
+            "sqrt(lcm(12, 18)) / ln(42) + cbrt(27)",
+            "x = (3.5)",
+            "x ^ 2 - 4 * x + 1",
+        };
+
+    std::vector<Report> reports(settings.connections);
+    std::vector<std::thread> threads;
+
+    const auto start = Clock::now();
+    for (auto& report : reports)
+        threads.emplace_back([&settings, &report] { drive(settings, report); });
+    for (auto& thread : threads) thread.join();
+    const auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<uint64_t> latencies;
+    size_t errors = 0, failed = 0;
+    for (const auto& report : reports) {
+        latencies.insert(latencies.end(), report.latencies.begin(), report.latencies.end());
+        errors += report.errors;
+        failed += report.failed;
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    my::printf("endpoint:    {} ({} connections, pipeline depth {})\n",
+               settings.endpoint, settings.connections, settings.depth);
+    my::printf("responses:   {} ({} errors, {} broken connections)\n",
+               latencies.size(), errors, failed);
+    my::printf("throughput:  {} req/s\n", (size_t)(latencies.size() / seconds));
+    my::printf("latency us:  p50 {} | p90 {} | p99 {} | p99.9 {} | max {}\n",
+               percentile(latencies, 0.5), percentile(latencies, 0.9),
+               percentile(latencies, 0.99), percentile(latencies, 0.999),
+               latencies.empty() ? 0.0 : latencies.back() / 1000.0);
+
+    return failed ? 1 : 0;
+}